@@ -14,6 +14,7 @@
 #include "util.h"
 #include "crt.h"
 #include "drive.h"
+#include "drive-sound.h"
 #include "tape.h"
 #include "tapeport.h"
 #include "diskimage.h"
@@ -32,10 +33,12 @@
 #include "keymap.h"
 #include "kbdbuf.h"
 #include "joystick.h"
+#include "lightpen.h"
 #include "resources.h"
 #include "sid.h"
 #include "sid-resources.h"
 #include "uistatusbar.h"
+#include "timeprobe.h"
 #if !defined(__XCBM5x0__)
 #include "userport.h"
 #endif
@@ -50,6 +53,29 @@ long retro_now = 0;
 unsigned retro_renderloop = 1;
 bool retro_sound_keep_alive = false;
 
+/* Native runahead */
+unsigned int opt_runahead = 0;
+bool retro_runahead_hidden = false;
+bool retro_runahead_replay = false;
+static uint8_t *runahead_state = NULL;
+static size_t runahead_state_size = 0;
+
+/* In-core rewind */
+unsigned int opt_rewind = 0;
+
+/* Pipelined rendering */
+static bool opt_render_thread = false;
+
+/* Threaded true drive emulation */
+static bool opt_drive_thread = false;
+
+/* Threaded extra SIDs */
+static bool opt_sid_thread = false;
+
+/* Batched sound writes */
+static bool opt_sound_batch = false;
+bool retro_rewinding = false;
+
 /* VKBD */
 extern bool retro_vkbd;
 extern void print_vkbd(void);
@@ -74,6 +100,11 @@ static snapshot_stream_t* snapshot_stream = NULL;
 static int load_trap_happened = 0;
 static int save_trap_happened = 0;
 
+/* Snapshot size cache, refreshed only when snapshot layout affecting setup changes */
+#define SNAPSHOT_SIZE_SLACK 1024
+static size_t snapshot_size_cached = 0;
+static uint32_t snapshot_size_key = 0;
+
 unsigned int retro_devices[RETRO_DEVICES] = {0};
 unsigned int opt_video_options_display = 0;
 unsigned int opt_audio_options_display = 0;
@@ -122,6 +153,7 @@ unsigned short int pix_bytes = 2;
 static bool pix_bytes_initialized = false;
 unsigned short int retro_bmp[RETRO_BMP_SIZE] = {0};
 unsigned int retro_bmp_offset = 0;
+bool retro_bmp_changed = true;
 
 int crop_id = -1;
 int crop_id_prev = -1;
@@ -253,6 +285,7 @@ static struct retro_perf_callback perf_cb;
 
 bool libretro_supports_bitmasks = false;
 static bool libretro_supports_ff_override = false;
+static bool libretro_supports_dupe = false;
 bool libretro_ff_enabled = false;
 static bool libretro_supports_option_categories = false;
 #define HAVE_NO_LANGEXTRA
@@ -280,6 +313,7 @@ int disk_label_mode = DISK_LABEL_MODE_ASCII_OR_CAMELCASE;
 /* Forward declarations */
 bool retro_disk_set_eject_state(bool ejected);
 static void update_variables(void);
+static void retro_unserialize_post(void);
 
 /* Display message on next retro_run */
 static bool retro_message = false;
@@ -2878,6 +2912,40 @@ static void retro_set_core_options()
          },
          "enabled"
       },
+      {
+         "vice_runahead",
+         "System > Runahead",
+         "Runahead",
+         "Internal runahead for lower input latency. Frames ahead are replayed without audio and rendered only at the last one, then the real state is restored.\nDo not combine with frontend runahead!",
+         NULL,
+         "system",
+         {
+            { "disabled", NULL },
+            { "1", "1 frame" },
+            { "2", "2 frames" },
+            { "3", "3 frames" },
+            { "4", "4 frames" },
+            { NULL, NULL },
+         },
+         "disabled"
+      },
+      {
+         "vice_rewind",
+         "System > Rewind",
+         "Rewind",
+         "Internal rewind with compressed frame history, limited to the selected amount of memory. Requires 'Hotkey > Hold Rewind'.\nDo not combine with frontend rewind!",
+         NULL,
+         "system",
+         {
+            { "disabled", NULL },
+            { "16", "16MB" },
+            { "32", "32MB" },
+            { "64", "64MB" },
+            { "128", "128MB" },
+            { NULL, NULL },
+         },
+         "disabled"
+      },
 #if !defined(__X64DTV__)
       {
          "vice_reset",
@@ -2959,6 +3027,22 @@ static void retro_set_core_options()
          },
          "enabled"
       },
+#if defined(HAVE_THREADS) && !defined(__X64DTV__)
+      {
+         "vice_drive_thread",
+         "Media > Threaded True Drive Emulation",
+         "Threaded True Drive Emulation",
+         "Emulate the first disk drive in a separate thread while the computer is emulated. Only used with 1540/1541/1541-II drives without parallel cable.",
+         NULL,
+         "media",
+         {
+            { "disabled", NULL },
+            { "enabled", NULL },
+            { NULL, NULL },
+         },
+         "disabled"
+      },
+#endif
       {
          "vice_virtual_device_traps",
          "Media > Virtual Device Traps",
@@ -3545,6 +3629,22 @@ static void retro_set_core_options()
          "24bit"
 #endif
       },
+#ifdef HAVE_THREADS
+      {
+         "vice_render_thread",
+         "Video > Threaded Rendering",
+         "Threaded Rendering",
+         "Convert the lines of the frame in a separate thread while the rest of it is emulated. Does not add latency. Not used with runahead, rewind, light pens or warp mode.",
+         NULL,
+         "video",
+         {
+            { "disabled", NULL },
+            { "enabled", NULL },
+            { NULL, NULL },
+         },
+         "disabled"
+      },
+#endif
       {
          "vice_vkbd_theme",
          "OSD > Virtual KBD Theme",
@@ -3853,7 +3953,37 @@ static void retro_set_core_options()
          },
          "disabled"
       },
+#endif
+#if defined(HAVE_THREADS) && (defined(__X64__) || defined(__X64SC__) || defined(__XSCPU64__) || defined(__X128__))
+      {
+         "vice_sid_thread",
+         "Audio > Threaded Extra SIDs",
+         "Threaded Extra SIDs",
+         "Render each extra SID in a separate thread. Only used with 'ReSID' and 'ReSID-FP', and while no other sound like drive sound is playing.",
+         NULL,
+         "audio",
+         {
+            { "disabled", NULL },
+            { "enabled", NULL },
+            { NULL, NULL },
+         },
+         "disabled"
+      },
 #endif
+      {
+         "vice_sound_batch",
+         "Audio > Batched Sound Writes",
+         "Batched Sound Writes",
+         "Log writes to the SIDs and replay them once per frame. Only used with 'ReSID' and 'ReSID-FP', and while no other sound like drive sound is playing.",
+         NULL,
+         "audio",
+         {
+            { "disabled", NULL },
+            { "enabled", NULL },
+            { NULL, NULL },
+         },
+         "disabled"
+      },
       {
          "vice_resid_sampling",
          "Audio > ReSID Sampling",
@@ -4407,6 +4537,16 @@ static void retro_set_core_options()
          {{ NULL, NULL }},
          "---"
       },
+      {
+         "vice_mapper_rewind",
+         "Hotkey > Hold Rewind",
+         "Hold Rewind",
+         "Hold the mapped key to rewind. Requires 'System > Rewind'.",
+         NULL,
+         "hotkey",
+         {{ NULL, NULL }},
+         "---"
+      },
       /* Button mappings */
       {
          "vice_mapper_up",
@@ -4820,6 +4960,7 @@ static void retro_set_core_options()
             || strstr(option_defs_us[i].key, "vice_mapper_aspect_ratio_toggle")
             || strstr(option_defs_us[i].key, "vice_mapper_crop_toggle")
             || strstr(option_defs_us[i].key, "vice_mapper_warp_mode")
+            || strstr(option_defs_us[i].key, "vice_mapper_rewind")
             || strstr(option_defs_us[i].key, "vice_mapper_turbo_fire_toggle")
             || strstr(option_defs_us[i].key, "vice_mapper_save_disk_toggle")
             || strstr(option_defs_us[i].key, "vice_mapper_datasette_toggle_hotkeys")
@@ -5364,6 +5505,8 @@ void retro_set_options_display(void)
    environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
    option_display.key = "vice_mapper_warp_mode";
    environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
+   option_display.key = "vice_mapper_rewind";
+   environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
    option_display.key = "vice_mapper_turbo_fire_toggle";
    environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
    option_display.key = "vice_mapper_save_disk_toggle";
@@ -5442,6 +5585,10 @@ void retro_set_options_display(void)
    environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
    option_display.key = "vice_gfx_colors";
    environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
+#ifdef HAVE_THREADS
+   option_display.key = "vice_render_thread";
+   environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
+#endif
 #if defined(__X64__) || defined(__X64SC__) || defined(__X64DTV__) || defined(__X128__) || defined(__XSCPU64__) || defined(__XCBM5x0__) || defined(__XVIC__) || defined(__XPLUS4__)
    option_display.key = "vice_aspect_ratio";
    environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
@@ -5856,6 +6003,28 @@ static void update_variables(void)
    }
 #endif
 
+#if defined(HAVE_THREADS) && !defined(__X64DTV__)
+   GET_VAR("drive_thread")
+   {
+      if (!strcmp(var.value, "disabled")) opt_drive_thread = false;
+      else                                opt_drive_thread = true;
+   }
+#endif
+
+#if defined(HAVE_THREADS) && (defined(__X64__) || defined(__X64SC__) || defined(__XSCPU64__) || defined(__X128__))
+   GET_VAR("sid_thread")
+   {
+      if (!strcmp(var.value, "disabled")) opt_sid_thread = false;
+      else                                opt_sid_thread = true;
+   }
+#endif
+
+   GET_VAR("sound_batch")
+   {
+      if (!strcmp(var.value, "disabled")) opt_sound_batch = false;
+      else                                opt_sound_batch = true;
+   }
+
 #if !defined(__X64DTV__)
    GET_VAR("drive_sound_emulation")
    {
@@ -6555,6 +6724,14 @@ static void update_variables(void)
       }
    }
 
+#ifdef HAVE_THREADS
+   GET_VAR("render_thread")
+   {
+      if (!strcmp(var.value, "disabled")) opt_render_thread = false;
+      else                                opt_render_thread = true;
+   }
+#endif
+
 #if defined(__X128__)
    GET_VAR("vdc_filter")
    {
@@ -7031,6 +7208,21 @@ static void update_variables(void)
    }
 #endif
 
+   GET_VAR("runahead")
+   {
+      if (!strcmp(var.value, "disabled")) opt_runahead = 0;
+      else                                opt_runahead = atoi(var.value);
+   }
+
+   GET_VAR("rewind")
+   {
+      if (!strcmp(var.value, "disabled")) opt_rewind = 0;
+      else                                opt_rewind = atoi(var.value);
+
+      if (!opt_rewind)
+         retro_rewinding = false;
+   }
+
    GET_VAR("vkbd_theme")
    {
       if      (strstr(var.value, "auto"))    opt_vkbd_theme = 0;
@@ -7327,6 +7519,11 @@ static void update_variables(void)
       mapper_keys[RETRO_MAPPER_WARP_MODE] = retro_keymap_id(var.value);
    }
 
+   GET_VAR("mapper_rewind")
+   {
+      mapper_keys[RETRO_MAPPER_REWIND] = retro_keymap_id(var.value);
+   }
+
    GET_VAR("mapper_turbo_fire_toggle")
    {
       mapper_keys[RETRO_MAPPER_TURBO_FIRE] = retro_keymap_id(var.value);
@@ -7541,6 +7738,7 @@ bool retro_disk_set_eject_state(bool ejected)
                break;
             default:
                sound_drive_mute = false;
+               drive_sound_unmute();
                file_system_attach_disk(unit, 0, dc->files[dc->index]);
                autodetect_drivetype(unit);
                break;
@@ -7765,6 +7963,9 @@ void retro_init(void)
    if (environ_cb(RETRO_ENVIRONMENT_SET_FASTFORWARDING_OVERRIDE, NULL))
       libretro_supports_ff_override = true;
 
+   if (!environ_cb(RETRO_ENVIRONMENT_GET_CAN_DUPE, &libretro_supports_dupe))
+      libretro_supports_dupe = false;
+
    bool achievements = true;
    environ_cb(RETRO_ENVIRONMENT_SET_SUPPORT_ACHIEVEMENTS, &achievements);
 
@@ -7794,6 +7995,9 @@ void retro_deinit(void)
    /* Clean dynamic core option info */
    free_vice_core_options();
 
+   /* Stop the render thread before freeing what it draws with */
+   video_render_thread_shutdown();
+
    /* Free buffers used by libretro-graph */
    libretro_graph_free();
 
@@ -7804,6 +8008,7 @@ void retro_deinit(void)
    pix_bytes_initialized = false;
    libretro_supports_bitmasks = false;
    libretro_supports_ff_override = false;
+   libretro_supports_dupe = false;
    libretro_supports_option_categories = false;
 }
 
@@ -8194,6 +8399,11 @@ void retro_set_audio_sample_batch(retro_audio_sample_batch_t cb)
 
 #define RETRO_AUDIO_BATCH
 
+void retro_audio_reserve(int32_t samples)
+{
+   ensure_output_audio_buffer_capacity(samples);
+}
+
 void retro_audio_queue(const int16_t *data, int32_t samples)
 {
    if ((samples < 1) || !runstate)
@@ -8201,8 +8411,15 @@ void retro_audio_queue(const int16_t *data, int32_t samples)
 
 #if ARCHDEP_SOUND_OUTPUT_MODE == SOUND_OUTPUT_STEREO
 #ifdef RETRO_AUDIO_BATCH
+   /* The buffer is sized when the sound device opens, hand over what
+    * does not fit instead of growing it while running */
    if (output_audio_buffer.capacity - output_audio_buffer.size < samples)
-      ensure_output_audio_buffer_capacity((output_audio_buffer.capacity + samples) * 1.5);
+      upload_output_audio_buffer();
+   if (output_audio_buffer.capacity < samples)
+   {
+      audio_batch_cb(data, samples / 2);
+      return;
+   }
    memcpy(output_audio_buffer.data + output_audio_buffer.size, data, samples * sizeof(*output_audio_buffer.data));
    output_audio_buffer.size += samples;
 #else
@@ -8258,10 +8475,435 @@ void emu_model_set(int model)
 
 #define AUTOLOADWARP_TAPE_DEBUG 0
 
+/* Runahead needs a snapshot taken at the frame boundary, and state outside of
+ * snapshots (autostart, keyboard buffer) must not be consumed by replays */
+static bool retro_run_ahead_possible(void)
+{
+   return opt_runahead
+       && retro_ui_finalized
+       && maincpu_frame_boundary
+       && !vsync_get_warp_mode()
+       && !autostart_in_progress()
+       && kbdbuf_is_empty()
+       && kbdbuf_queue_is_empty();
+}
+
+static void retro_run_ahead(void)
+{
+   snapshot_stream_t *stream;
+   size_t size = retro_serialize_size();
+   unsigned int i;
+   int saved;
+
+   if (size > runahead_state_size)
+   {
+      uint8_t *state = (uint8_t *)realloc(runahead_state, size);
+      if (!state)
+      {
+         /* Plain frame without runahead */
+         log_cb(RETRO_LOG_ERROR, "Failed to allocate runahead snapshot.\n");
+         while (retro_renderloop)
+            maincpu_mainloop();
+         retro_renderloop = 1;
+         return;
+      }
+      runahead_state      = state;
+      runahead_state_size = size;
+   }
+
+   /* Don't stop and start audio on every frame due to restoring */
+   retro_sound_keep_alive = true;
+
+   /* Real frame, with audio but without rendering */
+   retro_runahead_hidden = true;
+   while (retro_renderloop)
+      maincpu_mainloop();
+   retro_renderloop = 1;
+
+   /* Only changed pages of large RAM expansions are needed */
+   snapshot_delta_set_mode(1);
+   stream = snapshot_memory_write_fopen(runahead_state, runahead_state_size);
+   saved  = maincpu_frame_boundary && machine_write_snapshot_to_stream(stream, 0, 0, 0) >= 0;
+   snapshot_fclose(stream);
+   snapshot_delta_set_mode(0);
+
+   if (!saved)
+   {
+      retro_runahead_hidden = false;
+      return;
+   }
+
+   /* Frames ahead, without audio, rendering only the last one */
+   retro_runahead_replay = true;
+   for (i = 1; i <= opt_runahead; i++)
+   {
+      retro_runahead_hidden = (i < opt_runahead);
+      while (retro_renderloop)
+         maincpu_mainloop();
+      retro_renderloop = 1;
+   }
+   retro_runahead_replay = false;
+   retro_runahead_hidden = false;
+
+   /* Back to the real frame */
+   stream = snapshot_memory_read_fopen(runahead_state, runahead_state_size);
+   if (machine_read_snapshot_from_stream(stream, 0) < 0)
+   {
+      /* Machine stays ahead, which must not repeat every frame */
+      log_cb(RETRO_LOG_ERROR, "Failed to restore runahead snapshot, runahead disabled.\n");
+      display_retro_message("Runahead disabled: restoring the snapshot failed");
+      opt_runahead = 0;
+   }
+   maincpu_import_registers();
+   snapshot_fclose(stream);
+}
+
+/* In-core rewind keeps the latest snapshot as is, and every older one as the
+ * XOR difference to its successor. Snapshots are taken in delta mode, so large
+ * RAM expansions only add the pages changed since their keyframe, and only the
+ * used part of the snapshots is compared. Differences between consecutive
+ * frames are mostly zero, so they are stored as runs of zero words and literal
+ * words */
+typedef struct rewind_patch_s {
+   size_t offset;
+   size_t size;
+   size_t state_len;        /* Used part of the older snapshot */
+} rewind_patch_t;
+
+static struct {
+   uint8_t *arena;          /* Patch storage, used as a ring */
+   size_t arena_size;
+   size_t head;             /* Offset for the next patch */
+   rewind_patch_t *patches; /* Patch ring, oldest at 'first' */
+   unsigned int patches_max;
+   unsigned int first;
+   unsigned int count;
+   uint8_t *state;          /* Latest snapshot */
+   uint8_t *scratch;        /* Snapshot being taken */
+   uint8_t *patch;          /* Patch being encoded */
+   size_t state_size;
+   size_t state_len;        /* Whole words in use, the rest is zero */
+   size_t scratch_len;
+   bool valid;
+} rewind_ring = {0};
+
+static void rewind_ring_free(void)
+{
+   free(rewind_ring.arena);
+   free(rewind_ring.patches);
+   free(rewind_ring.state);
+   free(rewind_ring.scratch);
+   free(rewind_ring.patch);
+   memset(&rewind_ring, 0, sizeof(rewind_ring));
+}
+
+static bool rewind_ring_init(size_t state_size)
+{
+   size_t arena_size = (size_t)opt_rewind << 20;
+
+   if (     rewind_ring.arena
+         && rewind_ring.arena_size == arena_size
+         && rewind_ring.state_size == state_size)
+      return true;
+
+   rewind_ring_free();
+
+   /* Most patches are a few kilobytes, small ones come from idle frames */
+   rewind_ring.arena       = (uint8_t *)malloc(arena_size);
+   rewind_ring.arena_size  = arena_size;
+   rewind_ring.patches_max = arena_size >> 9;
+   rewind_ring.patches     = (rewind_patch_t *)malloc(rewind_ring.patches_max * sizeof(rewind_patch_t));
+   rewind_ring.state       = (uint8_t *)calloc(1, state_size);
+   rewind_ring.scratch     = (uint8_t *)calloc(1, state_size);
+   rewind_ring.patch       = (uint8_t *)malloc(state_size + (state_size >> 3) + 16);
+   rewind_ring.state_size  = state_size;
+
+   if (     !rewind_ring.arena || !rewind_ring.patches
+         || !rewind_ring.state || !rewind_ring.scratch || !rewind_ring.patch)
+   {
+      log_cb(RETRO_LOG_ERROR, "Failed to allocate %uMB for rewind.\n", opt_rewind);
+      rewind_ring_free();
+      return false;
+   }
+   return true;
+}
+
+static uint8_t *rewind_varint_write(uint8_t *out, size_t value)
+{
+   while (value >= 0x80)
+   {
+      *out++ = (uint8_t)(value | 0x80);
+      value >>= 7;
+   }
+   *out++ = (uint8_t)value;
+   return out;
+}
+
+static const uint8_t *rewind_varint_read(const uint8_t *in, size_t *value)
+{
+   unsigned int shift = 0;
+   *value = 0;
+   do
+   {
+      *value |= (size_t)(*in & 0x7f) << shift;
+      shift += 7;
+   } while (*in++ & 0x80);
+   return in;
+}
+
+/* Encode 'a' XOR 'b' as pairs of zero word and literal word counts,
+ * followed by the literal words */
+static size_t rewind_patch_encode(uint8_t *out, const uint8_t *a, const uint8_t *b, size_t size)
+{
+   const uint64_t *wa = (const uint64_t *)a;
+   const uint64_t *wb = (const uint64_t *)b;
+   size_t words = size / sizeof(uint64_t);
+   size_t i = 0, zeros, literals;
+   uint8_t *p = out;
+
+   while (i < words)
+   {
+      zeros = i;
+      while (i < words && wa[i] == wb[i])
+         i++;
+      zeros = i - zeros;
+
+      literals = i;
+      while (i < words && wa[i] != wb[i])
+         i++;
+      literals = i - literals;
+
+      p = rewind_varint_write(p, zeros);
+      p = rewind_varint_write(p, literals);
+      for (; literals; literals--, p += sizeof(uint64_t))
+      {
+         uint64_t x = wa[i - literals] ^ wb[i - literals];
+         memcpy(p, &x, sizeof(uint64_t));
+      }
+   }
+   return p - out;
+}
+
+static void rewind_patch_apply(uint8_t *state, const uint8_t *patch, size_t patch_size)
+{
+   uint64_t *w = (uint64_t *)state;
+   const uint8_t *p = patch;
+   const uint8_t *end = patch + patch_size;
+   size_t zeros, literals;
+
+   while (p < end)
+   {
+      p = rewind_varint_read(p, &zeros);
+      p = rewind_varint_read(p, &literals);
+      w += zeros;
+      for (; literals; literals--, p += sizeof(uint64_t))
+      {
+         uint64_t x;
+         memcpy(&x, p, sizeof(uint64_t));
+         *w++ ^= x;
+      }
+   }
+}
+
+static void rewind_ring_push(const uint8_t *patch, size_t size, size_t state_len)
+{
+   rewind_patch_t *entry;
+   size_t offset = rewind_ring.head;
+
+   if (size > rewind_ring.arena_size)
+   {
+      rewind_ring.count = 0;
+      return;
+   }
+   if (offset + size > rewind_ring.arena_size)
+      offset = 0;
+
+   /* Drop the oldest patches overlapping the new one */
+   while (rewind_ring.count)
+   {
+      rewind_patch_t *oldest = &rewind_ring.patches[rewind_ring.first];
+      if (     rewind_ring.count < rewind_ring.patches_max
+            && (oldest->offset >= offset + size || oldest->offset + oldest->size <= offset))
+         break;
+      rewind_ring.first = (rewind_ring.first + 1) % rewind_ring.patches_max;
+      rewind_ring.count--;
+   }
+
+   entry = &rewind_ring.patches[(rewind_ring.first + rewind_ring.count) % rewind_ring.patches_max];
+   entry->offset    = offset;
+   entry->size      = size;
+   entry->state_len = state_len;
+   memcpy(rewind_ring.arena + offset, patch, size);
+   rewind_ring.head = offset + size;
+   rewind_ring.count++;
+}
+
+/* Snapshot of the frame just finished goes to history */
+static void retro_rewind_capture(void)
+{
+   snapshot_stream_t *stream;
+   size_t size, used;
+   long len;
+   uint8_t *swap;
+   int saved;
+
+   if (!opt_rewind)
+   {
+      if (rewind_ring.arena)
+         rewind_ring_free();
+      return;
+   }
+
+   if (!maincpu_frame_boundary)
+      return;
+
+   /* Whole words for the patches */
+   size = (retro_serialize_size() + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+   if (!rewind_ring_init(size))
+      return;
+
+   snapshot_delta_set_mode(1);
+   stream = snapshot_memory_write_fopen(rewind_ring.scratch, size);
+   saved  = machine_write_snapshot_to_stream(stream, 0, 0, 0) >= 0;
+   len    = snapshot_ftell(stream);
+   snapshot_fclose(stream);
+   snapshot_delta_set_mode(0);
+
+   if (!saved)
+   {
+      rewind_ring.valid = false;
+      rewind_ring.count = 0;
+      return;
+   }
+
+   /* Clear what is left of an older snapshot */
+   if (rewind_ring.scratch_len > (size_t)len)
+      memset(rewind_ring.scratch + len, 0, rewind_ring.scratch_len - len);
+   used = ((size_t)len + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+   memset(rewind_ring.scratch + len, 0, used - len);
+
+   if (rewind_ring.valid)
+   {
+      size_t compared = (used > rewind_ring.state_len) ? used : rewind_ring.state_len;
+      rewind_ring_push(rewind_ring.patch,
+            rewind_patch_encode(rewind_ring.patch, rewind_ring.scratch, rewind_ring.state, compared),
+            rewind_ring.state_len);
+   }
+
+   swap                    = rewind_ring.state;
+   rewind_ring.state       = rewind_ring.scratch;
+   rewind_ring.scratch     = swap;
+   rewind_ring.scratch_len = rewind_ring.state_len;
+   rewind_ring.state_len   = used;
+   rewind_ring.valid       = true;
+}
+
+/* Step one frame back in history instead of running one */
+static void retro_rewind_step(void)
+{
+   snapshot_stream_t *stream;
+   rewind_patch_t *entry;
+
+   if (!rewind_ring.valid || !maincpu_frame_boundary)
+      return;
+
+   if (rewind_ring.count)
+   {
+      rewind_ring.count--;
+      entry = &rewind_ring.patches[(rewind_ring.first + rewind_ring.count) % rewind_ring.patches_max];
+      rewind_patch_apply(rewind_ring.state, rewind_ring.arena + entry->offset, entry->size);
+      rewind_ring.state_len = entry->state_len;
+      rewind_ring.head      = entry->offset;
+   }
+
+   autostart_reset();
+   retro_sound_keep_alive = true;
+   stream = snapshot_memory_read_fopen(rewind_ring.state, rewind_ring.state_size);
+   if (machine_read_snapshot_from_stream(stream, 0) < 0)
+   {
+      log_cb(RETRO_LOG_ERROR, "Failed to restore rewind snapshot.\n");
+      rewind_ring.valid = false;
+      rewind_ring.count = 0;
+   }
+   maincpu_import_registers();
+   snapshot_fclose(stream);
+   retro_unserialize_post();
+
+   /* Render the restored frame without audio */
+   retro_runahead_replay = true;
+   while (retro_renderloop)
+      maincpu_mainloop();
+   retro_renderloop = 1;
+   retro_runahead_replay = false;
+}
+
+static uint64_t retro_bmp_rows_hash(int first, int last)
+{
+   const uint64_t *p, *end;
+   uint64_t hash = 0;
+
+   if (first < 0)
+      first = 0;
+   if (last >= (int)retroh)
+      last = retroh - 1;
+   if (last < first)
+      return 0;
+
+   p   = (const uint64_t *)((const uint8_t *)retro_bmp + (first * retrow * pix_bytes));
+   end = (const uint64_t *)((const uint8_t *)retro_bmp + ((last + 1) * retrow * pix_bytes));
+   while (p < end)
+      hash = ((hash << 5) | (hash >> 59)) ^ (*p++ * 0x9e3779b97f4a7c15ULL);
+   return hash;
+}
+
+/* Previous frame can be shown again, if the emulated screen was not rendered
+ * differently, and if the overlays drawn over it are the same */
+static bool retro_video_dupe(void)
+{
+   static int first_prev = 0, last_prev = -1;
+   static uint64_t hash_prev = 0;
+   static unsigned int offset_prev = 0, width_prev = 0, height_prev = 0;
+   uint64_t hash;
+   bool dupe;
+
+   if (!libretro_supports_dupe)
+      return false;
+
+   hash = retro_bmp_rows_hash(draw_rows_first, draw_rows_last);
+   dupe =   !retro_bmp_changed
+         && hash              == hash_prev
+         && draw_rows_first   == first_prev
+         && draw_rows_last    == last_prev
+         && retro_bmp_offset  == offset_prev
+         && retrow_crop       == width_prev
+         && retroh_crop       == height_prev;
+
+   hash_prev   = hash;
+   first_prev  = draw_rows_first;
+   last_prev   = draw_rows_last;
+   offset_prev = retro_bmp_offset;
+   width_prev  = retrow_crop;
+   height_prev = retroh_crop;
+   return dupe;
+}
+
+/* Pipelined rendering converts frames after their emulation, so every frame
+ * must be emulated once, and nothing else may draw during emulation */
+static bool retro_render_thread_possible(void)
+{
+   return opt_render_thread
+       && retro_ui_finalized
+       && !opt_runahead
+       && !retro_rewinding
+       && !lightpen_enabled;
+}
+
 void retro_run(void)
 {
    /* Core options */
    bool updated = false;
+
+   TIMEPROBE_ENTER(TIMEPROBE_FRONTEND);
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &updated) && updated)
       update_variables();
 
@@ -8412,9 +9054,29 @@ void retro_run(void)
    retro_poll_event();
 
    /* Main loop */
-   while (retro_renderloop)
-      maincpu_mainloop();
-   retro_renderloop = 1;
+#if defined(HAVE_THREADS) && !defined(__X64DTV__)
+   drive_thread_set_enabled(opt_drive_thread && retro_ui_finalized);
+#endif
+#if defined(HAVE_THREADS) && (defined(__X64__) || defined(__X64SC__) || defined(__XSCPU64__) || defined(__X128__))
+   sid_thread_set_enabled(opt_sid_thread && retro_ui_finalized);
+#endif
+   sound_batch_set_enabled(opt_sound_batch && retro_ui_finalized);
+   video_render_thread_begin(retro_render_thread_possible());
+   if (retro_rewinding)
+      retro_rewind_step();
+   else
+   {
+      if (retro_run_ahead_possible())
+         retro_run_ahead();
+      else
+      {
+         while (retro_renderloop)
+            maincpu_mainloop();
+         retro_renderloop = 1;
+      }
+      retro_rewind_capture();
+   }
+   video_render_thread_end();
    retro_now += 1000000 / retro_refresh;
 
    retro_sound_keep_alive = false;
@@ -8465,7 +9127,11 @@ void retro_run(void)
    }
 
    /* Video output */
-   video_cb(retro_bmp + retro_bmp_offset, retrow_crop, retroh_crop, retrow << (pix_bytes >> 1));
+   if (retro_video_dupe())
+      video_cb(NULL, retrow_crop, retroh_crop, retrow << (pix_bytes >> 1));
+   else
+      video_cb(retro_bmp + retro_bmp_offset, retrow_crop, retroh_crop, retrow << (pix_bytes >> 1));
+   retro_bmp_changed = false;
 
    /* Audio output */
    upload_output_audio_buffer();
@@ -8487,6 +9153,11 @@ void retro_run(void)
          emu_reset(0);
       }
    }
+
+   TIMEPROBE_LEAVE();
+#ifdef TIMEPROBE
+   timeprobe_frame();
+#endif
 }
 
 bool retro_load_game(const struct retro_game_info *info)
@@ -8605,6 +9276,12 @@ void retro_unload_game(void)
    autostartProgram = NULL;
 
    retro_sound_keep_alive = false;
+   snapshot_size_cached = 0;
+   free(runahead_state);
+   runahead_state      = NULL;
+   runahead_state_size = 0;
+   rewind_ring_free();
+   retro_rewinding = false;
    cur_port_locked = false;
    opt_aspect_ratio_locked = false;
    noautostart_locked = false;
@@ -8700,6 +9377,39 @@ static void load_trap(uint16_t addr, void *success)
    load_trap_happened = 1;
 }
 
+/* Frames end on an instruction boundary with the CPU registers exported,
+ * so the trap round trip is needed only when that is not the case */
+static int retro_snapshot_save(void)
+{
+   int success = 0;
+   if (maincpu_frame_boundary)
+   {
+      save_trap(0, (void *)&success);
+      return success;
+   }
+   interrupt_maincpu_trigger_trap(save_trap, (void *)&success);
+   save_trap_happened = 0;
+   while (!save_trap_happened)
+      maincpu_mainloop();
+   return success;
+}
+
+static int retro_snapshot_load(void)
+{
+   int success = 0;
+   if (maincpu_frame_boundary)
+   {
+      load_trap(0, (void *)&success);
+      maincpu_import_registers();
+      return success;
+   }
+   interrupt_maincpu_trigger_trap(load_trap, (void *)&success);
+   load_trap_happened = 0;
+   while (!load_trap_happened)
+      maincpu_mainloop();
+   return success;
+}
+
 static void retro_unserialize_post(void)
 {
    /* Disable warp */
@@ -8713,23 +9423,106 @@ static void retro_unserialize_post(void)
    dc_sync_index();
 }
 
+/* Resources which change the amount of modules or their sizes in snapshots */
+static const char *snapshot_size_resources[] = {
+   "Drive8Type", "Drive9Type", "Drive10Type", "Drive11Type",
+   "Drive8RAM2000", "Drive8RAM4000", "Drive8RAM6000", "Drive8RAM8000", "Drive8RAMA000",
+   "Drive9RAM2000", "Drive9RAM4000", "Drive9RAM6000", "Drive9RAM8000", "Drive9RAMA000",
+   "Drive10RAM2000", "Drive10RAM4000", "Drive10RAM6000", "Drive10RAM8000", "Drive10RAMA000",
+   "Drive11RAM2000", "Drive11RAM4000", "Drive11RAM6000", "Drive11RAM8000", "Drive11RAMA000",
+   "DriveTrueEmulation",
+   "REU", "REUsize", "GEORAM", "GEORAMsize", "RAMCART", "RAMCARTsize",
+   "DQBB", "DQBBSize", "RAMLINK", "RAMLINKsize", "SSRamExpansion",
+   "IsepicCartridgeEnabled", "ExpertCartridgeEnabled", "MagicVoiceCartridgeEnabled", "CPMCart",
+   "MemoryHack", "SidStereo", "SidEngine",
+   "RamSize", "RAMBlock0", "RAMBlock1", "RAMBlock2", "RAMBlock3", "RAMBlock5",
+   "UserportDevice", "JoyPort1Device", "JoyPort2Device",
+   NULL
+};
+
+static uint32_t snapshot_size_key_add(uint32_t key, const void *data, size_t len)
+{
+   const uint8_t *p = (const uint8_t *)data;
+
+   /* FNV-1a */
+   while (len--)
+   {
+      key ^= *p++;
+      key *= 16777619u;
+   }
+   return key;
+}
+
+static uint32_t snapshot_size_key_get(void)
+{
+   uint32_t key = 2166136261u;
+   const char *name;
+   unsigned int unit;
+   int value;
+   int i;
+
+   for (i = 0; snapshot_size_resources[i]; i++)
+   {
+      if (!resources_exists(snapshot_size_resources[i]))
+         continue;
+      resources_get_int(snapshot_size_resources[i], &value);
+      key = snapshot_size_key_add(key, &value, sizeof(value));
+   }
+
+   for (unit = 8; unit < 12; unit++)
+   {
+      name = file_system_get_disk_name(unit, 0);
+      if (name)
+         key = snapshot_size_key_add(key, name, strlen(name) + 1);
+   }
+
+   name = tape_get_file_name(TAPEPORT_PORT_1);
+   if (name)
+      key = snapshot_size_key_add(key, name, strlen(name) + 1);
+
+   value = cartridge_get_id(0);
+   key = snapshot_size_key_add(key, &value, sizeof(value));
+   name = cartridge_get_filename_by_slot(0);
+   if (name)
+      key = snapshot_size_key_add(key, name, strlen(name) + 1);
+
+   key = snapshot_size_key_add(key, &tape_enabled, sizeof(tape_enabled));
+   key = snapshot_size_key_add(key, &request_model_prev, sizeof(request_model_prev));
+
+   /* Zero is reserved for 'not calculated' */
+   return key ? key : 1;
+}
+
+static void snapshot_size_invalidate(void)
+{
+   snapshot_size_cached = 0;
+   snapshot_size_key    = 0;
+}
+
 size_t retro_serialize_size(void)
 {
    long snapshot_size = 0;
    if (retro_ui_finalized)
    {
+      /* Trial snapshot is required only if the setup has changed */
+      uint32_t key = snapshot_size_key_get();
+      if (snapshot_size_cached && key == snapshot_size_key)
+         return snapshot_size_cached;
+
       snapshot_stream = snapshot_memory_write_fopen(NULL, 0);
-      int success = 0;
-      interrupt_maincpu_trigger_trap(save_trap, (void *)&success);
-      save_trap_happened = 0;
-      while (!save_trap_happened)
-         maincpu_mainloop();
+      int success = retro_snapshot_save();
       if (snapshot_stream != NULL)
       {
          if (success)
          {
             snapshot_fseek(snapshot_stream, 0, SEEK_END);
             snapshot_size = snapshot_ftell(snapshot_stream);
+
+            /* Leave room for modules with slightly varying sizes,
+             * and for page numbers of delta snapshots */
+            snapshot_size += SNAPSHOT_SIZE_SLACK + snapshot_delta_overhead();
+            snapshot_size_cached = snapshot_size;
+            snapshot_size_key    = key;
          }
          else
          {
@@ -8760,12 +9553,18 @@ bool retro_serialize(void *data_, size_t size)
 {
    if (retro_ui_finalized)
    {
+      /* Frontend rewind and runahead states never leave this session, so
+       * only changed pages of large RAM expansions are needed. Normal
+       * states may be written to disk and loaded in another session
+       * without the keyframe, and stay complete. */
+      int context = RETRO_SAVESTATE_CONTEXT_NORMAL;
+      if (!environ_cb(RETRO_ENVIRONMENT_GET_SAVESTATE_CONTEXT, &context))
+         context = RETRO_SAVESTATE_CONTEXT_NORMAL;
+      snapshot_delta_set_mode(context == RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_INSTANCE);
+
       snapshot_stream = snapshot_memory_write_fopen(data_, size);
-      int success = 0;
-      interrupt_maincpu_trigger_trap(save_trap, (void *)&success);
-      save_trap_happened = 0;
-      while (!save_trap_happened)
-         maincpu_mainloop();
+      int success = retro_snapshot_save();
+      snapshot_delta_set_mode(0);
       if (snapshot_stream != NULL)
       {
          snapshot_fclose(snapshot_stream);
@@ -8775,6 +9574,8 @@ bool retro_serialize(void *data_, size_t size)
       {
          return true;
       }
+      /* Cached size may have been outgrown by something not covered by the key */
+      snapshot_size_invalidate();
       log_cb(RETRO_LOG_ERROR, "Failed to serialize snapshot.\n");
    }
    return false;
@@ -8790,11 +9591,7 @@ bool retro_unserialize(const void *data_, size_t size)
       /* Don't stop and start audio on every frame while rewinding */
       retro_sound_keep_alive = true;
       snapshot_stream = snapshot_memory_read_fopen(data_, size);
-      int success = 0;
-      interrupt_maincpu_trigger_trap(load_trap, (void *)&success);
-      load_trap_happened = 0;
-      while (!load_trap_happened)
-         maincpu_mainloop();
+      int success = retro_snapshot_load();
       if (snapshot_stream != NULL)
       {
          snapshot_fclose(snapshot_stream);
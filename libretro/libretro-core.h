@@ -64,6 +64,7 @@ typedef uint8_t uint8;
 #endif
 #define RETRO_BMP_SIZE (WINDOW_WIDTH * WINDOW_HEIGHT * 2)
 extern unsigned short int retro_bmp[RETRO_BMP_SIZE];
+extern bool retro_bmp_changed;
 extern unsigned short int pix_bytes;
 
 #define MANUAL_CROP_OPTIONS \
@@ -140,6 +141,10 @@ extern unsigned short int pix_bytes;
 
 /* Variables */
 extern unsigned int retro_renderloop;
+extern bool retro_runahead_hidden;
+extern bool retro_runahead_replay;
+extern unsigned int opt_rewind;
+extern bool retro_rewinding;
 extern unsigned int retroXS;
 extern unsigned int retroYS;
 extern unsigned int retroXS_offset;
@@ -265,6 +270,10 @@ extern void display_retro_message(const char *message);
 extern void statusbar_message_show(signed char icon, const char *format, ...);
 extern void set_variable(const char *key, const char *value);
 extern char* get_variable(const char *key);
+extern void video_render_thread_begin(bool enabled);
+extern void video_render_thread_end(void);
+extern void video_render_thread_rows(const uint8_t *draw_buffer, unsigned int line);
+extern void video_render_thread_shutdown(void);
 
 extern void emu_function(int function);
 enum EMU_FUNCTIONS
@@ -285,6 +294,7 @@ enum EMU_FUNCTIONS
    EMU_DATASETTE_FORWARD,
    EMU_DATASETTE_REWIND,
    EMU_DATASETTE_RESET,
+   EMU_REWIND,
    EMU_FUNCTION_COUNT
 };
 
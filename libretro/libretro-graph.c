@@ -9,6 +9,24 @@
 
 unsigned short int graphed[RETRO_BMP_SIZE];
 
+/* Rows drawn over since the emulated screen was last rendered */
+int draw_rows_first = 0;
+int draw_rows_last  = -1;
+
+static void draw_rows_mark(int y, int height)
+{
+   if (draw_rows_last < draw_rows_first)
+   {
+      draw_rows_first = y;
+      draw_rows_last  = y + height - 1;
+      return;
+   }
+   if (y < draw_rows_first)
+      draw_rows_first = y;
+   if (y + height - 1 > draw_rows_last)
+      draw_rows_last = y + height - 1;
+}
+
 static uint16_t *linesurf16 = NULL;
 static int linesurf16_w     = 0;
 static int linesurf16_h     = 0;
@@ -63,6 +81,7 @@ int RGBc(int r, int g, int b)
 
 void draw_fbox(int x, int y, int dx, int dy, uint32_t color, libretro_graph_alpha_t alpha)
 {
+   draw_rows_mark(y, dy);
    if (pix_bytes == 4)
       draw_fbox_bmp32((uint32_t *)retro_bmp, x, y, dx, dy, color, alpha);
    else
@@ -190,6 +209,7 @@ void draw_fbox_bmp32(uint32_t *buffer, int x, int y, int dx, int dy, uint32_t co
 
 void draw_box(int x, int y, int dx, int dy, int width, int height, uint32_t color, libretro_graph_alpha_t alpha)
 {
+   draw_rows_mark(y, dy + height);
    if (pix_bytes == 4)
       draw_box_bmp32((uint32_t *)retro_bmp, x, y, dx, dy, width, height, color, alpha);
    else
@@ -568,6 +588,7 @@ void draw_box_bmp32(uint32_t *buffer, int x, int y, int dx, int dy, int width, i
 
 void draw_hline(int x, int y, int dx, int dy, uint32_t color)
 {
+   draw_rows_mark(y, 1);
    if (pix_bytes == 4)
       draw_hline_bmp32((uint32_t *)retro_bmp, x, y, dx, dy, color);
    else
@@ -606,6 +627,7 @@ void draw_hline_bmp32(uint32_t *buffer, int x, int y, int dx, int dy, uint32_t c
 
 void draw_vline(int x, int y, int dx, int dy, uint32_t color)
 {
+   draw_rows_mark(y, dy);
    if (pix_bytes == 4)
       draw_vline_bmp32((uint32_t *)retro_bmp, x, y, dx, dy, color);
    else
@@ -1226,6 +1248,13 @@ void draw_text(uint16_t x, uint16_t y,
       uint32_t fgcol, uint32_t bgcol, libretro_graph_alpha_t alpha, libretro_graph_bg_t draw_bg,
       uint8_t scalex, uint8_t scaley, uint16_t max, const unsigned char *string)
 {
+   unsigned int i, breaks = 0;
+
+   /* 8 pixel high characters plus outline, linebreaks advance 6 pixels */
+   for (i = 0; string && string[i] && i < max; i++)
+      breaks += (string[i] == '\1');
+   draw_rows_mark(y, (breaks * 6 + 10) * scaley);
+
    if (pix_bytes == 4)
       draw_text_bmp32((uint32_t *)retro_bmp, x, y, fgcol, bgcol, alpha, draw_bg, scalex, scaley, max, string);
    else
@@ -54,6 +54,8 @@
 #define COLOR_TAPE_32      ARGB888(255,  89,  79,  78)
 
 extern unsigned short int graphed[RETRO_BMP_SIZE];
+extern int draw_rows_first;
+extern int draw_rows_last;
 
 typedef enum {
    GRAPH_ALPHA_0 = 0,
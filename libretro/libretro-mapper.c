@@ -302,6 +302,11 @@ void emu_function(int function)
          retro_warpmode = (retro_warpmode) ? 0 : 1;
          vsync_set_warp_mode(retro_warpmode);
          break;
+      case EMU_REWIND:
+         if (!opt_rewind)
+            break;
+         retro_rewinding = !retro_rewinding;
+         break;
       case EMU_DATASETTE_HOTKEYS:
 #if defined(__X64DTV__) || defined(__XSCPU64__)
          break;
@@ -496,14 +501,18 @@ void update_input(uint8_t disable_keys)
    static int kbt[EMU_FUNCTION_COUNT] = {0};
     
    /* Iterate hotkeys, skip Datasette hotkeys if Datasette hotkeys are disabled or if VKBD is on */
-   int i_last = (datasette_hotkeys && !retro_vkbd) ? RETRO_MAPPER_DATASETTE_RESET : RETRO_MAPPER_DATASETTE_HOTKEYS;
-   i_last -= RETRO_DEVICE_ID_JOYPAD_LAST;
+   bool datasette_keys = datasette_hotkeys && !retro_vkbd;
 
-   for (i = 0; i <= i_last; i++)
+   for (i = 0; i < RETRO_MAPPER_LAST - RETRO_DEVICE_ID_JOYPAD_LAST; i++)
    {
       /* Skip RetroPad mappings from mapper_keys */
       mk = i + RETRO_DEVICE_ID_JOYPAD_LAST;
 
+      if (     !datasette_keys
+            && mk >  RETRO_MAPPER_DATASETTE_HOTKEYS
+            && mk <= RETRO_MAPPER_DATASETTE_RESET)
+         continue;
+
       /* Key down */
       if (input_state_cb(0, RETRO_DEVICE_KEYBOARD, 0, mapper_keys[mk]) && !kbt[i] && mapper_keys[mk])
       {
@@ -531,6 +540,9 @@ void update_input(uint8_t disable_keys)
             case RETRO_MAPPER_WARP_MODE:
                emu_function(EMU_WARP_MODE);
                break;
+            case RETRO_MAPPER_REWIND:
+               emu_function(EMU_REWIND);
+               break;
             case RETRO_MAPPER_TURBO_FIRE:
                emu_function(EMU_TURBO_FIRE);
                break;
@@ -585,6 +597,9 @@ void update_input(uint8_t disable_keys)
             case RETRO_MAPPER_WARP_MODE:
                emu_function(EMU_WARP_MODE);
                break;
+            case RETRO_MAPPER_REWIND:
+               emu_function(EMU_REWIND);
+               break;
          }
       }
       else if (mapper_keys_pressed_time)
@@ -727,6 +742,8 @@ void update_input(uint8_t disable_keys)
                   emu_function(EMU_CROP);
                else if (mapper_keys[i] == mapper_keys[RETRO_MAPPER_WARP_MODE])
                   emu_function(EMU_WARP_MODE);
+               else if (mapper_keys[i] == mapper_keys[RETRO_MAPPER_REWIND])
+                  emu_function(EMU_REWIND);
                else if (mapper_keys[i] == mapper_keys[RETRO_MAPPER_TURBO_FIRE])
                   emu_function(EMU_TURBO_FIRE);
                else if (mapper_keys[i] == mapper_keys[RETRO_MAPPER_SAVE_DISK])
@@ -800,6 +817,8 @@ void update_input(uint8_t disable_keys)
                   ; /* nop */
                else if (mapper_keys[i] == mapper_keys[RETRO_MAPPER_WARP_MODE])
                   emu_function(EMU_WARP_MODE);
+               else if (mapper_keys[i] == mapper_keys[RETRO_MAPPER_REWIND])
+                  emu_function(EMU_REWIND);
                else if (mapper_keys[i] == mapper_keys[RETRO_MAPPER_TURBO_FIRE])
                   ; /* nop */
                else if (mapper_keys[i] == mapper_keys[RETRO_MAPPER_SAVE_DISK])
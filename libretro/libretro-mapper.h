@@ -40,7 +40,9 @@
 #define RETRO_MAPPER_DATASETTE_REWIND   37
 #define RETRO_MAPPER_DATASETTE_RESET    38
 
-#define RETRO_MAPPER_LAST               39
+#define RETRO_MAPPER_REWIND             39
+
+#define RETRO_MAPPER_LAST               40
 
 #define TOGGLE_VKBD                     -31
 #define TOGGLE_STATUSBAR                -32
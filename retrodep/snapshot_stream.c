@@ -64,6 +64,7 @@ static char *current_filename = NULL;
 static size_t current_fpos = 0;
 
 char snapshot_magic_string[] = "VICE Snapshot File\032";
+char snapshot_delta_magic_string[] = "VICE Snapshot Delta";
 char snapshot_version_magic_string[] = "VICE Version\032";
 
 /* informal only, used by the error message created below */
@@ -72,6 +73,7 @@ static uint32_t snapshot_vicerevision;
 
 #define SNAPSHOT_MAGIC_LEN              19
 #define SNAPSHOT_VERSION_MAGIC_LEN      13
+#define SNAPSHOT_MODULE_HEADER_LEN      (SNAPSHOT_MODULE_NAME_LEN + 2 + 4)
 
 /* Stream operations interface */
 struct snapshot_stream_ops_s {
@@ -165,6 +167,65 @@ struct snapshot_s {
     int write_mode;
 };
 
+/* Pages of an older keyframe that differ from the next one */
+typedef struct snapshot_delta_undo_s {
+    /* Amount of pages */
+    unsigned int count;
+
+    /* Page numbers, ascending */
+    uint32_t *pages;
+
+    /* Page contents in the older keyframe */
+    uint8_t *data;
+} snapshot_delta_undo_t;
+
+#define SNAPSHOT_DELTA_HISTORY          8
+
+/* Memory block written as changed pages only in delta snapshots */
+typedef struct snapshot_delta_region_s {
+    /* Live memory block */
+    const uint8_t *data;
+
+    /* Size of the block */
+    unsigned int size;
+
+    /* Amount of pages in the block */
+    unsigned int pages;
+
+    /* Page flags, set by the owner when storing to the block */
+    uint8_t *dirty;
+
+    /* Block contents at the time of the current keyframe */
+    uint8_t *keyframe;
+
+    /* Older keyframes, indexed by generation modulo SNAPSHOT_DELTA_HISTORY */
+    snapshot_delta_undo_t undo[SNAPSHOT_DELTA_HISTORY];
+} snapshot_delta_region_t;
+
+#define SNAPSHOT_DELTA_REGIONS_MAX      8
+#define SNAPSHOT_DELTA_PAGE_SIZE        (1 << SNAPSHOT_DELTA_PAGE_SHIFT)
+
+/* A new keyframe is taken when more than 1/n of the pages of a block differ */
+#define SNAPSHOT_DELTA_REKEY_SHARE      4
+
+static snapshot_delta_region_t snapshot_delta_regions[SNAPSHOT_DELTA_REGIONS_MAX];
+
+/* Flag: write delta snapshots when creating from a stream */
+static int snapshot_delta_mode = 0;
+
+/* Flags: is the current snapshot a delta snapshot? */
+static int snapshot_delta_writing = 0;
+static int snapshot_delta_reading = 0;
+
+/* Keyframe generation, delta snapshots of generations older than the oldest
+   kept one are refused */
+static uint32_t snapshot_delta_generation = 0;
+static uint32_t snapshot_delta_oldest = 0;
+static int snapshot_delta_keyed = 0;
+
+/* Generation of the delta snapshot being read */
+static uint32_t snapshot_delta_read_generation = 0;
+
 int snapshot_free(snapshot_t *s)
 {
     lib_free(s);
@@ -406,6 +467,12 @@ static int snapshot_memory_fseek(snapshot_stream_t *f, long offset, int whence)
 static int snapshot_memory_fclose(snapshot_stream_t *f)
 {
     snapshot_memory_stream_t* stream = container_of(f, snapshot_memory_stream_t, istream);
+    /* Terminate with an empty module header, since retro_serialize_size() overestimates */
+    if (stream->write_mode && stream->buffer != NULL && stream->stream_size < stream->buffer_size) {
+        size_t tail = stream->buffer_size - stream->stream_size;
+        memset(stream->buffer + stream->stream_size, 0,
+               (tail < SNAPSHOT_MODULE_HEADER_LEN) ? tail : SNAPSHOT_MODULE_HEADER_LEN);
+    }
     lib_free(stream);
     return 0;
 }
@@ -791,6 +858,353 @@ static int snapshot_read_string(snapshot_stream_t *f, char **s)
     return 0;
 }
 
+/* ------------------------------------------------------------------------- */
+/* Delta snapshots
+ *
+ * Large memory blocks registered here are written as the pages changed since
+ * the last keyframe. The keyframe lives only in this process, therefore delta
+ * snapshots are meant for rewind and runahead within the same session.
+ *
+ * A new keyframe is taken when too many pages differ from the current one, so
+ * that deltas stay small. The pages that differ are kept for the last
+ * SNAPSHOT_DELTA_HISTORY keyframes, and deltas of these generations can still
+ * be read.
+ */
+
+static void snapshot_delta_undo_free(snapshot_delta_undo_t *u)
+{
+    lib_free(u->pages);
+    lib_free(u->data);
+    u->pages = NULL;
+    u->data = NULL;
+    u->count = 0;
+}
+
+static void snapshot_delta_region_free(snapshot_delta_region_t *r)
+{
+    int i;
+
+    lib_free(r->dirty);
+    lib_free(r->keyframe);
+    for (i = 0; i < SNAPSHOT_DELTA_HISTORY; i++) {
+        snapshot_delta_undo_free(&r->undo[i]);
+    }
+    memset(r, 0, sizeof(snapshot_delta_region_t));
+}
+
+uint8_t *snapshot_delta_register(const uint8_t *data, unsigned int size)
+{
+    snapshot_delta_region_t *r = NULL;
+    int i;
+
+    if (data == NULL || size == 0) {
+        return NULL;
+    }
+
+    snapshot_delta_unregister(data);
+
+    /* Blocks are detached and attached again while a snapshot is read, keep
+       the keyframe of a detached block of the same size */
+    for (i = 0; i < SNAPSHOT_DELTA_REGIONS_MAX; i++) {
+        r = &snapshot_delta_regions[i];
+        if (r->data == NULL && r->dirty != NULL && r->size == size) {
+            r->data = data;
+            memset(r->dirty, 1, r->pages);
+            return r->dirty;
+        }
+    }
+
+    r = NULL;
+    for (i = 0; i < SNAPSHOT_DELTA_REGIONS_MAX; i++) {
+        if (snapshot_delta_regions[i].data == NULL) {
+            r = &snapshot_delta_regions[i];
+            break;
+        }
+    }
+
+    if (r == NULL) {
+        return NULL;
+    }
+
+    snapshot_delta_region_free(r);
+
+    r->data = data;
+    r->size = size;
+    r->pages = (size + SNAPSHOT_DELTA_PAGE_SIZE - 1) >> SNAPSHOT_DELTA_PAGE_SHIFT;
+    r->dirty = lib_calloc(r->pages, 1);
+
+    /* New block requires a new keyframe */
+    snapshot_delta_keyed = 0;
+    return r->dirty;
+}
+
+void snapshot_delta_unregister(const uint8_t *data)
+{
+    int i;
+
+    if (data == NULL) {
+        return;
+    }
+
+    for (i = 0; i < SNAPSHOT_DELTA_REGIONS_MAX; i++) {
+        if (snapshot_delta_regions[i].data == data) {
+            snapshot_delta_regions[i].data = NULL;
+        }
+    }
+}
+
+void snapshot_delta_touch(const uint8_t *data)
+{
+    int i;
+
+    for (i = 0; i < SNAPSHOT_DELTA_REGIONS_MAX; i++) {
+        if (snapshot_delta_regions[i].data == data) {
+            memset(snapshot_delta_regions[i].dirty, 1, snapshot_delta_regions[i].pages);
+        }
+    }
+}
+
+void snapshot_delta_set_mode(int enabled)
+{
+    snapshot_delta_mode = enabled;
+}
+
+unsigned int snapshot_delta_overhead(void)
+{
+    unsigned int overhead = sizeof(uint32_t);
+    int i;
+
+    /* Page count and page numbers on top of the data */
+    for (i = 0; i < SNAPSHOT_DELTA_REGIONS_MAX; i++) {
+        if (snapshot_delta_regions[i].data != NULL) {
+            overhead += sizeof(uint32_t) + snapshot_delta_regions[i].pages * sizeof(uint32_t);
+        }
+    }
+    return overhead;
+}
+
+static snapshot_delta_region_t *snapshot_delta_find(const uint8_t *data, unsigned int size)
+{
+    int i;
+
+    for (i = 0; i < SNAPSHOT_DELTA_REGIONS_MAX; i++) {
+        if (snapshot_delta_regions[i].data == data
+            && snapshot_delta_regions[i].size == size) {
+            return &snapshot_delta_regions[i];
+        }
+    }
+    return NULL;
+}
+
+static unsigned int snapshot_delta_page_size(snapshot_delta_region_t *r, unsigned int page)
+{
+    unsigned int offset = page << SNAPSHOT_DELTA_PAGE_SHIFT;
+
+    return (r->size - offset < SNAPSHOT_DELTA_PAGE_SIZE) ? r->size - offset : SNAPSHOT_DELTA_PAGE_SIZE;
+}
+
+/* Clear the flags of dirty pages that are the same as in the keyframe again,
+   returns the amount of pages that differ */
+static unsigned int snapshot_delta_refresh_dirty(snapshot_delta_region_t *r)
+{
+    unsigned int page, count = 0;
+
+    for (page = 0; page < r->pages; page++) {
+        if (r->dirty[page]) {
+            unsigned int offset = page << SNAPSHOT_DELTA_PAGE_SHIFT;
+
+            if (memcmp(r->data + offset, r->keyframe + offset, snapshot_delta_page_size(r, page)) == 0) {
+                r->dirty[page] = 0;
+            } else {
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+/* Move the keyframe of a block to its current contents.  The pages that
+   change are kept as the undo record of the outgoing generation. */
+static void snapshot_delta_rekey_region(snapshot_delta_region_t *r, unsigned int count)
+{
+    snapshot_delta_undo_t *u = &r->undo[snapshot_delta_generation % SNAPSHOT_DELTA_HISTORY];
+    unsigned int page, i = 0;
+
+    snapshot_delta_undo_free(u);
+    if (count) {
+        u->pages = lib_malloc(count * sizeof(uint32_t));
+        u->data = lib_malloc(count << SNAPSHOT_DELTA_PAGE_SHIFT);
+    }
+    for (page = 0; page < r->pages; page++) {
+        unsigned int offset = page << SNAPSHOT_DELTA_PAGE_SHIFT;
+        unsigned int len;
+
+        if (!r->dirty[page]) {
+            continue;
+        }
+        len = snapshot_delta_page_size(r, page);
+        u->pages[i] = page;
+        memcpy(u->data + (i << SNAPSHOT_DELTA_PAGE_SHIFT), r->keyframe + offset, len);
+        memcpy(r->keyframe + offset, r->data + offset, len);
+        r->dirty[page] = 0;
+        i++;
+    }
+    u->count = i;
+}
+
+/* Start a new keyframe when there is none, or when too many pages of a block
+   differ from the current one.  Older keyframes stay readable through their
+   undo records, frontend rewind loads states of any age. */
+static void snapshot_delta_keyframe_update(void)
+{
+    unsigned int count[SNAPSHOT_DELTA_REGIONS_MAX];
+    int rekey = 0;
+    int i;
+
+    if (snapshot_delta_keyed) {
+        for (i = 0; i < SNAPSHOT_DELTA_REGIONS_MAX; i++) {
+            snapshot_delta_region_t *r = &snapshot_delta_regions[i];
+
+            count[i] = 0;
+            if (r->data == NULL || r->keyframe == NULL) {
+                continue;
+            }
+            count[i] = snapshot_delta_refresh_dirty(r);
+            if (count[i] * SNAPSHOT_DELTA_REKEY_SHARE > r->pages) {
+                rekey = 1;
+            }
+        }
+        if (!rekey) {
+            return;
+        }
+
+        for (i = 0; i < SNAPSHOT_DELTA_REGIONS_MAX; i++) {
+            snapshot_delta_region_t *r = &snapshot_delta_regions[i];
+
+            /* Blocks detached for good are not written any more */
+            if (r->data == NULL) {
+                snapshot_delta_region_free(r);
+                continue;
+            }
+            snapshot_delta_rekey_region(r, count[i]);
+        }
+
+        snapshot_delta_generation++;
+        if (snapshot_delta_generation - snapshot_delta_oldest > SNAPSHOT_DELTA_HISTORY) {
+            snapshot_delta_oldest = snapshot_delta_generation - SNAPSHOT_DELTA_HISTORY;
+        }
+        DBG(("snapshot delta keyframe %u, oldest %u", snapshot_delta_generation, snapshot_delta_oldest));
+        return;
+    }
+
+    for (i = 0; i < SNAPSHOT_DELTA_REGIONS_MAX; i++) {
+        snapshot_delta_region_t *r = &snapshot_delta_regions[i];
+        int j;
+
+        /* Detached blocks would be stale in the new keyframe */
+        if (r->data == NULL) {
+            snapshot_delta_region_free(r);
+            continue;
+        }
+        r->keyframe = lib_realloc(r->keyframe, r->size);
+        memcpy(r->keyframe, r->data, r->size);
+        memset(r->dirty, 0, r->pages);
+        for (j = 0; j < SNAPSHOT_DELTA_HISTORY; j++) {
+            snapshot_delta_undo_free(&r->undo[j]);
+        }
+    }
+
+    /* Deltas of all earlier generations refer to blocks that are gone */
+    snapshot_delta_generation++;
+    snapshot_delta_oldest = snapshot_delta_generation;
+    snapshot_delta_keyed = 1;
+    DBG(("snapshot delta keyframe %u", snapshot_delta_generation));
+}
+
+static int snapshot_delta_write_region(snapshot_module_t *m, snapshot_delta_region_t *r)
+{
+    unsigned int page, count = 0;
+
+    for (page = 0; page < r->pages; page++) {
+        count += r->dirty[page];
+    }
+
+    if (snapshot_write_dword(m->file, count) < 0) {
+        return -1;
+    }
+    m->size += sizeof(uint32_t);
+
+    for (page = 0; page < r->pages; page++) {
+        unsigned int len;
+
+        if (!r->dirty[page]) {
+            continue;
+        }
+        len = snapshot_delta_page_size(r, page);
+        if (snapshot_write_dword(m->file, page) < 0
+            || snapshot_write_byte_array(m->file, r->data + (page << SNAPSHOT_DELTA_PAGE_SHIFT), len) < 0) {
+            return -1;
+        }
+        m->size += sizeof(uint32_t) + len;
+    }
+    return 0;
+}
+
+static int snapshot_delta_read_region(snapshot_module_t *m, snapshot_delta_region_t *r)
+{
+    uint8_t *data = (uint8_t *)r->data;
+    uint32_t count, page, i, gen;
+
+    if (r->keyframe == NULL || snapshot_read_dword(m->file, &count) < 0 || count > r->pages) {
+        snapshot_error = SNAPSHOT_READ_BYTE_ARRAY_ERROR;
+        return -1;
+    }
+
+    /* Back to the keyframe, only changed pages differ from it */
+    for (page = 0; page < r->pages; page++) {
+        if (r->dirty[page]) {
+            unsigned int offset = page << SNAPSHOT_DELTA_PAGE_SHIFT;
+
+            memcpy(data + offset, r->keyframe + offset, snapshot_delta_page_size(r, page));
+            r->dirty[page] = 0;
+        }
+    }
+
+    /* Then back to the keyframe of an older delta, newest undo record first,
+       so the record of the delta's own generation wins */
+    for (gen = snapshot_delta_generation; gen != snapshot_delta_read_generation; ) {
+        snapshot_delta_undo_t *u;
+
+        gen--;
+        u = &r->undo[gen % SNAPSHOT_DELTA_HISTORY];
+        for (i = 0; i < u->count; i++) {
+            page = u->pages[i];
+            memcpy(data + (page << SNAPSHOT_DELTA_PAGE_SHIFT), u->data + (i << SNAPSHOT_DELTA_PAGE_SHIFT),
+                   snapshot_delta_page_size(r, page));
+            r->dirty[page] = 1;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        unsigned int len;
+
+        if (snapshot_read_dword(m->file, &page) < 0 || page >= r->pages) {
+            snapshot_error = SNAPSHOT_READ_BYTE_ARRAY_ERROR;
+            return -1;
+        }
+        len = snapshot_delta_page_size(r, page);
+        if ((long)(snapshot_ftell(m->file) + len) > (long)(m->offset + m->size)) {
+            snapshot_error = SNAPSHOT_READ_OUT_OF_BOUNDS_ERROR;
+            return -1;
+        }
+        if (snapshot_read_byte_array(m->file, data + (page << SNAPSHOT_DELTA_PAGE_SHIFT), len) < 0) {
+            return -1;
+        }
+        r->dirty[page] = 1;
+    }
+    return 0;
+}
+
 /* ------------------------------------------------------------------------- */
 
 int snapshot_module_write_byte(snapshot_module_t *m, uint8_t b)
@@ -855,6 +1269,12 @@ int snapshot_module_write_padded_string(snapshot_module_t *m, const char *s, uin
 
 int snapshot_module_write_byte_array(snapshot_module_t *m, const uint8_t *b, unsigned int num)
 {
+    snapshot_delta_region_t *r;
+
+    if (snapshot_delta_writing && (r = snapshot_delta_find(b, num)) != NULL) {
+        return snapshot_delta_write_region(m, r);
+    }
+
     if (snapshot_write_byte_array(m->file, b, num) < 0) {
         return -1;
     }
@@ -955,13 +1375,30 @@ int snapshot_module_read_double(snapshot_module_t *m, double *db_return)
 
 int snapshot_module_read_byte_array(snapshot_module_t *m, uint8_t *b_return, unsigned int num)
 {
+    snapshot_delta_region_t *r = snapshot_delta_find(b_return, num);
+
+    if (r != NULL && snapshot_delta_reading) {
+        return snapshot_delta_read_region(m, r);
+    }
+
     current_fpos = snapshot_ftell(m->file);
     if ((long)(snapshot_ftell(m->file) + num) > (long)(m->offset + m->size)) {
         snapshot_error = SNAPSHOT_READ_OUT_OF_BOUNDS_ERROR;
         return -1;
     }
 
-    return snapshot_read_byte_array(m->file, b_return, num);
+    if (snapshot_read_byte_array(m->file, b_return, num) < 0) {
+        return -1;
+    }
+
+    /* Whole block replaced, only pages that differ from the keyframe count */
+    if (r != NULL) {
+        memset(r->dirty, 1, r->pages);
+        if (r->keyframe != NULL) {
+            snapshot_delta_refresh_dirty(r);
+        }
+    }
+    return 0;
 }
 
 int snapshot_module_read_word_array(snapshot_module_t *m, uint16_t *w_return, unsigned int num)
@@ -1150,6 +1587,12 @@ snapshot_module_t *snapshot_module_open(snapshot_t *s, const char *name, uint8_t
             goto fail;
         }
 
+        /* Zero padding after the last module, not a module header */
+        if (m->size == 0) {
+            snapshot_error = SNAPSHOT_MODULE_NOT_FOUND_ERROR;
+            goto fail;
+        }
+
         /* Found?  */
         if (memcmp(n, name, name_len) == 0
             && (name_len == SNAPSHOT_MODULE_NAME_LEN || n[name_len] == 0)) {
@@ -1210,8 +1653,14 @@ snapshot_t *snapshot_create_from_stream(snapshot_stream_t *f, uint8_t major_vers
         return NULL;
     }
 
+    snapshot_delta_writing = snapshot_delta_mode;
+    if (snapshot_delta_writing) {
+        snapshot_delta_keyframe_update();
+    }
+
     /* Magic string.  */
-    if (snapshot_write_padded_string(f, snapshot_magic_string, (uint8_t)0, SNAPSHOT_MAGIC_LEN) < 0) {
+    if (snapshot_write_padded_string(f, snapshot_delta_writing ? snapshot_delta_magic_string : snapshot_magic_string,
+                                     (uint8_t)0, SNAPSHOT_MAGIC_LEN) < 0) {
         snapshot_error = SNAPSHOT_CANNOT_WRITE_MAGIC_STRING_ERROR;
         goto fail;
     }
@@ -1248,6 +1697,12 @@ snapshot_t *snapshot_create_from_stream(snapshot_stream_t *f, uint8_t major_vers
         goto fail;
     }
 
+    /* Keyframe generation of delta snapshots */
+    if (snapshot_delta_writing && snapshot_write_dword(f, snapshot_delta_generation) < 0) {
+        snapshot_error = SNAPSHOT_CANNOT_WRITE_VERSION_ERROR;
+        goto fail;
+    }
+
     s = lib_malloc(sizeof(snapshot_t));
     s->file = f;
     s->first_module_offset = snapshot_ftell(f);
@@ -1289,8 +1744,14 @@ snapshot_t *snapshot_open_from_stream(snapshot_stream_t *f, uint8_t *major_versi
     }
 
     /* Magic string.  */
-    if (snapshot_read_byte_array(f, (uint8_t *)magic, SNAPSHOT_MAGIC_LEN) < 0
-        || memcmp(magic, snapshot_magic_string, SNAPSHOT_MAGIC_LEN) != 0) {
+    snapshot_delta_reading = 0;
+    if (snapshot_read_byte_array(f, (uint8_t *)magic, SNAPSHOT_MAGIC_LEN) < 0) {
+        snapshot_error = SNAPSHOT_MAGIC_STRING_MISMATCH_ERROR;
+        goto fail;
+    }
+    if (memcmp(magic, snapshot_delta_magic_string, SNAPSHOT_MAGIC_LEN) == 0) {
+        snapshot_delta_reading = 1;
+    } else if (memcmp(magic, snapshot_magic_string, SNAPSHOT_MAGIC_LEN) != 0) {
         snapshot_error = SNAPSHOT_MAGIC_STRING_MISMATCH_ERROR;
         goto fail;
     }
@@ -1339,6 +1800,19 @@ snapshot_t *snapshot_open_from_stream(snapshot_stream_t *f, uint8_t *major_versi
         }
     }
 
+    /* Delta snapshots are only valid against a kept keyframe */
+    if (snapshot_delta_reading) {
+        uint32_t generation;
+
+        if (snapshot_read_dword(f, &generation) < 0
+            || !snapshot_delta_keyed
+            || generation - snapshot_delta_oldest > snapshot_delta_generation - snapshot_delta_oldest) {
+            snapshot_error = SNAPSHOT_CANNOT_READ_SNAPSHOT;
+            goto fail;
+        }
+        snapshot_delta_read_generation = generation;
+    }
+
     s = lib_malloc(sizeof(snapshot_t));
     s->file = f;
     s->first_module_offset = snapshot_ftell(f);
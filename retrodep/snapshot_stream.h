@@ -144,4 +144,15 @@ long snapshot_ftell(snapshot_stream_t *f);
 int snapshot_fclose(snapshot_stream_t *f);
 int snapshot_fclose_erase(snapshot_stream_t *f);
 
+/* Delta snapshots */
+
+#define SNAPSHOT_DELTA_PAGE_SHIFT 8
+#define SNAPSHOT_DELTA_MARK(dirty, addr) ((dirty)[(addr) >> SNAPSHOT_DELTA_PAGE_SHIFT] = 1)
+
+uint8_t *snapshot_delta_register(const uint8_t *data, unsigned int size);
+void snapshot_delta_unregister(const uint8_t *data);
+void snapshot_delta_touch(const uint8_t *data);
+void snapshot_delta_set_mode(int enabled);
+unsigned int snapshot_delta_overhead(void);
+
 #endif
@@ -7,11 +7,14 @@
 #include "sound.h"
 
 #include "libretro-core.h"
+extern void retro_audio_reserve(int32_t samples);
 extern void retro_audio_queue(const int16_t *data, int32_t samples);
 
 static int retro_sound_init(const char *param, int *speed, int *fragsize, int *fragnr, int *channels)
 {
     *speed = vice_opt.SoundSampleRate;
+    /* Room for 100ms of stereo samples, several frames */
+    retro_audio_reserve(*speed / 10 * 2);
 #if 0
     printf("speed:%d fragsize:%d fragnr:%d channels:%d\n", *speed, *fragsize, *fragnr, *channels);
 #endif
@@ -0,0 +1,197 @@
+/*
+ * timeprobe.c - Optional timing probes for the emulation stages.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/* Built with TIMEPROBE=1 only.  Every second the time spent in each stage
+   is logged as a CSV line:
+
+     TimeProbe: frames,frontend_ms,cpu_ms,vicii_ms,sound_ms,drive_ms,video_ms,drive_thread_ms,drive_skipped_cycles
+     TimeProbe: 50,1.204,310.877,120.338,95.610,80.022,30.117,0.000,812345
+
+   The frames are retro_run() calls and the times are totals over the
+   second.  The last column counts the drive cycles skipped in polling
+   loops during the second.  The shares of the stages are shown in the
+   statusbar too.  */
+
+#include "vice.h"
+
+#ifdef TIMEPROBE
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "drive.h"
+#include "drivecpu.h"
+#include "log.h"
+#include "timeprobe.h"
+
+/* Nesting of stages: maincpu_mainloop() -> alarm -> VIC-II -> vsync ->
+   sound_flush() -> drivecpu_execute() is as deep as it gets.  */
+#define TIMEPROBE_MAX_DEPTH 16
+
+/* Time outside retro_run() is charged to this extra slot and ignored.  */
+#define TIMEPROBE_NONE TIMEPROBE_NUM
+
+static const char *stage_names[TIMEPROBE_NUM] = {
+    "frontend", "cpu", "vicii", "sound", "drive", "video", "drive_thread"
+};
+
+static int stack[TIMEPROBE_MAX_DEPTH];
+static unsigned int depth = 0;
+static int current = TIMEPROBE_NONE;
+static uint64_t last;
+
+/* Totals of the running second, and shares of the last one.  */
+static uint64_t totals[TIMEPROBE_NUM + 1];
+static unsigned int percent[TIMEPROBE_NUM];
+static unsigned int frames = 0;
+static uint64_t second_start = 0;
+
+static log_t timeprobe_log = LOG_DEFAULT;
+
+/* Skipped drive cycles at the start of the running second.  */
+static CLOCK skipped_start[NUM_DISK_UNITS];
+
+uint64_t timeprobe_now(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER now;
+
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&now);
+    return (uint64_t)((double)now.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+#endif
+}
+
+void timeprobe_enter(int stage)
+{
+    uint64_t now = timeprobe_now();
+
+    totals[current] += now - last;
+    last = now;
+    if (depth < TIMEPROBE_MAX_DEPTH) {
+        stack[depth] = current;
+    }
+    depth++;
+    current = stage;
+}
+
+void timeprobe_leave(void)
+{
+    uint64_t now = timeprobe_now();
+
+    totals[current] += now - last;
+    last = now;
+    if (depth > 0) {
+        depth--;
+        current = (depth < TIMEPROBE_MAX_DEPTH) ? stack[depth] : current;
+    }
+}
+
+void timeprobe_add(int stage, uint64_t ns)
+{
+    totals[stage] += ns;
+}
+
+/* Drive cycles skipped in polling loops since the last call.  A reset of
+   the drive clears its counter.  */
+static uint64_t timeprobe_skipped_cycles(void)
+{
+    uint64_t sum = 0;
+    unsigned int dnr;
+
+    drive_thread_sync();
+
+    for (dnr = 0; dnr < NUM_DISK_UNITS; dnr++) {
+        CLOCK skipped;
+
+        if (diskunit_context[dnr] == NULL || diskunit_context[dnr]->cpu == NULL) {
+            continue;
+        }
+        skipped = drivecpu_idle_skipped_cycles(diskunit_context[dnr]);
+        sum += skipped >= skipped_start[dnr] ? skipped - skipped_start[dnr] : skipped;
+        skipped_start[dnr] = skipped;
+    }
+    return sum;
+}
+
+void timeprobe_frame(void)
+{
+    uint64_t now = timeprobe_now();
+    uint64_t sum = 0;
+    int i;
+
+    frames++;
+    if (second_start == 0) {
+        second_start = now;
+        memset(totals, 0, sizeof(totals));
+        frames = 0;
+        timeprobe_skipped_cycles();
+        timeprobe_log = log_open("TimeProbe");
+        log_message(timeprobe_log, "frames,%s_ms,%s_ms,%s_ms,%s_ms,%s_ms,%s_ms,%s_ms,drive_skipped_cycles",
+                    stage_names[0], stage_names[1], stage_names[2], stage_names[3],
+                    stage_names[4], stage_names[5], stage_names[6]);
+        return;
+    }
+    if (now - second_start < 1000000000) {
+        return;
+    }
+
+    for (i = 0; i < TIMEPROBE_DRIVE_THREAD; i++) {
+        sum += totals[i];
+    }
+    for (i = 0; i < TIMEPROBE_NUM; i++) {
+        unsigned int share = sum ? (unsigned int)(totals[i] * 100 / sum) : 0;
+
+        percent[i] = share > 99 ? 99 : share;
+    }
+
+    log_message(timeprobe_log, "%u,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%" PRIu64, frames,
+                totals[0] / 1e6, totals[1] / 1e6, totals[2] / 1e6, totals[3] / 1e6,
+                totals[4] / 1e6, totals[5] / 1e6, totals[6] / 1e6,
+                timeprobe_skipped_cycles());
+
+    memset(totals, 0, sizeof(totals));
+    frames = 0;
+    second_start = now;
+}
+
+unsigned int timeprobe_percent(int stage)
+{
+    return percent[stage];
+}
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * timeprobe.h - Optional timing probes for the emulation stages.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#ifndef VICE_TIMEPROBE_H
+#define VICE_TIMEPROBE_H
+
+#include <stdint.h>
+
+/* Stages of the emulation.  The time of a stage does not include the time
+   of the stages entered from it, so the stages of the main thread add up
+   to the time spent in retro_run().  */
+enum {
+    TIMEPROBE_FRONTEND,     /* retro_run() itself, statusbar */
+    TIMEPROBE_CPU,          /* maincpu_mainloop(), alarms not listed here */
+    TIMEPROBE_VICII,        /* VIC-II raster line drawing */
+    TIMEPROBE_SOUND,        /* sound_flush(), SID emulation */
+    TIMEPROBE_DRIVE,        /* drivecpu_execute() in the main thread */
+    TIMEPROBE_VIDEO,        /* video_canvas_refresh(), conversion, vkbd */
+    TIMEPROBE_DRIVE_THREAD, /* drive CPU in the drive thread */
+    TIMEPROBE_NUM
+};
+
+#ifdef TIMEPROBE
+/* None of these are thread safe, they are only called from the main
+   thread.  */
+
+/* Enters and leaves a stage of the main thread.  */
+void timeprobe_enter(int stage);
+void timeprobe_leave(void);
+
+/* Adds time measured with timeprobe_now() in another thread, which the
+   main thread collects from it.  */
+void timeprobe_add(int stage, uint64_t ns);
+uint64_t timeprobe_now(void);
+
+/* Called at the end of each retro_run(), logs a CSV line every second.  */
+void timeprobe_frame(void);
+
+/* Share of the stage in the time of the main thread during the last
+   second, in percent.  */
+unsigned int timeprobe_percent(int stage);
+
+#define TIMEPROBE_ENTER(stage) timeprobe_enter(stage)
+#define TIMEPROBE_LEAVE()      timeprobe_leave()
+#else
+#define TIMEPROBE_ENTER(stage)
+#define TIMEPROBE_LEAVE()
+#endif
+
+#endif
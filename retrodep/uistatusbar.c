@@ -44,6 +44,7 @@
 #include "drive.h"
 #include "keyboard.h"
 #include "keymap.h"
+#include "timeprobe.h"
 
 #include "libretro-core.h"
 #include "libretro-graph.h"
@@ -129,6 +130,17 @@ static void display_speed(void)
 {
     sprintf(&statusbar_chars[STATUSBAR_SPEED_POS], "%2s", fps_str);
 
+#ifdef TIMEPROBE
+    /* Shares of the emulation stages in place of resolution, memory and model:
+       CPU, VIC-II, SID, drive, video output and frontend */
+    snprintf(statusbar_resolution, sizeof(statusbar_resolution), "C%02u V%02u",
+             timeprobe_percent(TIMEPROBE_CPU), timeprobe_percent(TIMEPROBE_VICII));
+    snprintf(statusbar_memory, sizeof(statusbar_memory), "S%02u D%02u",
+             timeprobe_percent(TIMEPROBE_SOUND), timeprobe_percent(TIMEPROBE_DRIVE));
+    snprintf(statusbar_model, sizeof(statusbar_model), "R%02u F%02u",
+             timeprobe_percent(TIMEPROBE_VIDEO), timeprobe_percent(TIMEPROBE_FRONTEND));
+#endif
+
     if (uistatusbar_state & UISTATUSBAR_ACTIVE) {
         uistatusbar_state |= UISTATUSBAR_REPAINT;
     }
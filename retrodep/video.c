@@ -11,16 +11,24 @@
 #include "ui.h"
 #include "vsync.h"
 #include "raster.h"
+#include "render1x1.h"
 #include "sound.h"
 #include "machine.h"
 #include "resources.h"
+#include "video-render.h"
+#include "timeprobe.h"
 
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
 #include "libretro-core.h"
+#include "libretro-graph.h"
 #include "libretro-vkbd.h"
 
 #if defined(__X128__)
@@ -30,6 +38,53 @@ extern int c128_vdc;
 int machine_ui_done = 0;
 int num_screens = 0;
 
+/* Source lines of the last rendered frame, so that only changed lines
+ * need to be converted again */
+static struct {
+   uint8_t *lines;
+   size_t size;
+   video_canvas_t *canvas;
+   const uint8_t *draw_buffer;
+   unsigned int draw_buffer_width;
+   unsigned int width, height;
+   int xs, ys;
+   unsigned short int pix_bytes;
+} render_prev = {0};
+
+/* Source and geometry of one emulated frame to convert */
+typedef struct video_frame_s {
+   video_canvas_t *canvas;
+   const uint8_t *draw_buffer;
+   unsigned int pitchs;
+   unsigned int width, height;
+   unsigned int xs, ys;
+   unsigned int blanked;
+   bool full;                   /* all lines, not only the changed ones */
+   int draw_rows_first;         /* lines drawn over by overlays */
+   int draw_rows_last;
+} video_frame_t;
+
+#ifdef HAVE_THREADS
+/* Threaded rendering, converting the lines of the frame being emulated
+ * which the raster has passed already */
+static struct {
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *cond;
+   bool enabled;
+   bool quit;
+   bool active;             /* frame lines handed to the worker */
+   bool busy;               /* worker converting lines */
+   video_canvas_t *canvas;  /* canvas of the last refresh */
+   video_frame_t frame;
+   unsigned int rows_ready; /* lines final in the draw buffer */
+   unsigned int rows_done;  /* lines converted */
+} render_thread = {0};
+
+/* Lines passed by the raster before the worker is woken up */
+#define RENDER_THREAD_ROWS 16
+#endif
+
 static const cmdline_option_t cmdline_options[] = {
      { NULL }
 };
@@ -48,6 +103,27 @@ void video_canvas_resize(struct video_canvas_s *canvas, char resize_canvas)
 {
 }
 
+/* 1x1 without CRT emulation converts pixel pairs with the pair color table,
+ * everything else goes through the generic renderers */
+static void video_render_pal_ntsc_pairs(video_render_config_t *config,
+      uint8_t *src, uint8_t *trg,
+      int width, int height, int xs, int ys, int xt,
+      int yt, int pitchs, int pitcht,
+      int crt_type,
+      unsigned int viewport_first_line, unsigned int viewport_last_line)
+{
+   if (config->rendermode == VIDEO_RENDER_PAL_NTSC_1X1
+         && config->filter != VIDEO_FILTER_CRT)
+   {
+      render_32_1x1_pairs(&config->color_tables, src, trg, width, height,
+            xs, ys, xt, yt, pitchs, pitcht);
+      return;
+   }
+
+   video_render_pal_ntsc_main(config, src, trg, width, height, xs, ys, xt,
+         yt, pitchs, pitcht, crt_type, viewport_first_line, viewport_last_line);
+}
+
 video_canvas_t *video_canvas_create(video_canvas_t *canvas, 
       unsigned int *width, unsigned int *height, int mapped)
 {
@@ -57,6 +133,7 @@ video_canvas_t *video_canvas_create(video_canvas_t *canvas,
       case 0:
          /* VIC-II, VIC etc */
          canvas->videoconfig->rendermode = VIDEO_RENDER_PAL_NTSC_1X1;
+         video_render_palntscfunc_set(video_render_pal_ntsc_pairs);
          break;
       case 1:
          /* VDC */
@@ -96,6 +173,9 @@ int video_canvas_set_palette(struct video_canvas_s *canvas,
 
    canvas->palette = palette;
 
+   /* New colors for every line */
+   render_prev.canvas = NULL;
+
    for (i = 0; i < palette->num_entries; i++) {
       if (pix_bytes == 2)
          col = RGB565(palette->entries[i].red, palette->entries[i].green, palette->entries[i].blue);
@@ -104,6 +184,7 @@ int video_canvas_set_palette(struct video_canvas_s *canvas,
 
       video_render_setphysicalcolor(canvas->videoconfig, i, col, canvas->depth);
    }
+   render_1x1_pairs_init(color_tables, pix_bytes);
 
    for (i = 0; i < 256; i++) {
       if (pix_bytes == 2)
@@ -116,7 +197,7 @@ int video_canvas_set_palette(struct video_canvas_s *canvas,
    return 0;
 }
 
-static void video_canvas_crop(struct video_canvas_s *canvas)
+static void video_canvas_crop(const video_frame_t *frame)
 {
    unsigned i                  = 0;
    unsigned j                  = 0;
@@ -127,40 +208,41 @@ static void video_canvas_crop(struct video_canvas_s *canvas)
    unsigned crop_left_border   = CROP_LEFT_BORDER;
    unsigned crop_pad           = 10;
    unsigned crop_counter       = (crop_delay) ? 3 : 0;
+   unsigned blanked            = frame->blanked;
 
    if (!retrow_crop || !retroh_crop)
       return;
 
 #if defined(__X128__)
-   if (canvas->videoconfig->rendermode == VIDEO_RENDER_RGBI_1X1)
+   if (frame->canvas->videoconfig->rendermode == VIDEO_RENDER_RGBI_1X1)
    {
       crop_top_border     = CROP_VDC_TOP_BORDER;
       crop_left_border    = CROP_VDC_LEFT_BORDER;
 
-      vice_raster.blanked = 0;
+      blanked = 0;
    }
 #elif defined(__XPET__)
-   if (retrow > 384)
+   if (frame->width > 384)
       crop_top_border -= 13;
 #elif defined(__XCBM2__)
-   if (retroh == 366)
+   if (frame->height == 366)
    {
       crop_top_border -= 25;
       crop_height_max += 150;
    }
 #elif defined(__XPLUS4__)
-   if (retroh == 242)
+   if (frame->height == 242)
       crop_top_border = CROP_TOP_BORDER_NTSC;
 #elif defined(__XVIC__)
-   if (retroh == 234)
+   if (frame->height == 234)
       crop_top_border = CROP_TOP_BORDER_NTSC;
 
-   vice_raster.blanked = 0;
+   blanked = 0;
 #endif
 
    /* Reset to maximum crop */
    vice_raster.first_line = (crop_id == 0 && crop_id != crop_id_prev) ? 0 : crop_top_border;
-   vice_raster.last_line  = (crop_id == 0 && crop_id != crop_id_prev) ? retroh : vice_raster.first_line + crop_height_max;
+   vice_raster.last_line  = (crop_id == 0 && crop_id != crop_id_prev) ? frame->height : vice_raster.first_line + crop_height_max;
 
    switch (crop_id)
    {
@@ -176,15 +258,15 @@ static void video_canvas_crop(struct video_canvas_s *canvas)
          crop_bottom_border = crop_top_border + crop_height_max;
 
          /* Top border, start from top */
-         for (i = 0; i < crop_top_border && !vice_raster.blanked; i++)
+         for (i = 0; i < crop_top_border && !blanked; i++)
          {
-            unsigned row      = i * (retrow << (pix_bytes >> 2));
+            unsigned row      = i * (frame->width << (pix_bytes >> 2));
             unsigned color    = row + (crop_left_border + crop_pad) * (pix_bytes >> 1);
             unsigned lb_color = row + crop_pad * (pix_bytes >> 1);
-            unsigned rb_color = row + (retrow - crop_left_border) * (pix_bytes >> 1);
+            unsigned rb_color = row + (frame->width - crop_left_border) * (pix_bytes >> 1);
             unsigned found    = 0;
 
-            for (j = crop_left_border + crop_pad; j < retrow - crop_left_border - crop_pad; j++)
+            for (j = crop_left_border + crop_pad; j < frame->width - crop_left_border - crop_pad; j++)
             {
                unsigned pixel = row + j * (pix_bytes >> 1);
 
@@ -226,15 +308,15 @@ static void video_canvas_crop(struct video_canvas_s *canvas)
 #endif
 
          /* Bottom border, start from bottom, almost */
-         for (i = retroh - 2; i > crop_bottom_border && !vice_raster.blanked; i--)
+         for (i = frame->height - 2; i > crop_bottom_border && !blanked; i--)
          {
-            unsigned row      = i * (retrow << (pix_bytes >> 2));
+            unsigned row      = i * (frame->width << (pix_bytes >> 2));
             unsigned color    = row + (crop_left_border + crop_pad) * (pix_bytes >> 1);
             unsigned lb_color = row + crop_pad * (pix_bytes >> 1);
-            unsigned rb_color = row + (retrow - crop_left_border) * (pix_bytes >> 1);
+            unsigned rb_color = row + (frame->width - crop_left_border) * (pix_bytes >> 1);
             unsigned found    = 0;
 
-            for (j = crop_left_border + crop_pad; j < retrow - crop_left_border - crop_pad; j++)
+            for (j = crop_left_border + crop_pad; j < frame->width - crop_left_border - crop_pad; j++)
             {
                unsigned pixel = row + j * (pix_bytes >> 1);
 
@@ -287,7 +369,7 @@ static void video_canvas_crop(struct video_canvas_s *canvas)
                   || vice_raster.last_line  != vice_raster.first_line + crop_height_max))
          {
             vice_raster.first_line = 0;
-            vice_raster.last_line  = retroh;
+            vice_raster.last_line  = frame->height;
          }
 
          /* Result pondering with stabilization period */
@@ -336,10 +418,10 @@ static void video_canvas_crop(struct video_canvas_s *canvas)
       case CROP_AUTO_DISABLE:
          crop_counter = (crop_delay) ? 1 : 0;
 
-         if (!vice_raster.blanked)
+         if (!blanked)
          {
             vice_raster.first_line = 0;
-            vice_raster.last_line  = retroh;
+            vice_raster.last_line  = frame->height;
          }
 
          /* Result pondering with stabilization period */
@@ -377,7 +459,325 @@ static void video_canvas_crop(struct video_canvas_s *canvas)
 
    vice_raster.first_line_prev = vice_raster.first_line;
    vice_raster.last_line_prev  = vice_raster.last_line;
-   vice_raster.blanked         = 0;
+}
+
+static int video_canvas_render_lines_possible(const video_frame_t *frame)
+{
+   video_canvas_t *canvas        = frame->canvas;
+   video_render_config_t *config = canvas->videoconfig;
+
+   /* Filters and scaling spread source pixels over neighbouring lines,
+    * and audio leak emulation needs the whole frame */
+   return config->filter == VIDEO_FILTER_NONE
+       && config->scalex == 1
+       && config->scaley == 1
+       && !config->interlaced
+       && !config->video_resources.audioleak
+       && config->color_tables.updated
+       && canvas->crt_type == canvas->viewport->crt_type
+       && render_prev.canvas            == canvas
+       && render_prev.draw_buffer       == frame->draw_buffer
+       && render_prev.draw_buffer_width == frame->pitchs
+       && render_prev.width             == frame->width
+       && render_prev.height            == frame->height
+       && render_prev.xs                == frame->xs
+       && render_prev.ys                == frame->ys
+       && render_prev.pix_bytes         == pix_bytes;
+}
+
+/* Source and geometry of the frame being emulated */
+static void video_frame_get(video_frame_t *frame, video_canvas_t *canvas)
+{
+   memset(frame, 0, sizeof(video_frame_t));
+   frame->canvas      = canvas;
+   frame->draw_buffer = canvas->draw_buffer->draw_buffer;
+   frame->pitchs      = canvas->draw_buffer->draw_buffer_width;
+   frame->width       = retrow;
+   frame->height      = retroh;
+   frame->xs          = retroXS;
+   frame->ys          = retroYS;
+}
+
+static bool video_frame_same(const video_frame_t *a, const video_frame_t *b)
+{
+   return a->canvas      == b->canvas
+       && a->draw_buffer == b->draw_buffer
+       && a->pitchs      == b->pitchs
+       && a->width       == b->width
+       && a->height      == b->height
+       && a->xs          == b->xs
+       && a->ys          == b->ys;
+}
+
+/* Palette and line bookkeeping before any line of a frame is converted,
+ * always done by the emulation thread */
+static void video_canvas_render_prepare(video_frame_t *frame)
+{
+   video_canvas_t *canvas = frame->canvas;
+   viewport_t *viewport   = canvas->viewport;
+   size_t size            = (size_t)frame->width * frame->height;
+
+   frame->full            = !video_canvas_render_lines_possible(frame);
+   frame->draw_rows_first = draw_rows_first;
+   frame->draw_rows_last  = draw_rows_last;
+
+   if (viewport->crt_type != canvas->crt_type)
+   {
+      canvas->videoconfig->color_tables.updated = 0;
+      canvas->crt_type = viewport->crt_type;
+   }
+
+   if (!canvas->videoconfig->color_tables.updated)
+      video_color_update_palette(canvas);
+
+   if (!frame->full)
+      return;
+
+   if (size > render_prev.size)
+   {
+      render_prev.lines = lib_realloc(render_prev.lines, size);
+      render_prev.size  = size;
+   }
+   render_prev.canvas            = canvas;
+   render_prev.draw_buffer       = frame->draw_buffer;
+   render_prev.draw_buffer_width = frame->pitchs;
+   render_prev.width             = frame->width;
+   render_prev.height            = frame->height;
+   render_prev.xs                = frame->xs;
+   render_prev.ys                = frame->ys;
+   render_prev.pix_bytes         = pix_bytes;
+   retro_bmp_changed             = true;
+}
+
+static void video_canvas_render_frame(const video_frame_t *frame,
+      unsigned int ys, unsigned int height)
+{
+   video_canvas_t *canvas = frame->canvas;
+
+   video_render_main(canvas->videoconfig, (uint8_t *)frame->draw_buffer, (uint8_t *)&retro_bmp,
+         frame->width, height,
+         frame->xs, frame->ys + ys,
+         0, ys,
+         frame->pitchs, frame->width * pix_bytes,
+         canvas->viewport);
+}
+
+/* Converts the lines [first, last) of a prepared frame. Only the colors
+ * tables, render_prev and the bitmap are used, so that this can run in the
+ * render thread while the emulation thread draws the following lines */
+static void video_canvas_render_lines(const video_frame_t *frame,
+      unsigned int first, unsigned int last)
+{
+   const uint8_t *src   = frame->draw_buffer;
+   unsigned int pitchs  = frame->pitchs;
+   unsigned int width   = frame->width;
+   int dirty_first      = -1;
+   unsigned int y;
+
+   if (first >= last)
+      return;
+
+   if (frame->full)
+   {
+      video_canvas_render_frame(frame, first, last - first);
+      for (y = first; y < last; y++)
+         memcpy(render_prev.lines + (y * width), src + ((frame->ys + y) * pitchs) + frame->xs, width);
+      return;
+   }
+
+   /* Lines drawn over by the statusbar or the virtual keyboard are stale too */
+   for (y = first; y <= last; y++)
+   {
+      int dirty = 0;
+
+      if (y < last)
+      {
+         const uint8_t *line = src + ((frame->ys + y) * pitchs) + frame->xs;
+         uint8_t *prev       = render_prev.lines + (y * width);
+
+         if ((int)y >= frame->draw_rows_first && (int)y <= frame->draw_rows_last)
+            dirty = 1;
+         if (memcmp(line, prev, width))
+         {
+            memcpy(prev, line, width);
+            dirty = 1;
+            retro_bmp_changed = true;
+         }
+      }
+
+      if (dirty && dirty_first < 0)
+         dirty_first = y;
+      else if (!dirty && dirty_first >= 0)
+      {
+         video_canvas_render_frame(frame, dirty_first, y - dirty_first);
+         dirty_first = -1;
+      }
+   }
+}
+
+/* Everything done to the output bitmap after the lines of a frame */
+static void video_canvas_render_finish(const video_frame_t *frame)
+{
+   draw_rows_first = 0;
+   draw_rows_last  = -1;
+
+   /* Automatic crop */
+   if (crop_id >= CROP_AUTO)
+      video_canvas_crop(frame);
+
+   /* Virtual keyboard */
+   if (retro_vkbd)
+      print_vkbd();
+}
+
+#ifdef HAVE_THREADS
+static void video_render_thread_func(void *data)
+{
+   slock_lock(render_thread.lock);
+   for (;;)
+   {
+      unsigned int first, last;
+
+      while (     !render_thread.quit
+               && (!render_thread.active || render_thread.rows_done >= render_thread.rows_ready))
+         scond_wait(render_thread.cond, render_thread.lock);
+      if (render_thread.quit)
+         break;
+
+      first = render_thread.rows_done;
+      last  = render_thread.rows_ready;
+      render_thread.busy = true;
+      slock_unlock(render_thread.lock);
+
+      video_canvas_render_lines(&render_thread.frame, first, last);
+
+      slock_lock(render_thread.lock);
+      render_thread.rows_done = last;
+      render_thread.busy      = false;
+      scond_broadcast(render_thread.cond);
+   }
+   slock_unlock(render_thread.lock);
+}
+
+static bool video_render_thread_init(void)
+{
+   if (render_thread.thread)
+      return true;
+
+   render_thread.lock = slock_new();
+   render_thread.cond = scond_new();
+   render_thread.quit = false;
+   if (render_thread.lock && render_thread.cond)
+      render_thread.thread = sthread_create(video_render_thread_func, NULL);
+
+   if (!render_thread.thread)
+   {
+      log_error(LOG_DEFAULT, "Failed to create render thread.");
+      video_render_thread_shutdown();
+      return false;
+   }
+   return true;
+}
+
+/* Takes the frame back from the worker, once it is done with its lines */
+static void video_render_thread_stop(void)
+{
+   if (!render_thread.active)
+      return;
+
+   slock_lock(render_thread.lock);
+   render_thread.active = false;
+   while (render_thread.busy)
+      scond_wait(render_thread.cond, render_thread.lock);
+   slock_unlock(render_thread.lock);
+}
+#endif
+
+/* Called before emulating a frame. With the render thread enabled, the
+ * lines of the frame are converted as soon as the raster has passed them,
+ * so the frame is complete at its end as without the thread */
+void video_render_thread_begin(bool enabled)
+{
+#ifdef HAVE_THREADS
+   video_frame_t *frame = &render_thread.frame;
+
+   if (enabled && !video_render_thread_init())
+      enabled = false;
+   render_thread.enabled = enabled;
+
+   /* Skipped frames are not rendered at all, and the geometry of the
+    * first frame is not known yet */
+   if (!enabled || vsync_get_warp_mode() || !render_thread.canvas)
+      return;
+
+   video_frame_get(frame, render_thread.canvas);
+   if (     frame->canvas->videoconfig->interlaced
+         || frame->canvas->videoconfig->video_resources.audioleak)
+      return;
+
+   video_canvas_render_prepare(frame);
+
+   slock_lock(render_thread.lock);
+   render_thread.rows_ready = 0;
+   render_thread.rows_done  = 0;
+   render_thread.active     = true;
+   slock_unlock(render_thread.lock);
+#endif
+}
+
+/* Called by the raster when the lines above `line' of the draw buffer are
+ * final for this frame */
+void video_render_thread_rows(const uint8_t *draw_buffer, unsigned int line)
+{
+#ifdef HAVE_THREADS
+   const video_frame_t *frame = &render_thread.frame;
+   unsigned int rows;
+
+   if (!render_thread.active || draw_buffer != frame->draw_buffer || line <= frame->ys)
+      return;
+
+   rows = line - frame->ys;
+   if (rows > frame->height)
+      rows = frame->height;
+   if (rows < render_thread.rows_ready + RENDER_THREAD_ROWS && rows < frame->height)
+      return;
+   if (rows <= render_thread.rows_ready)
+      return;
+
+   slock_lock(render_thread.lock);
+   render_thread.rows_ready = rows;
+   scond_broadcast(render_thread.cond);
+   slock_unlock(render_thread.lock);
+#endif
+}
+
+/* Called after emulating a frame */
+void video_render_thread_end(void)
+{
+#ifdef HAVE_THREADS
+   /* Frame not refreshed, e.g. after a reset */
+   video_render_thread_stop();
+#endif
+}
+
+void video_render_thread_shutdown(void)
+{
+#ifdef HAVE_THREADS
+   if (render_thread.thread)
+   {
+      slock_lock(render_thread.lock);
+      render_thread.quit = true;
+      scond_broadcast(render_thread.cond);
+      slock_unlock(render_thread.lock);
+      sthread_join(render_thread.thread);
+   }
+   if (render_thread.cond)
+      scond_free(render_thread.cond);
+   if (render_thread.lock)
+      slock_free(render_thread.lock);
+
+   memset(&render_thread, 0, sizeof(render_thread));
+#endif
 }
 
 void video_canvas_refresh(struct video_canvas_s *canvas,
@@ -385,25 +785,52 @@ void video_canvas_refresh(struct video_canvas_s *canvas,
       unsigned int xi, unsigned int yi,
       unsigned int w, unsigned int h)
 {
+   video_frame_t frame;
+
 #ifdef RETRO_DEBUG
    printf("XS:%d YS:%d XI:%d YI:%d W:%d H:%d\n",xs,ys,xi,yi,w,h);
 #endif
 
-   video_canvas_render(
-         canvas, (uint8_t *)&retro_bmp,
-         retrow, retroh,
-         retroXS, retroYS,
-         0, 0, /*xi, yi,*/
-         retrow * pix_bytes
-   );
+   TIMEPROBE_ENTER(TIMEPROBE_VIDEO);
 
-   /* Automatic crop */
-   if (crop_id >= CROP_AUTO)
-      video_canvas_crop(canvas);
+   video_frame_get(&frame, canvas);
+   frame.blanked       = vice_raster.blanked;
+   vice_raster.blanked = 0;
 
-   /* Virtual keyboard */
-   if (retro_vkbd)
-      print_vkbd();
+#ifdef HAVE_THREADS
+   render_thread.canvas = canvas;
+
+   if (render_thread.active)
+   {
+      /* The worker converts the rest, unless something changed during the
+       * frame that the lines it has done don't account for */
+      if (     video_frame_same(&render_thread.frame, &frame)
+            && canvas->videoconfig->color_tables.updated
+            && canvas->crt_type == canvas->viewport->crt_type)
+      {
+         slock_lock(render_thread.lock);
+         render_thread.rows_ready = frame.height;
+         scond_broadcast(render_thread.cond);
+         while (render_thread.rows_done < frame.height)
+            scond_wait(render_thread.cond, render_thread.lock);
+         render_thread.active = false;
+         slock_unlock(render_thread.lock);
+
+         video_canvas_render_finish(&frame);
+         TIMEPROBE_LEAVE();
+         return;
+      }
+
+      video_render_thread_stop();
+      render_prev.canvas = NULL;
+   }
+#endif
+
+   video_canvas_render_prepare(&frame);
+   video_canvas_render_lines(&frame, 0, frame.height);
+   video_canvas_render_finish(&frame);
+
+   TIMEPROBE_LEAVE();
 }
 
 int video_init()
@@ -13,6 +13,8 @@
 #include "videoarch.h"
 #include "video.h"
 #include "resources.h"
+#include "sid.h"
+#include "sound.h"
 
 #include "libretro-core.h"
 
@@ -57,6 +59,12 @@ void vsyncarch_presync(void)
 #endif
     retro_renderloop = 0;
     retro_lightpen_update();
+
+    /* Samples held back for the SID threads and logged sound writes belong
+       to this frame */
+    if (sid_thread_deferred() || sound_batch_pending()) {
+        sound_flush();
+    }
 }
 
 void vsyncarch_postsync(void)
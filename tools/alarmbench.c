@@ -0,0 +1,572 @@
+/*
+ * alarmbench.c - Replay alarm traces against the alarm scheduler.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/* Usage: alarmbench [-n repeats] [-a alarms] [trace]
+
+   Replays a trace recorded by a core built with ALARM_TRACE=1 (see
+   alarm.c), or a synthetic trace of one busy context with the given number
+   of alarms (default 16) if none is given, through the alarm scheduler of
+   alarm.h/alarm.c and through the linear scan it used before the heap, and
+   reports the time per operation of both.  First both are run side by
+   side, and they have to agree on the next pending clock and on the alarm
+   that is dispatched next after every operation.  */
+
+#include "vice.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "alarm.h"
+#include "lib.h"
+#include "log.h"
+#include "types.h"
+
+#define MAX_CONTEXTS 16
+
+enum {
+    OP_SET,
+    OP_UNSET,
+    OP_DISPATCH
+};
+
+typedef struct trace_op_s {
+    unsigned int type;
+    unsigned int id;
+    CLOCK clk;
+} trace_op_t;
+
+typedef struct trace_s {
+    trace_op_t *ops;
+    unsigned int num_ops;
+    unsigned int max_ops;
+    unsigned int num_contexts;
+    unsigned int num_alarms;
+    unsigned int *alarm_context;
+} trace_t;
+
+/* ------------------------------------------------------------------------ */
+
+/* Just enough of lib.c and log.c for alarm.c.  */
+
+void *lib_malloc(size_t size)
+{
+    void *p = malloc(size);
+
+    if (p == NULL) {
+        exit(1);
+    }
+    return p;
+}
+
+void lib_free(void *ptr)
+{
+    free(ptr);
+}
+
+char *lib_strdup(const char *str)
+{
+    return strcpy(lib_malloc(strlen(str) + 1), str);
+}
+
+int log_error(log_t log, const char *format, ...)
+{
+    fprintf(stderr, "alarmbench: %s\n", format);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* The scheduler alarm.c used before the heap: an unsorted array, searched
+   linearly for the next pending alarm.  */
+
+typedef struct linear_alarm_s {
+    struct linear_context_s *context;
+    int pending_idx;
+    unsigned int id;
+} linear_alarm_t;
+
+typedef struct linear_context_s {
+    struct {
+        linear_alarm_t *alarm;
+        CLOCK clk;
+    } pending_alarms[ALARM_CONTEXT_MAX_PENDING_ALARMS];
+    unsigned int num_pending_alarms;
+    CLOCK next_pending_alarm_clk;
+    int next_pending_alarm_idx;
+} linear_context_t;
+
+static void linear_update_next_pending(linear_context_t *context)
+{
+    CLOCK next_pending_alarm_clk = CLOCK_MAX;
+    int next_pending_alarm_idx;
+    unsigned int i;
+
+    next_pending_alarm_idx = context->next_pending_alarm_idx;
+
+    for (i = 0; i < context->num_pending_alarms; i++) {
+        CLOCK pending_clk = context->pending_alarms[i].clk;
+
+        if (pending_clk <= next_pending_alarm_clk) {
+            next_pending_alarm_clk = pending_clk;
+            next_pending_alarm_idx = (int)i;
+        }
+    }
+
+    context->next_pending_alarm_clk = next_pending_alarm_clk;
+    context->next_pending_alarm_idx = next_pending_alarm_idx;
+}
+
+static void linear_set(linear_alarm_t *alarm, CLOCK cpu_clk)
+{
+    linear_context_t *context = alarm->context;
+    int idx = alarm->pending_idx;
+
+    if (idx < 0) {
+        int new_idx = (int)(context->num_pending_alarms);
+
+        if (new_idx >= (int)ALARM_CONTEXT_MAX_PENDING_ALARMS) {
+            return;
+        }
+
+        context->pending_alarms[new_idx].alarm = alarm;
+        context->pending_alarms[new_idx].clk = cpu_clk;
+
+        context->num_pending_alarms++;
+
+        if (cpu_clk < context->next_pending_alarm_clk) {
+            context->next_pending_alarm_clk = cpu_clk;
+            context->next_pending_alarm_idx = new_idx;
+        }
+
+        alarm->pending_idx = new_idx;
+    } else {
+        context->pending_alarms[idx].clk = cpu_clk;
+        if (context->next_pending_alarm_clk > cpu_clk
+            || idx == context->next_pending_alarm_idx) {
+            linear_update_next_pending(context);
+        }
+    }
+}
+
+static void linear_unset(linear_alarm_t *alarm)
+{
+    linear_context_t *context = alarm->context;
+    int idx = alarm->pending_idx;
+
+    if (idx < 0) {
+        return;
+    }
+
+    if (context->num_pending_alarms > 1) {
+        int last = --context->num_pending_alarms;
+
+        if (last != idx) {
+            context->pending_alarms[idx].alarm = context->pending_alarms[last].alarm;
+            context->pending_alarms[idx].clk = context->pending_alarms[last].clk;
+            context->pending_alarms[idx].alarm->pending_idx = idx;
+        }
+
+        if (context->next_pending_alarm_idx == idx) {
+            linear_update_next_pending(context);
+        } else if (context->next_pending_alarm_idx == last) {
+            context->next_pending_alarm_idx = idx;
+        }
+    } else {
+        context->num_pending_alarms = 0;
+        context->next_pending_alarm_clk = CLOCK_MAX;
+        context->next_pending_alarm_idx = -1;
+    }
+
+    alarm->pending_idx = -1;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void trace_add(trace_t *trace, unsigned int type, unsigned int id, CLOCK clk)
+{
+    if (trace->num_ops == trace->max_ops) {
+        trace->max_ops = trace->max_ops ? trace->max_ops * 2 : 0x10000;
+        trace->ops = realloc(trace->ops, trace->max_ops * sizeof(trace_op_t));
+        if (trace->ops == NULL) {
+            exit(1);
+        }
+    }
+    trace->ops[trace->num_ops].type = type;
+    trace->ops[trace->num_ops].id = id;
+    trace->ops[trace->num_ops].clk = clk;
+    trace->num_ops++;
+}
+
+static void trace_add_alarm(trace_t *trace, unsigned int id, unsigned int context_id)
+{
+    if (id > trace->num_alarms) {
+        trace->alarm_context = realloc(trace->alarm_context, (id + 1) * sizeof(unsigned int));
+        if (trace->alarm_context == NULL) {
+            exit(1);
+        }
+        memset(trace->alarm_context + trace->num_alarms + 1, 0,
+               (id - trace->num_alarms) * sizeof(unsigned int));
+        trace->num_alarms = id;
+    }
+    trace->alarm_context[id] = context_id;
+}
+
+static int trace_load(trace_t *trace, const char *name)
+{
+    FILE *f;
+    char line[256];
+    unsigned int id, context_id;
+    unsigned long long clk;
+
+    f = fopen(name, "r");
+    if (f == NULL) {
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        switch (line[0]) {
+            case 'c':
+                if (sscanf(line + 1, "%u", &id) == 1 && id > trace->num_contexts) {
+                    trace->num_contexts = id;
+                }
+                break;
+            case 'a':
+                if (sscanf(line + 1, "%u %u", &id, &context_id) == 2) {
+                    trace_add_alarm(trace, id, context_id);
+                }
+                break;
+            case 's':
+                if (sscanf(line + 1, "%u %llu", &id, &clk) == 2) {
+                    trace_add(trace, OP_SET, id, (CLOCK)clk);
+                }
+                break;
+            case 'u':
+                if (sscanf(line + 1, "%u", &id) == 1) {
+                    trace_add(trace, OP_UNSET, id, 0);
+                }
+                break;
+            case 'd':
+                if (sscanf(line + 1, "%u %llu", &id, &clk) == 2) {
+                    trace_add(trace, OP_DISPATCH, id, (CLOCK)clk);
+                }
+                break;
+        }
+    }
+
+    fclose(f);
+
+    return trace->num_contexts > MAX_CONTEXTS ? -1 : 0;
+}
+
+/* A busy context like that of a C64 with several expansions: VIC-II, CIA
+   and SID like alarms firing periodically and rescheduling themselves,
+   some on the same period so that they fall on the same clock, timers that
+   get reprogrammed before they expire, and a second context with a few
+   alarms of its own.  */
+static void trace_generate(trace_t *trace, unsigned int num)
+{
+    static const unsigned int periods[] = {
+        63, 63, 19656, 1023, 1023, 255, 4000, 312, 985, 17, 5000, 20000,
+        100, 100, 77, 12000
+    };
+    CLOCK *due = lib_malloc((num + 4) * sizeof(CLOCK));
+    CLOCK *period = lib_malloc((num + 4) * sizeof(CLOCK));
+    unsigned int seed = 1, i, n;
+
+    trace->num_contexts = 2;
+    for (i = 1; i <= num + 4; i++) {
+        trace_add_alarm(trace, i, i <= num ? 1 : 2);
+        period[i - 1] = periods[(i - 1) % 16] + ((i - 1) / 16) * 8;
+        due[i - 1] = period[i - 1];
+        trace_add(trace, OP_SET, i, due[i - 1]);
+    }
+    num += 4;
+
+    for (n = 0; n < 2000000; n++) {
+        CLOCK next = CLOCK_MAX;
+        unsigned int fire = 0;
+
+        for (i = 0; i < num; i++) {
+            if (due[i] < next) {
+                next = due[i];
+                fire = i;
+            }
+        }
+        trace_add(trace, OP_DISPATCH, trace->alarm_context[fire + 1], next);
+        due[fire] = next + period[fire];
+        trace_add(trace, OP_SET, fire + 1, due[fire]);
+
+        /* reprogram a random timer now and then */
+        seed = seed * 1103515245 + 12345;
+        if ((seed >> 16) % 4 == 0) {
+            i = (seed >> 8) % num;
+            if (due[i] != next) {
+                due[i] = next + 1 + (seed >> 20) % period[i];
+                trace_add(trace, OP_UNSET, i + 1, 0);
+                trace_add(trace, OP_SET, i + 1, due[i]);
+            }
+        }
+    }
+
+    lib_free(due);
+    lib_free(period);
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void callback_none(CLOCK offset, void *data)
+{
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static unsigned int next_alarm_id(alarm_context_t *context)
+{
+    if (context->num_pending_alarms == 0) {
+        return 0;
+    }
+    return (unsigned int)(uintptr_t)context->pending_alarms[context->next_pending_alarm_idx].alarm->data;
+}
+
+static unsigned int linear_next_alarm_id(linear_context_t *context)
+{
+    if (context->num_pending_alarms == 0) {
+        return 0;
+    }
+    return context->pending_alarms[context->next_pending_alarm_idx].alarm->id;
+}
+
+/* Runs both schedulers side by side, returns -1 if they disagree on the next
+   pending clock or alarm of any context after any operation.  */
+static int verify(const trace_t *trace, alarm_context_t **contexts, alarm_t **alarms,
+                  linear_context_t *linear_contexts, linear_alarm_t *linear_alarms)
+{
+    unsigned int i, c;
+
+    for (i = 0; i < trace->num_ops; i++) {
+        const trace_op_t *op = &trace->ops[i];
+
+        switch (op->type) {
+            case OP_SET:
+                alarm_set(alarms[op->id], op->clk);
+                linear_set(&linear_alarms[op->id], op->clk);
+                break;
+            case OP_UNSET:
+                alarm_unset(alarms[op->id]);
+                linear_unset(&linear_alarms[op->id]);
+                break;
+            default:
+                break;
+        }
+        for (c = 0; c <= trace->num_contexts; c++) {
+            if (alarm_context_next_pending_clk(contexts[c]) != linear_contexts[c].next_pending_alarm_clk
+                || next_alarm_id(contexts[c]) != linear_next_alarm_id(&linear_contexts[c])) {
+                fprintf(stderr, "alarmbench: operation %u: alarm %u at %" PRIu64 " instead of alarm %u at %" PRIu64 "\n",
+                        i, next_alarm_id(contexts[c]), (uint64_t)alarm_context_next_pending_clk(contexts[c]),
+                        linear_next_alarm_id(&linear_contexts[c]), (uint64_t)linear_contexts[c].next_pending_alarm_clk);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static uint64_t replay_heap(const trace_t *trace, alarm_context_t **contexts, alarm_t **alarms)
+{
+    uint64_t sum = 0;
+    unsigned int i;
+
+    for (i = 0; i < trace->num_ops; i++) {
+        const trace_op_t *op = &trace->ops[i];
+        alarm_context_t *context;
+
+        switch (op->type) {
+            case OP_SET:
+                alarm_set(alarms[op->id], op->clk);
+                context = alarms[op->id]->context;
+                break;
+            case OP_UNSET:
+                alarm_unset(alarms[op->id]);
+                context = alarms[op->id]->context;
+                break;
+            default:
+                context = contexts[op->id];
+                if (context->num_pending_alarms > 0) {
+                    alarm_context_dispatch(context, op->clk);
+                }
+                break;
+        }
+        sum += alarm_context_next_pending_clk(context);
+    }
+    return sum;
+}
+
+static uint64_t replay_linear(const trace_t *trace, linear_context_t *contexts, linear_alarm_t *alarms)
+{
+    uint64_t sum = 0;
+    unsigned int i;
+
+    for (i = 0; i < trace->num_ops; i++) {
+        const trace_op_t *op = &trace->ops[i];
+        linear_context_t *context;
+
+        switch (op->type) {
+            case OP_SET:
+                linear_set(&alarms[op->id], op->clk);
+                context = alarms[op->id].context;
+                break;
+            case OP_UNSET:
+                linear_unset(&alarms[op->id]);
+                context = alarms[op->id].context;
+                break;
+            default:
+                context = &contexts[op->id];
+                if (context->num_pending_alarms > 0) {
+                    callback_none(op->clk - context->next_pending_alarm_clk,
+                                  context->pending_alarms[context->next_pending_alarm_idx].alarm);
+                }
+                break;
+        }
+        sum += context->next_pending_alarm_clk;
+    }
+    return sum;
+}
+
+static void setup(const trace_t *trace, alarm_context_t **contexts, alarm_t **alarms,
+                  linear_context_t *linear_contexts, linear_alarm_t *linear_alarms)
+{
+    unsigned int i;
+
+    for (i = 0; i <= trace->num_contexts; i++) {
+        alarm_context_init(contexts[i], "bench");
+        linear_contexts[i].num_pending_alarms = 0;
+        linear_contexts[i].next_pending_alarm_clk = CLOCK_MAX;
+        linear_contexts[i].next_pending_alarm_idx = -1;
+    }
+    for (i = 0; i <= trace->num_alarms; i++) {
+        unsigned int context_id = i > 0 ? trace->alarm_context[i] : 0;
+
+        alarms[i] = alarm_new(contexts[context_id], "bench", callback_none, (void *)(uintptr_t)i);
+        linear_alarms[i].context = &linear_contexts[context_id];
+        linear_alarms[i].pending_idx = -1;
+        linear_alarms[i].id = i;
+    }
+}
+
+static void teardown(const trace_t *trace, alarm_t **alarms)
+{
+    unsigned int i;
+
+    for (i = 0; i <= trace->num_alarms; i++) {
+        alarm_destroy(alarms[i]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    trace_t trace;
+    alarm_context_t *contexts[MAX_CONTEXTS + 1];
+    alarm_t **alarms;
+    linear_context_t *linear_contexts;
+    linear_alarm_t *linear_alarms;
+    const char *name = NULL;
+    unsigned int repeats = 10, num = 16, i, r;
+    uint64_t sum_heap = 0, sum_linear = 0;
+    double t, t_heap, t_linear;
+
+    for (i = 1; i < (unsigned int)argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < (unsigned int)argc) {
+            repeats = (unsigned int)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-a") == 0 && i + 1 < (unsigned int)argc) {
+            num = (unsigned int)atoi(argv[++i]);
+        } else {
+            name = argv[i];
+        }
+    }
+
+    if (num < 1 || num + 4 > ALARM_CONTEXT_MAX_PENDING_ALARMS) {
+        fprintf(stderr, "alarmbench: between 1 and %u alarms\n", ALARM_CONTEXT_MAX_PENDING_ALARMS - 4);
+        return 1;
+    }
+
+    memset(&trace, 0, sizeof(trace));
+    if (name != NULL) {
+        if (trace_load(&trace, name) < 0) {
+            fprintf(stderr, "alarmbench: cannot load trace `%s'\n", name);
+            return 1;
+        }
+    } else {
+        trace_generate(&trace, num);
+    }
+
+    alarms = lib_malloc((trace.num_alarms + 1) * sizeof(alarm_t *));
+    linear_contexts = lib_malloc((trace.num_contexts + 1) * sizeof(linear_context_t));
+    linear_alarms = lib_malloc((trace.num_alarms + 1) * sizeof(linear_alarm_t));
+
+    for (i = 0; i <= trace.num_contexts; i++) {
+        contexts[i] = alarm_context_new("bench");
+    }
+
+    setup(&trace, contexts, alarms, linear_contexts, linear_alarms);
+    if (verify(&trace, contexts, alarms, linear_contexts, linear_alarms) < 0) {
+        return 1;
+    }
+    teardown(&trace, alarms);
+
+    t_heap = t_linear = 0.0;
+    for (r = 0; r < repeats; r++) {
+        setup(&trace, contexts, alarms, linear_contexts, linear_alarms);
+
+        t = now();
+        sum_heap = replay_heap(&trace, contexts, alarms);
+        t_heap += now() - t;
+
+        t = now();
+        sum_linear = replay_linear(&trace, linear_contexts, linear_alarms);
+        t_linear += now() - t;
+
+        teardown(&trace, alarms);
+
+        if (sum_heap != sum_linear) {
+            fprintf(stderr, "alarmbench: schedulers disagree on the next pending clock\n");
+            return 1;
+        }
+    }
+
+    printf("%u operations, %u alarms in %u contexts, %u repeats\n",
+           trace.num_ops, trace.num_alarms, trace.num_contexts, repeats);
+    printf("alarm.c: %6.2f ns/op\n", t_heap * 1e9 / ((double)trace.num_ops * repeats));
+    printf("linear:  %6.2f ns/op\n", t_linear * 1e9 / ((double)trace.num_ops * repeats));
+
+    return 0;
+}
@@ -0,0 +1,543 @@
+/*
+ * corehost.c - Minimal libretro frontend for the tools.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#include <dlfcn.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "corehost.h"
+
+#define MAX_OPTIONS 512
+
+const char *corehost_directory = ".";
+int corehost_verbose = 0;
+unsigned int corehost_pixel_bytes = 2;
+
+static const char *option_keys[MAX_OPTIONS];
+static const char *option_values[MAX_OPTIONS];
+static unsigned int num_options = 0;
+
+static retro_audio_sample_batch_t audio_batch_cb;
+
+/* Built-in workloads.  All but "@basic" are machine code started with
+   10 SYS2061.
+
+   "@basic" keeps the CPU busy in the floating point routines of the BASIC
+   ROM and prints to the screen:
+
+   10 A=0:FOR I=1 TO 500:A=A+SQR(I)*SIN(I):B$=STR$(A):NEXT
+   20 PRINT A:GOTO 10  */
+static const uint8_t basic_prg[] = {
+    0x01, 0x08, 0x2d, 0x08, 0x0a, 0x00, 0x41, 0xb2, 0x30, 0x3a, 0x81, 0x20,
+    0x49, 0xb2, 0x31, 0x20, 0xa4, 0x20, 0x35, 0x30, 0x30, 0x3a, 0x41, 0xb2,
+    0x41, 0xaa, 0xba, 0x28, 0x49, 0x29, 0xac, 0xbf, 0x28, 0x49, 0x29, 0x3a,
+    0x42, 0x24, 0xb2, 0xc4, 0x28, 0x41, 0x29, 0x3a, 0x82, 0x00, 0x3a, 0x08,
+    0x14, 0x00, 0x99, 0x20, 0x41, 0x3a, 0x89, 0x20, 0x31, 0x30, 0x00, 0x00,
+    0x00
+};
+
+/* "@raster" fills the screen, turns on eight expanded multicolor sprites
+   and then changes the border and background color on every line of the
+   display window, moves the sprites and cycles $d016 once a frame.  */
+static const uint8_t raster_prg[] = {
+    0x01, 0x08, 0x0b, 0x08, 0x0a, 0x00, 0x9e, 0x32, 0x30, 0x36, 0x31, 0x00,
+    0x00, 0x00, 0x78, 0xa9, 0x7f, 0x8d, 0x0d, 0xdc, 0xad, 0x0d, 0xdc, 0xa2,
+    0x00, 0x8a, 0x9d, 0x00, 0x04, 0x9d, 0x00, 0x05, 0x9d, 0x00, 0x06, 0x9d,
+    0xe8, 0x06, 0x9d, 0x00, 0xd8, 0x9d, 0x00, 0xd9, 0x9d, 0x00, 0xda, 0x9d,
+    0xe8, 0xda, 0xe8, 0xd0, 0xe4, 0xa2, 0x3f, 0x8a, 0x49, 0x55, 0x9d, 0x40,
+    0x03, 0xca, 0x10, 0xf7, 0xa2, 0x0f, 0xbd, 0x8e, 0x08, 0x9d, 0x00, 0xd0,
+    0xca, 0x10, 0xf7, 0xa2, 0x07, 0xa9, 0x0d, 0x9d, 0xf8, 0x07, 0x8a, 0x9d,
+    0x27, 0xd0, 0xca, 0x10, 0xf4, 0xa9, 0xff, 0x8d, 0x15, 0xd0, 0x8d, 0x1c,
+    0xd0, 0x8d, 0x17, 0xd0, 0xa9, 0x32, 0xcd, 0x12, 0xd0, 0xd0, 0xfb, 0xa0,
+    0x00, 0xae, 0x12, 0xd0, 0xec, 0x12, 0xd0, 0xf0, 0xfb, 0x8c, 0x20, 0xd0,
+    0x8c, 0x21, 0xd0, 0xc8, 0xc0, 0xc0, 0xd0, 0xed, 0xa2, 0x0e, 0xfe, 0x00,
+    0xd0, 0xca, 0xca, 0x10, 0xf9, 0xee, 0x16, 0xd0, 0x4c, 0x63, 0x08, 0x18,
+    0x3c, 0x38, 0x4c, 0x58, 0x5c, 0x78, 0x6c, 0x98, 0x7c, 0xb8, 0x8c, 0xd8,
+    0x9c, 0xf8, 0xac
+};
+
+/* "@sid" plays pulse, ring modulated triangle and noise on the three
+   voices through the resonant low pass filter, sweeping the frequencies,
+   the pulse width and the cutoff once a frame and gating the voices every
+   16 frames.  */
+static const uint8_t sid_prg[] = {
+    0x01, 0x08, 0x0b, 0x08, 0x0a, 0x00, 0x9e, 0x32, 0x30, 0x36, 0x31, 0x00,
+    0x00, 0x00, 0x78, 0xa9, 0x7f, 0x8d, 0x0d, 0xdc, 0xad, 0x0d, 0xdc, 0xa2,
+    0x18, 0xa9, 0x00, 0x9d, 0x00, 0xd4, 0xca, 0x10, 0xfa, 0xa9, 0x1f, 0x8d,
+    0x18, 0xd4, 0xa9, 0xf7, 0x8d, 0x17, 0xd4, 0xa9, 0x09, 0x8d, 0x05, 0xd4,
+    0x8d, 0x0c, 0xd4, 0x8d, 0x13, 0xd4, 0xa9, 0xa8, 0x8d, 0x06, 0xd4, 0x8d,
+    0x0d, 0xd4, 0x8d, 0x14, 0xd4, 0xa9, 0x08, 0x8d, 0x03, 0xd4, 0x8d, 0x0a,
+    0xd4, 0xa9, 0x80, 0xcd, 0x12, 0xd0, 0xd0, 0xfb, 0xcd, 0x12, 0xd0, 0xf0,
+    0xfb, 0xee, 0xa7, 0x02, 0xad, 0xa7, 0x02, 0x8d, 0x01, 0xd4, 0x8d, 0x16,
+    0xd4, 0x0a, 0x8d, 0x08, 0xd4, 0x4a, 0x4a, 0x8d, 0x0f, 0xd4, 0x8d, 0x02,
+    0xd4, 0xad, 0xa7, 0x02, 0x29, 0x10, 0xf0, 0x12, 0xa9, 0x41, 0x8d, 0x04,
+    0xd4, 0xa9, 0x15, 0x8d, 0x0b, 0xd4, 0xa9, 0x81, 0x8d, 0x12, 0xd4, 0x4c,
+    0x48, 0x08, 0xa9, 0x40, 0x8d, 0x04, 0xd4, 0xa9, 0x14, 0x8d, 0x0b, 0xd4,
+    0xa9, 0x80, 0x8d, 0x12, 0xd4, 0x4c, 0x48, 0x08
+};
+
+/* "@fastload" uploads a fast loader to $0500 of drive 8 with M-W and starts
+   it with M-E.  The drive reads the sectors of tracks 17 to 14 over and
+   over with the job queue and sends every byte to the C64 in four pairs of
+   bits on CLK and DATA, 24 cycles apart after a handshake, with interrupts
+   off on both sides.  The C64 reads the pairs at fixed cycles with the
+   screen blanked, and stores the sectors to the screen memory and the
+   sector count to the border color.  */
+static const uint8_t fastload_prg[] = {
+    0x01, 0x08, 0x0b, 0x08, 0x0a, 0x00, 0x9e, 0x32, 0x30, 0x36, 0x31, 0x00,
+    0x00, 0x00, 0xa9, 0x0f, 0xa2, 0x08, 0xa0, 0x0f, 0x20, 0xba, 0xff, 0xa9,
+    0x26, 0xa2, 0x8c, 0xa0, 0x09, 0x20, 0xbd, 0xff, 0x20, 0xc0, 0xff, 0xa9,
+    0x0f, 0x20, 0xc3, 0xff, 0xa9, 0x0f, 0xa2, 0x08, 0xa0, 0x0f, 0x20, 0xba,
+    0xff, 0xa9, 0x26, 0xa2, 0xb2, 0xa0, 0x09, 0x20, 0xbd, 0xff, 0x20, 0xc0,
+    0xff, 0xa9, 0x0f, 0x20, 0xc3, 0xff, 0xa9, 0x0f, 0xa2, 0x08, 0xa0, 0x0f,
+    0x20, 0xba, 0xff, 0xa9, 0x26, 0xa2, 0xd8, 0xa0, 0x09, 0x20, 0xbd, 0xff,
+    0x20, 0xc0, 0xff, 0xa9, 0x0f, 0x20, 0xc3, 0xff, 0xa9, 0x0f, 0xa2, 0x08,
+    0xa0, 0x0f, 0x20, 0xba, 0xff, 0xa9, 0x26, 0xa2, 0xfe, 0xa0, 0x09, 0x20,
+    0xbd, 0xff, 0x20, 0xc0, 0xff, 0xa9, 0x0f, 0x20, 0xc3, 0xff, 0xa9, 0x0f,
+    0xa2, 0x08, 0xa0, 0x0f, 0x20, 0xba, 0xff, 0xa9, 0x26, 0xa2, 0x24, 0xa0,
+    0x0a, 0x20, 0xbd, 0xff, 0x20, 0xc0, 0xff, 0xa9, 0x0f, 0x20, 0xc3, 0xff,
+    0xa9, 0x0f, 0xa2, 0x08, 0xa0, 0x0f, 0x20, 0xba, 0xff, 0xa9, 0x26, 0xa2,
+    0x4a, 0xa0, 0x0a, 0x20, 0xbd, 0xff, 0x20, 0xc0, 0xff, 0xa9, 0x0f, 0x20,
+    0xc3, 0xff, 0xa9, 0x0f, 0xa2, 0x08, 0xa0, 0x0f, 0x20, 0xba, 0xff, 0xa9,
+    0x13, 0xa2, 0x70, 0xa0, 0x0a, 0x20, 0xbd, 0xff, 0x20, 0xc0, 0xff, 0xa9,
+    0x0f, 0x20, 0xc3, 0xff, 0xa9, 0x0f, 0xa2, 0x08, 0xa0, 0x0f, 0x20, 0xba,
+    0xff, 0xa9, 0x05, 0xa2, 0x83, 0xa0, 0x0a, 0x20, 0xbd, 0xff, 0x20, 0xc0,
+    0xff, 0x78, 0xa9, 0x00, 0x85, 0xfb, 0xa9, 0x04, 0x85, 0xfc, 0xa0, 0x00,
+    0xa9, 0x13, 0x8d, 0x00, 0xdd, 0x2c, 0x00, 0xdd, 0x30, 0xfb, 0xc0, 0x00,
+    0xd0, 0x0f, 0xad, 0x12, 0xd0, 0xc9, 0xfb, 0xd0, 0xf9, 0xad, 0x11, 0xd0,
+    0x29, 0xef, 0x8d, 0x11, 0xd0, 0xa9, 0x03, 0x8d, 0x00, 0xdd, 0xea, 0xea,
+    0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0xad, 0x00,
+    0xdd, 0x85, 0x02, 0x24, 0x00, 0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0xea,
+    0xad, 0x00, 0xdd, 0x85, 0x03, 0x24, 0x00, 0xea, 0xea, 0xea, 0xea, 0xea,
+    0xea, 0xea, 0xad, 0x00, 0xdd, 0x85, 0x04, 0x24, 0x00, 0xea, 0xea, 0xea,
+    0xea, 0xea, 0xea, 0xea, 0xad, 0x00, 0xdd, 0x85, 0x05, 0xa5, 0x05, 0x0a,
+    0x26, 0x06, 0x0a, 0x26, 0x06, 0xa5, 0x04, 0x0a, 0x26, 0x06, 0x0a, 0x26,
+    0x06, 0xa5, 0x03, 0x0a, 0x26, 0x06, 0x0a, 0x26, 0x06, 0xa5, 0x02, 0x0a,
+    0x26, 0x06, 0x0a, 0x26, 0x06, 0xa5, 0x06, 0x91, 0xfb, 0x2c, 0x00, 0xdd,
+    0x10, 0xfb, 0xc8, 0xf0, 0x03, 0x4c, 0xe3, 0x08, 0xad, 0x11, 0xd0, 0x09,
+    0x10, 0x8d, 0x11, 0xd0, 0xee, 0x20, 0xd0, 0xe6, 0xfc, 0xa5, 0xfc, 0xc9,
+    0x08, 0xf0, 0x03, 0x4c, 0xe1, 0x08, 0xa9, 0x04, 0x85, 0xfc, 0x4c, 0xe1,
+    0x08, 0x4d, 0x2d, 0x57, 0x00, 0x05, 0x20, 0xa9, 0x11, 0x8d, 0xf4, 0x05,
+    0xa9, 0x00, 0x8d, 0xf5, 0x05, 0xad, 0xf4, 0x05, 0x85, 0x06, 0xad, 0xf5,
+    0x05, 0x85, 0x07, 0x58, 0xa9, 0x80, 0x85, 0x00, 0xa5, 0x00, 0x30, 0xfc,
+    0x78, 0xa0, 0x00, 0x4d, 0x2d, 0x57, 0x20, 0x05, 0x20, 0xb9, 0x00, 0x03,
+    0x48, 0x29, 0x03, 0xaa, 0xbd, 0xc9, 0x05, 0x8d, 0xf0, 0x05, 0x68, 0x4a,
+    0x4a, 0x48, 0x29, 0x03, 0xaa, 0xbd, 0xc9, 0x05, 0x8d, 0xf1, 0x05, 0x68,
+    0x4a, 0x4a, 0x48, 0x29, 0x03, 0x4d, 0x2d, 0x57, 0x40, 0x05, 0x20, 0xaa,
+    0xbd, 0xc9, 0x05, 0x8d, 0xf2, 0x05, 0x68, 0x4a, 0x4a, 0xaa, 0xbd, 0xc9,
+    0x05, 0x8d, 0xf3, 0x05, 0xad, 0x00, 0x18, 0x29, 0x04, 0xf0, 0xf9, 0xa9,
+    0x02, 0x8d, 0x00, 0x18, 0xad, 0x00, 0x18, 0x4d, 0x2d, 0x57, 0x60, 0x05,
+    0x20, 0x29, 0x04, 0xd0, 0xf9, 0xae, 0xf0, 0x05, 0x8e, 0x00, 0x18, 0xea,
+    0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0xae, 0xf1, 0x05, 0x8e, 0x00,
+    0x18, 0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0x4d, 0x2d, 0x57,
+    0x80, 0x05, 0x20, 0xae, 0xf2, 0x05, 0x8e, 0x00, 0x18, 0xea, 0xea, 0xea,
+    0xea, 0xea, 0xea, 0xea, 0xea, 0xae, 0xf3, 0x05, 0x8e, 0x00, 0x18, 0xea,
+    0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0xa9, 0x00, 0x8d, 0x4d,
+    0x2d, 0x57, 0xa0, 0x05, 0x20, 0x00, 0x18, 0xc8, 0xf0, 0x03, 0x4c, 0x20,
+    0x05, 0xee, 0xf5, 0x05, 0xad, 0xf5, 0x05, 0xc9, 0x15, 0xd0, 0x14, 0xa9,
+    0x00, 0x8d, 0xf5, 0x05, 0xce, 0xf4, 0x05, 0xad, 0xf4, 0x05, 0xc9, 0x0d,
+    0xd0, 0x4d, 0x2d, 0x57, 0xc0, 0x05, 0x0d, 0x05, 0xa9, 0x11, 0x8d, 0xf4,
+    0x05, 0x4c, 0x0a, 0x05, 0x0a, 0x02, 0x08, 0x00, 0x4d, 0x2d, 0x45, 0x00,
+    0x05
+};
+
+/* "@sidload" plays a pulse on the first SID and a triangle an octave up
+   on a second one at $d420 from the raster interrupt, gating them every
+   16 frames, and loads itself to $2000 over and over with the KERNAL, so
+   the drive runs while both SIDs play.  */
+static const uint8_t sidload_prg[] = {
+    0x01, 0x08, 0x0b, 0x08, 0x0a, 0x00, 0x9e, 0x32, 0x30, 0x36, 0x31, 0x00,
+    0x00, 0x00, 0xa9, 0x0f, 0x8d, 0x18, 0xd4, 0x8d, 0x38, 0xd4, 0xa9, 0x08,
+    0x8d, 0x03, 0xd4, 0x8d, 0x23, 0xd4, 0xa9, 0x00, 0x8d, 0x05, 0xd4, 0x8d,
+    0x25, 0xd4, 0xa9, 0xf0, 0x8d, 0x06, 0xd4, 0x8d, 0x26, 0xd4, 0x78, 0xa9,
+    0x57, 0x8d, 0x14, 0x03, 0xa9, 0x08, 0x8d, 0x15, 0x03, 0x58, 0xa9, 0x01,
+    0xa2, 0x85, 0xa0, 0x08, 0x20, 0xbd, 0xff, 0xa9, 0x01, 0xa2, 0x08, 0xa0,
+    0x00, 0x20, 0xba, 0xff, 0xa9, 0x00, 0xa2, 0x00, 0xa0, 0x20, 0x20, 0xd5,
+    0xff, 0x4c, 0x39, 0x08, 0xee, 0x86, 0x08, 0xad, 0x86, 0x08, 0x8d, 0x01,
+    0xd4, 0x0a, 0x8d, 0x21, 0xd4, 0xad, 0x86, 0x08, 0x29, 0x10, 0xd0, 0x0d,
+    0xa9, 0x40, 0x8d, 0x04, 0xd4, 0xa9, 0x10, 0x8d, 0x24, 0xd4, 0x4c, 0x31,
+    0xea, 0xa9, 0x41, 0x8d, 0x04, 0xd4, 0xa9, 0x11, 0x8d, 0x24, 0xd4, 0x4c,
+    0x31, 0xea, 0x2a, 0x00
+};
+
+/* "@disk" is a disk image with "@basic" padded to 100 blocks, so
+   autostarting it loads for a while with true drive emulation.
+   "@fastload" is a disk image with just the loader and "@sidload" one
+   with its program padded to 12 blocks.  */
+#define DISK_SIZE   174848
+
+typedef struct workload_s {
+    const char *name;
+    const uint8_t *prg;
+    size_t size;
+    int blocks;     /* blocks of the file on a disk image, 0 for a PRG */
+} workload_t;
+
+static const workload_t workloads[] = {
+    { "@basic", basic_prg, sizeof(basic_prg), 0 },
+    { "@raster", raster_prg, sizeof(raster_prg), 0 },
+    { "@sid", sid_prg, sizeof(sid_prg), 0 },
+    { "@disk", basic_prg, sizeof(basic_prg), 100 },
+    { "@fastload", fastload_prg, sizeof(fastload_prg), 3 },
+    { "@sidload", sidload_prg, sizeof(sidload_prg), 12 },
+    { NULL, NULL, 0, 0 }
+};
+
+uint64_t corehost_hash(uint64_t hash, const void *data, size_t size)
+{
+    const uint8_t *p = data;
+
+    while (size--) {
+        hash ^= *p++;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static void add_option(const char *key, const char *value)
+{
+    unsigned int i;
+
+    for (i = 0; i < num_options; i++) {
+        if (!strcmp(option_keys[i], key)) {
+            return;
+        }
+    }
+    if (num_options < MAX_OPTIONS) {
+        option_keys[num_options] = key;
+        option_values[num_options++] = value;
+    }
+}
+
+int corehost_option(char *arg)
+{
+    char *value = strchr(arg, '=');
+
+    if (value == NULL) {
+        return -1;
+    }
+    *value++ = '\0';
+    add_option(arg, value);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void core_log(enum retro_log_level level, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (level < RETRO_LOG_ERROR && !corehost_verbose) {
+        return;
+    }
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+static bool core_environment(unsigned int cmd, void *data)
+{
+    switch (cmd) {
+        case RETRO_ENVIRONMENT_GET_LOG_INTERFACE:
+            ((struct retro_log_callback *)data)->log = core_log;
+            return true;
+        case RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY:
+        case RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY:
+            *(const char **)data = corehost_directory;
+            return true;
+        case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT:
+            corehost_pixel_bytes = (*(const enum retro_pixel_format *)data == RETRO_PIXEL_FORMAT_XRGB8888) ? 4 : 2;
+            return true;
+        case RETRO_ENVIRONMENT_GET_CORE_OPTIONS_VERSION:
+            *(unsigned int *)data = 0;
+            return true;
+        case RETRO_ENVIRONMENT_SET_VARIABLES:
+            {
+                const struct retro_variable *var;
+
+                /* "Description; default|other|..." */
+                for (var = data; var->key != NULL; var++) {
+                    const char *value = strchr(var->value, ';');
+                    const char *end;
+
+                    if (value == NULL) {
+                        continue;
+                    }
+                    value += 2;
+                    end = strchr(value, '|');
+                    add_option(var->key, end != NULL ? strndup(value, (size_t)(end - value)) : value);
+                }
+            }
+            return true;
+        case RETRO_ENVIRONMENT_GET_VARIABLE:
+            {
+                struct retro_variable *var = data;
+                unsigned int i;
+
+                for (i = 0; i < num_options; i++) {
+                    if (!strcmp(option_keys[i], var->key)) {
+                        var->value = option_values[i];
+                        return true;
+                    }
+                }
+                var->value = NULL;
+            }
+            return false;
+        case RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE:
+            *(bool *)data = false;
+            return true;
+        default:
+            break;
+    }
+    return false;
+}
+
+static void core_audio_sample(int16_t left, int16_t right)
+{
+    int16_t sample[2] = { left, right };
+
+    audio_batch_cb(sample, 1);
+}
+
+static void core_input_poll(void)
+{
+}
+
+static int16_t core_input_state(unsigned int port, unsigned int device, unsigned int index, unsigned int id)
+{
+    return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void content_name(char *name, size_t size, const char *extension)
+{
+    snprintf(name, size, "%s/corehost-%d.%s", corehost_directory, (int)getpid(), extension);
+}
+
+static int sectors_per_track(int track)
+{
+    return track <= 17 ? 21 : track <= 24 ? 19 : track <= 30 ? 18 : 17;
+}
+
+static uint8_t *disk_sector(uint8_t *disk, int track, int sector)
+{
+    int t, offset = sector;
+
+    for (t = 1; t < track; t++) {
+        offset += sectors_per_track(t);
+    }
+    return disk + offset * 256;
+}
+
+/* Writes a D64 image with a single file "BENCH" of `blocks' blocks,
+   allocated from track 17 downwards with the interleave of the 1541 DOS.
+   The free blocks outside the directory track are filled with a pattern
+   for "@fastload" to read.  */
+static int write_disk(const char *name, const uint8_t *prg, size_t size, int blocks)
+{
+    static const uint8_t disk_name[27] = {
+        'C', 'O', 'R', 'E', 'H', 'O', 'S', 'T', 0xa0, 0xa0, 0xa0, 0xa0, 0xa0,
+        0xa0, 0xa0, 0xa0, 0xa0, 0xa0, 'C', 'H', 0xa0, '2', 'A', 0xa0, 0xa0,
+        0xa0, 0xa0
+    };
+    static const uint8_t file_name[16] = {
+        'B', 'E', 'N', 'C', 'H', 0xa0, 0xa0, 0xa0, 0xa0, 0xa0, 0xa0, 0xa0,
+        0xa0, 0xa0, 0xa0, 0xa0
+    };
+    uint8_t used[36][21];
+    uint8_t *disk, *bam, *dir, *block = NULL;
+    int track = 17, sector = 0, n = 0;
+    int t, s, i;
+    size_t pos = 0;
+    FILE *f;
+
+    disk = calloc(DISK_SIZE, 1);
+    if (disk == NULL) {
+        return -1;
+    }
+    memset(used, 0, sizeof(used));
+
+    for (i = 0; i < DISK_SIZE; i++) {
+        disk[i] = (uint8_t)(i * 7 + (i >> 8));
+    }
+    memset(disk_sector(disk, 18, 0), 0, sectors_per_track(18) * 256);
+
+    for (i = 0; i < blocks; i++) {
+        while (used[track][sector]) {
+            sector = (sector + 1) % sectors_per_track(track);
+        }
+        used[track][sector] = 1;
+        if (block != NULL) {
+            block[0] = (uint8_t)track;
+            block[1] = (uint8_t)sector;
+        }
+        block = disk_sector(disk, track, sector);
+        for (s = 2; s < 256; s++, pos++) {
+            block[s] = pos < size ? prg[pos] : (uint8_t)(pos * 7);
+        }
+        if (++n == sectors_per_track(track)) {
+            track--;
+            sector = 0;
+            n = 0;
+        } else {
+            sector = (sector + 10) % sectors_per_track(track);
+        }
+    }
+    block[0] = 0;
+    block[1] = 0xff;
+
+    used[18][0] = used[18][1] = 1;
+    bam = disk_sector(disk, 18, 0);
+    bam[0] = 18;
+    bam[1] = 1;
+    bam[2] = 0x41;
+    for (t = 1; t <= 35; t++) {
+        uint32_t free_map = 0;
+
+        for (s = 0; s < sectors_per_track(t); s++) {
+            if (!used[t][s]) {
+                free_map |= 1U << s;
+                bam[t * 4]++;
+            }
+        }
+        bam[t * 4 + 1] = (uint8_t)free_map;
+        bam[t * 4 + 2] = (uint8_t)(free_map >> 8);
+        bam[t * 4 + 3] = (uint8_t)(free_map >> 16);
+    }
+    memcpy(bam + 0x90, disk_name, sizeof(disk_name));
+
+    dir = disk_sector(disk, 18, 1);
+    dir[1] = 0xff;
+    dir[2] = 0x82;
+    dir[3] = 17;
+    dir[4] = 0;
+    memcpy(dir + 5, file_name, sizeof(file_name));
+    dir[30] = (uint8_t)blocks;
+
+    f = fopen(name, "wb");
+    if (f == NULL) {
+        perror(name);
+        free(disk);
+        return -1;
+    }
+    fwrite(disk, 1, DISK_SIZE, f);
+    fclose(f);
+    free(disk);
+    return 0;
+}
+
+int corehost_content(char *content, size_t size, const char *image, unsigned long seed)
+{
+    char builtin[4096];
+    const workload_t *w;
+    FILE *f;
+
+    if (image[0] == '@') {
+        for (w = workloads; w->name != NULL && strcmp(w->name, image); w++) {
+        }
+        if (w->name == NULL) {
+            fprintf(stderr, "unknown workload `%s'\n", image);
+            return -1;
+        }
+        if (w->blocks > 0) {
+            content_name(builtin, sizeof(builtin), "d64");
+            if (write_disk(builtin, w->prg, w->size, w->blocks) < 0) {
+                return -1;
+            }
+        } else {
+            content_name(builtin, sizeof(builtin), "prg");
+            f = fopen(builtin, "wb");
+            if (f == NULL) {
+                perror(builtin);
+                return -1;
+            }
+            fwrite(w->prg, 1, w->size, f);
+            fclose(f);
+        }
+        image = builtin;
+    }
+
+    /* The seed can only be passed with a playlist command line.  */
+    content_name(content, size, "m3u");
+    f = fopen(content, "w");
+    if (f == NULL) {
+        perror(content);
+        return -1;
+    }
+    fprintf(f, "#COMMAND:-seed %lu \"%s\"\n%s\n", seed, image, image);
+    fclose(f);
+
+    return 0;
+}
+
+void corehost_content_remove(const char *content)
+{
+    char builtin[4096];
+
+    remove(content);
+    content_name(builtin, sizeof(builtin), "prg");
+    remove(builtin);
+    content_name(builtin, sizeof(builtin), "d64");
+    remove(builtin);
+}
+
+int corehost_load(corehost_t *core, const char *path, const char *content,
+                  retro_video_refresh_t video, retro_audio_sample_batch_t audio)
+{
+    struct retro_game_info info;
+
+    core->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (core->handle == NULL) {
+        fprintf(stderr, "%s\n", dlerror());
+        return -1;
+    }
+
+    audio_batch_cb = audio;
+
+    ((void (*)(retro_environment_t))dlsym(core->handle, "retro_set_environment"))(core_environment);
+    ((void (*)(retro_video_refresh_t))dlsym(core->handle, "retro_set_video_refresh"))(video);
+    ((void (*)(retro_audio_sample_batch_t))dlsym(core->handle, "retro_set_audio_sample_batch"))(audio);
+    ((void (*)(retro_audio_sample_t))dlsym(core->handle, "retro_set_audio_sample"))(core_audio_sample);
+    ((void (*)(retro_input_poll_t))dlsym(core->handle, "retro_set_input_poll"))(core_input_poll);
+    ((void (*)(retro_input_state_t))dlsym(core->handle, "retro_set_input_state"))(core_input_state);
+    ((void (*)(void))dlsym(core->handle, "retro_init"))();
+
+    memset(&info, 0, sizeof(info));
+    info.path = content;
+    if (!((bool (*)(const struct retro_game_info *))dlsym(core->handle, "retro_load_game"))(&info)) {
+        fprintf(stderr, "%s: cannot load `%s'\n", path, content);
+        return -1;
+    }
+
+    core->run = (void (*)(void))dlsym(core->handle, "retro_run");
+    core->get_memory_data = (void *(*)(unsigned int))dlsym(core->handle, "retro_get_memory_data");
+    core->get_memory_size = (size_t (*)(unsigned int))dlsym(core->handle, "retro_get_memory_size");
+    core->serialize_size = (size_t (*)(void))dlsym(core->handle, "retro_serialize_size");
+    core->serialize = (bool (*)(void *, size_t))dlsym(core->handle, "retro_serialize");
+
+    return 0;
+}
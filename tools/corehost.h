@@ -0,0 +1,70 @@
+/*
+ * corehost.h - Minimal libretro frontend for the tools.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#ifndef VICE_COREHOST_H
+#define VICE_COREHOST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libretro.h"
+
+#define COREHOST_HASH_INIT 0xcbf29ce484222325ULL
+
+typedef struct corehost_s {
+    void *handle;
+    void (*run)(void);
+    void *(*get_memory_data)(unsigned int id);
+    size_t (*get_memory_size)(unsigned int id);
+    size_t (*serialize_size)(void);
+    bool (*serialize)(void *data, size_t size);
+} corehost_t;
+
+/* System and save directory of the core, also used for temporary files.  */
+extern const char *corehost_directory;
+
+/* Nonzero to show core log messages below errors.  */
+extern int corehost_verbose;
+
+/* Bytes per pixel of the video frames, set by the core.  */
+extern unsigned int corehost_pixel_bytes;
+
+/* Sets a core option from "key=value", options that are not set keep their
+   default values.  Returns -1 if `arg' has no value.  */
+int corehost_option(char *arg);
+
+/* Writes a playlist to autostart `image' with the given random seed, the
+   name of which is stored in `content'.  The images "@basic", "@raster",
+   "@sid", "@disk", "@fastload" and "@sidload" are built-in C64 workloads,
+   see corehost.c.  */
+int corehost_content(char *content, size_t size, const char *image, unsigned long seed);
+void corehost_content_remove(const char *content);
+
+/* Loads and initializes the core, and loads `content'.  The core cannot be
+   unloaded, so a process can only load one core once.  */
+int corehost_load(corehost_t *core, const char *path, const char *content,
+                  retro_video_refresh_t video, retro_audio_sample_batch_t audio);
+
+uint64_t corehost_hash(uint64_t hash, const void *data, size_t size);
+
+#endif
@@ -0,0 +1,382 @@
+/*
+ * cpucheck.c - Compare two builds of the core frame by frame.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/* Usage: cpucheck [-n frames] [-r runs] [-s seed] [-d dir] [-o key=value]...
+                   [-t key=value]... reference.so test.so image...
+
+   Autostarts every image with a fixed random seed in both cores and runs
+   them for the given number of frames (default 6000), hashing the clock
+   and the registers of the main CPU (from a saved state), the video frame,
+   the audio samples and the system RAM after every frame.  The first frame
+   where the cores disagree is reported and the exit status is non-zero.
+   Since the CPU clock is compared at the end of every frame, an opcode
+   taking one cycle more or less shows up in the frame it ran in.  This is
+   used to check CPU emulation variants like CPU_COMPUTED_GOTO=1 against the
+   default build over the Wolfgang Lorenz test suite, which is not part of
+   the tree and is given as disk image:
+
+     make OBJDIR=obj-ref && mv vice_x64_libretro.so ref.so
+     make OBJDIR=obj-cg CPU_COMPUTED_GOTO=1
+     make cpucheck
+     ./cpucheck -n 20000 ./ref.so ./vice_x64_libretro.so @basic @raster \
+         @sid @disk testsuite.d64
+
+   or a change to the emulation core against the build before it, with
+   `git stash' around the reference build.
+
+   Options given with -t are only set in the test core, so the same build
+   can be checked against itself with an option switched on, e.g. threaded
+   drive emulation over a fast loader:
+
+     ./cpucheck -t vice_drive_thread=enabled ./vice_x64_libretro.so \
+         ./vice_x64_libretro.so @fastload
+
+   or threaded extra SIDs mixed with the drive sound:
+
+     ./cpucheck -t vice_sid_thread=enabled -o vice_sid_extra=0xd420 \
+         -o vice_drive_sound_emulation=20% ./vice_x64_libretro.so \
+         ./vice_x64_libretro.so @sidload
+
+   The frame rates printed are measured over the frames only, without
+   loading the core, hashing and saving the states.  With -r the cores are run the given number of times
+   in turn, starting with the other core every run, and the median of the
+   frame rates and of the speed of the test core relative to the
+   reference in the same run is printed.  A single run is not enough to
+   measure changes of a few percent on a busy host.
+
+   The images "@basic", "@raster", "@sid", "@disk", "@fastload" and
+   "@sidload" are built-in C64 workloads, see corehost.c and
+   `make cpubench'.
+
+   The cores are loaded with dlopen(), so give a path containing a slash
+   for a core in the current directory.  The directory given with -d
+   (default ".") is used as system and save directory, and for the
+   playlists that pass the seed to the core.  Core options not given with
+   -o keep their default values.  */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "corehost.h"
+
+typedef struct frame_hash_s {
+    uint64_t cpu;
+    uint64_t video;
+    uint64_t audio;
+    uint64_t ram;
+} frame_hash_t;
+
+static frame_hash_t current;
+
+#define MAX_TEST_OPTIONS 16
+#define MAX_RUNS 99
+
+static char *test_options[MAX_TEST_OPTIONS];
+static unsigned int num_test_options = 0;
+
+static void core_video_refresh(const void *data, unsigned int width, unsigned int height, size_t pitch)
+{
+    unsigned int y;
+
+    if (data == NULL) {
+        return;
+    }
+    for (y = 0; y < height; y++) {
+        current.video = corehost_hash(current.video, (const uint8_t *)data + y * pitch, width * corehost_pixel_bytes);
+    }
+}
+
+static size_t core_audio_sample_batch(const int16_t *data, size_t frames)
+{
+    current.audio = corehost_hash(current.audio, data, frames * 2 * sizeof(int16_t));
+    return frames;
+}
+
+/* Returns the hash of the MAINCPU module of a snapshot, which holds the clock
+   and the registers of the main CPU, or 0 if there is none.  Modules start
+   with a 16 byte name, the major and minor version and the size of the
+   module including this header.  */
+static uint64_t cpu_hash(const uint8_t *state, size_t size)
+{
+    static const char name[16] = "MAINCPU";
+    size_t i, module_size;
+
+    for (i = 0; i + 22 <= size; i++) {
+        if (memcmp(state + i, name, sizeof(name)) == 0) {
+            module_size = state[i + 18] | (state[i + 19] << 8) | (state[i + 20] << 16) | ((size_t)state[i + 21] << 24);
+            if (module_size < 22 || module_size > size - i) {
+                break;
+            }
+            return corehost_hash(COREHOST_HASH_INIT, state + i, module_size);
+        }
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Runs the image in a child process, since the core cannot be unloaded and
+   loaded again.  The hashes of every frame are written to `fd', followed by
+   the time taken by the frames.  */
+static int run_core(const char *path, const char *content, unsigned int frames, int test, int fd)
+{
+    corehost_t core;
+    struct timespec t0, t1;
+    double seconds = 0.0;
+    uint8_t *state = NULL;
+    size_t state_size = 0, size;
+    unsigned int i;
+
+    for (i = 0; test && i < num_test_options; i++) {
+        corehost_option(test_options[i]);
+    }
+
+    if (corehost_load(&core, path, content, core_video_refresh, core_audio_sample_batch) < 0) {
+        return -1;
+    }
+
+    for (i = 0; i < frames; i++) {
+        current.video = COREHOST_HASH_INIT;
+        current.audio = COREHOST_HASH_INIT;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        core.run();
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        seconds += (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+        current.ram = corehost_hash(COREHOST_HASH_INIT, core.get_memory_data(RETRO_MEMORY_SYSTEM_RAM),
+                                    core.get_memory_size(RETRO_MEMORY_SYSTEM_RAM));
+        size = core.serialize_size();
+        if (size > state_size) {
+            free(state);
+            state = malloc(size);
+            state_size = size;
+        }
+        if (state == NULL || !core.serialize(state, size)) {
+            fprintf(stderr, "%s: cannot save state in frame %u\n", path, i);
+            return -1;
+        }
+        current.cpu = cpu_hash(state, size);
+        if (write(fd, &current, sizeof(current)) != sizeof(current)) {
+            return -1;
+        }
+    }
+    free(state);
+
+    if (write(fd, &seconds, sizeof(seconds)) != sizeof(seconds)) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Returns the number of frames run, the time taken is stored in `seconds'.  */
+static unsigned int record(const char *core, const char *content, unsigned int frames, int test,
+                           frame_hash_t *hashes, double *seconds)
+{
+    size_t size = frames * sizeof(frame_hash_t);
+    size_t got = 0;
+    ssize_t n;
+    int fds[2];
+    pid_t pid;
+
+    if (pipe(fds) < 0) {
+        perror("cpucheck: pipe");
+        return 0;
+    }
+
+    pid = fork();
+    if (pid < 0) {
+        perror("cpucheck: fork");
+        return 0;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        _exit(run_core(core, content, frames, test, fds[1]) < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    close(fds[1]);
+    while (got < size && (n = read(fds[0], (uint8_t *)hashes + got, size - got)) > 0) {
+        got += (size_t)n;
+    }
+    if (got == size && read(fds[0], seconds, sizeof(*seconds)) != sizeof(*seconds)) {
+        got = 0;
+    }
+    close(fds[0]);
+    waitpid(pid, NULL, 0);
+
+    return (unsigned int)(got / sizeof(frame_hash_t));
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static double median(double *values, unsigned int count)
+{
+    qsort(values, count, sizeof(double), compare_doubles);
+    return (count & 1) ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2.0;
+}
+
+static int check_image(const char *reference, const char *test, const char *image,
+                       unsigned int frames, unsigned int runs, unsigned long seed)
+{
+    char content[4096];
+    frame_hash_t *ref_hashes, *test_hashes;
+    unsigned int ref_frames, test_frames, run, i;
+    double ref_time, test_time;
+    double ref_fps[MAX_RUNS], test_fps[MAX_RUNS], speed[MAX_RUNS];
+    const char *what = NULL;
+    int result = 0;
+
+    if (corehost_content(content, sizeof(content), image, seed) < 0) {
+        return -1;
+    }
+
+    ref_hashes = calloc(frames, sizeof(frame_hash_t));
+    test_hashes = calloc(frames, sizeof(frame_hash_t));
+
+    printf("%s: ", image);
+    for (run = 0; run < runs && result == 0; run++) {
+        /* Alternate the order, so that a host getting slower or faster
+           during the runs does not favour one core.  */
+        if (run & 1) {
+            test_frames = record(test, content, frames, 1, test_hashes, &test_time);
+            ref_frames = record(reference, content, frames, 0, ref_hashes, &ref_time);
+        } else {
+            ref_frames = record(reference, content, frames, 0, ref_hashes, &ref_time);
+            test_frames = record(test, content, frames, 1, test_hashes, &test_time);
+        }
+
+        if (ref_frames < frames || test_frames < frames) {
+            printf("core failed after %u/%u frames\n", ref_frames, test_frames);
+            result = -1;
+            break;
+        }
+        for (i = 0; i < frames; i++) {
+            if (ref_hashes[i].cpu != test_hashes[i].cpu) {
+                what = "CPU clock or registers";
+            } else if (ref_hashes[i].ram != test_hashes[i].ram) {
+                what = "RAM";
+            } else if (ref_hashes[i].video != test_hashes[i].video) {
+                what = "video";
+            } else if (ref_hashes[i].audio != test_hashes[i].audio) {
+                what = "audio";
+            } else {
+                continue;
+            }
+            break;
+        }
+        if (what != NULL) {
+            printf("%s differs in frame %u\n", what, i);
+            result = -1;
+            break;
+        }
+
+        ref_fps[run] = frames / ref_time;
+        test_fps[run] = frames / test_time;
+        speed[run] = ref_time / test_time;
+    }
+    corehost_content_remove(content);
+
+    if (result == 0) {
+        if (runs == 1) {
+            printf("ok, %u frames, %.1f/%.1f fps\n", frames, ref_fps[0], test_fps[0]);
+        } else {
+            printf("ok, %u frames, median of %u runs %.1f/%.1f fps, test core %+.1f%%\n",
+                   frames, runs, median(ref_fps, runs), median(test_fps, runs),
+                   (median(speed, runs) - 1.0) * 100.0);
+        }
+    }
+
+    free(ref_hashes);
+    free(test_hashes);
+    return result;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: cpucheck [-n frames] [-r runs] [-s seed] [-d dir] [-o key=value]... [-t key=value]...\n"
+                    "                reference.so test.so image...\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int frames = 6000;
+    unsigned int runs = 1;
+    unsigned long seed = 12345;
+    int failed = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:s:d:o:t:v")) != -1) {
+        switch (opt) {
+            case 'n':
+                frames = (unsigned int)strtoul(optarg, NULL, 0);
+                break;
+            case 'r':
+                runs = (unsigned int)strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            case 'd':
+                corehost_directory = optarg;
+                break;
+            case 'o':
+                if (corehost_option(optarg) < 0) {
+                    usage();
+                }
+                break;
+            case 't':
+                if (num_test_options == MAX_TEST_OPTIONS || strchr(optarg, '=') == NULL) {
+                    usage();
+                }
+                test_options[num_test_options++] = optarg;
+                break;
+            case 'v':
+                corehost_verbose = 1;
+                break;
+            default:
+                usage();
+        }
+    }
+
+    if (argc - optind < 3 || frames == 0 || runs == 0 || runs > MAX_RUNS) {
+        usage();
+    }
+
+    for (opt = optind + 2; opt < argc; opt++) {
+        if (check_image(argv[optind], argv[optind + 1], argv[opt], frames, runs, seed) < 0) {
+            failed++;
+        }
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
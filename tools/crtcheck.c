@@ -0,0 +1,196 @@
+/*
+ * crtcheck.c - Compare the line kernels of the 1x1 CRT renderers.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/* Usage: crtcheck [-n rows] [-s seed]
+
+   Renders random rows with random color tables through the scalar
+   kernels of render1x1crt.c and through every vector variant the CPU
+   supports, and compares the stored pixels and the PAL delay lines byte
+   for byte.  Each source row is allocated with exactly the pixels the
+   renderer may read, so running the tool under valgrind or with
+   -fsanitize=address also checks the fetch for reads past the row.  */
+
+#include "vice.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "render1x1crt.h"
+#include "types.h"
+#include "video.h"
+
+/* Just enough of log.c for render1x1crt.c.  */
+
+int log_message(log_t log, const char *format, ...)
+{
+    return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static video_render_color_tables_t color_tab;
+
+static int32_t delay_u[VIDEO_MAX_OUTPUT_WIDTH];
+static int32_t delay_v[VIDEO_MAX_OUTPUT_WIDTH];
+static int32_t pal_delay_u[RENDER_CRT_KERNELS_MAX][VIDEO_MAX_OUTPUT_WIDTH];
+static int32_t pal_delay_v[RENDER_CRT_KERNELS_MAX][VIDEO_MAX_OUTPUT_WIDTH];
+static uint32_t pixels[RENDER_CRT_KERNELS_MAX][VIDEO_MAX_OUTPUT_WIDTH];
+
+static int random_range(int min, int max)
+{
+    return min + (int)(rand() % (max - min + 1));
+}
+
+/* Tables as video_calc_ycbcrtable() makes them, with random palettes and
+   settings in the range that keeps the gamma table indexes valid */
+static void random_tables(int pal)
+{
+    int lf = random_range(0, 64);
+    int hf = 255 - (lf << 1);
+    int sat = random_range(0, 256);
+    unsigned int i;
+
+    for (i = 0; i < 256; i++) {
+        int32_t y = random_range(0, 255) * (pal ? 256 : 128);
+        int32_t cb = random_range(-128, 127) * sat;
+        int32_t cr = random_range(-128, 127) * sat;
+
+        color_tab.ytablel[i] = y * lf;
+        color_tab.ytableh[i] = y * hf;
+        color_tab.cbtable[i] = pal ? cb : cb >> 1;
+        color_tab.crtable[i] = pal ? cr : cr >> 1;
+        color_tab.cbtable_odd[i] = random_range(-128, 127) * sat;
+        color_tab.crtable_odd[i] = random_range(-128, 127) * sat;
+    }
+
+    /* distinct values, so every index change shows in the pixels */
+    for (i = 0; i < 256 * 3; i++) {
+        color_tab.gamma_red[i] = i << 20;
+        color_tab.gamma_grn[i] = i << 10;
+        color_tab.gamma_blu[i] = i;
+    }
+    color_tab.alpha = 0;
+}
+
+/* Renders one row with every kernel, returns -1 if any differs from the
+   scalar one */
+static int check_row(const render_crt_kernels_t **kernels, unsigned int num_kernels,
+                     unsigned int row, int pal)
+{
+    render_crt_line_t *line = &render_crt_line;
+    unsigned int count = (unsigned int)random_range(0, VIDEO_MAX_OUTPUT_WIDTH / 2) * 2;
+    unsigned int avail = (unsigned int)random_range((int)count + 1, (int)count + 3);
+    int32_t off_flip = pal ? random_range(-16, 32) : 1 << 6;
+    const int32_t *cbtable = (row & 1) ? color_tab.cbtable_odd : color_tab.cbtable;
+    const int32_t *crtable = (row & 1) ? color_tab.crtable_odd : color_tab.crtable;
+    uint8_t *src = malloc(avail);
+    unsigned int i, k;
+    int result = 0;
+
+    for (i = 0; i < avail; i++) {
+        src[i] = (uint8_t)rand();
+    }
+    for (i = 0; i < count; i++) {
+        delay_u[i] = random_range(-(1 << 17), 1 << 17);
+        delay_v[i] = random_range(-(1 << 17), 1 << 17);
+    }
+
+    for (k = 0; k < num_kernels; k++) {
+        memcpy(pal_delay_u[k], delay_u, count * sizeof(int32_t));
+        memcpy(pal_delay_v[k], delay_v, count * sizeof(int32_t));
+
+        render_crt_line_fetch(line, &color_tab, cbtable, crtable, src, count, avail);
+        if (pal) {
+            kernels[k]->pal(line, pal_delay_u[k], pal_delay_v[k], off_flip, count);
+        } else {
+            kernels[k]->ntsc(line, off_flip, count);
+        }
+        render_crt_line_store(line, &color_tab, (uint8_t *)pixels[k], count, 4);
+
+        if (k == 0) {
+            continue;
+        }
+        if (memcmp(pixels[k], pixels[0], count * sizeof(uint32_t))
+            || memcmp(pal_delay_u[k], pal_delay_u[0], count * sizeof(int32_t))
+            || memcmp(pal_delay_v[k], pal_delay_v[0], count * sizeof(int32_t))) {
+            printf("%s %s differs from %s on row %u (%u pixels)\n",
+                   pal ? "PAL" : "NTSC", kernels[k]->name, kernels[0]->name, row, count);
+            result = -1;
+        }
+    }
+
+    free(src);
+    return result;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: crtcheck [-n rows] [-s seed]\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    const render_crt_kernels_t *kernels[RENDER_CRT_KERNELS_MAX];
+    unsigned int num_kernels, rows = 20000, row, failed = 0;
+    unsigned long seed = 12345;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+            case 'n':
+                rows = (unsigned int)strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                usage();
+        }
+    }
+    srand((unsigned int)seed);
+
+    num_kernels = render_crt_kernels_supported(kernels, RENDER_CRT_KERNELS_MAX);
+    printf("kernels:");
+    for (opt = 0; opt < (int)num_kernels; opt++) {
+        printf(" %s", kernels[opt]->name);
+    }
+    printf("\n");
+
+    for (row = 0; row < rows; row++) {
+        /* new tables every 64 rows, PAL and NTSC alternating */
+        if ((row & 63) == 0) {
+            random_tables((row >> 6) & 1);
+        }
+        if (check_row(kernels, num_kernels, row, ((row >> 6) & 1)) < 0) {
+            failed++;
+        }
+    }
+
+    printf("%u rows, %u differ\n", rows, failed);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
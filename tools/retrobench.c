@@ -0,0 +1,192 @@
+/*
+ * retrobench.c - Headless benchmark of the core.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/* Usage: retrobench [-n frames] [-w frames] [-s seed] [-d dir] [-o key=value]...
+                     core.so image
+
+   Autostarts the image with a fixed random seed, runs the given number of
+   warm-up frames (default 0) and then times the given number of frames
+   (default 3000), each retro_run() call on its own.  The result is
+   printed as a single line of key=value pairs for scripts:
+
+     frames=3000 fps=812.4 avg_ms=1.231 p50_ms=1.198 p90_ms=1.402
+     p99_ms=1.874 max_ms=3.105 video=0123456789abcdef audio=fedcba9876543210
+
+   `video' is a hash of the last frame and `audio' a hash of all audio
+   samples of the run, including the warm-up.  Both only depend on the
+   image, the seed and the core options, so a change in either one from
+   a build to the next means the emulation changed.  The video callback
+   does nothing but for the last frame, and hashing the audio costs a
+   few microseconds per frame.
+
+   The images "@basic", "@raster", "@sid", "@disk", "@fastload" and
+   "@sidload" are built-in C64 workloads for the CPU, the VIC-II, the SID
+   and the drive, see corehost.c.
+   The core is loaded with dlopen(), so give a path containing a slash for
+   a core in the current directory.  The directory given with -d (default
+   ".") is used as system and save directory, and for the playlist that
+   passes the seed to the core.  Core options not given with -o keep their
+   default values.  */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "corehost.h"
+
+static int last_frame = 0;
+static uint64_t video_hash = COREHOST_HASH_INIT;
+static uint64_t audio_hash = COREHOST_HASH_INIT;
+
+static void core_video_refresh(const void *data, unsigned int width, unsigned int height, size_t pitch)
+{
+    unsigned int y;
+
+    if (!last_frame || data == NULL) {
+        return;
+    }
+    video_hash = COREHOST_HASH_INIT;
+    for (y = 0; y < height; y++) {
+        video_hash = corehost_hash(video_hash, (const uint8_t *)data + y * pitch, width * corehost_pixel_bytes);
+    }
+}
+
+static size_t core_audio_sample_batch(const int16_t *data, size_t frames)
+{
+    audio_hash = corehost_hash(audio_hash, data, frames * 2 * sizeof(int16_t));
+    return frames;
+}
+
+static double elapsed_ms(const struct timespec *t0, const struct timespec *t1)
+{
+    return (double)(t1->tv_sec - t0->tv_sec) * 1e3 + (double)(t1->tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+static int compare_times(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of the sorted times.  */
+static double percentile(const double *times, unsigned int count, unsigned int p)
+{
+    unsigned int rank = (count * p + 99) / 100;
+
+    return times[rank > 0 ? rank - 1 : 0];
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: retrobench [-n frames] [-w frames] [-s seed] [-d dir] [-o key=value]... core.so image\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int frames = 3000;
+    unsigned int warmup = 0;
+    unsigned long seed = 12345;
+    char content[4096];
+    struct timespec t0, t1;
+    corehost_t core;
+    double *times;
+    double total = 0.0;
+    unsigned int i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:w:s:d:o:v")) != -1) {
+        switch (opt) {
+            case 'n':
+                frames = (unsigned int)strtoul(optarg, NULL, 0);
+                break;
+            case 'w':
+                warmup = (unsigned int)strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            case 'd':
+                corehost_directory = optarg;
+                break;
+            case 'o':
+                if (corehost_option(optarg) < 0) {
+                    usage();
+                }
+                break;
+            case 'v':
+                corehost_verbose = 1;
+                break;
+            default:
+                usage();
+        }
+    }
+
+    if (argc - optind != 2 || frames == 0) {
+        usage();
+    }
+
+    if (corehost_content(content, sizeof(content), argv[optind + 1], seed) < 0) {
+        return EXIT_FAILURE;
+    }
+    if (corehost_load(&core, argv[optind], content, core_video_refresh, core_audio_sample_batch) < 0) {
+        corehost_content_remove(content);
+        return EXIT_FAILURE;
+    }
+    /* The playlist is read when the game is loaded, the image is autostarted
+       later.  */
+    for (i = 0; i < warmup; i++) {
+        core.run();
+    }
+
+    times = malloc(frames * sizeof(double));
+    if (times == NULL) {
+        corehost_content_remove(content);
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < frames; i++) {
+        last_frame = (i == frames - 1);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        core.run();
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        times[i] = elapsed_ms(&t0, &t1);
+        total += times[i];
+    }
+    corehost_content_remove(content);
+
+    qsort(times, frames, sizeof(double), compare_times);
+
+    printf("frames=%u fps=%.1f avg_ms=%.3f p50_ms=%.3f p90_ms=%.3f p99_ms=%.3f max_ms=%.3f video=%016llx audio=%016llx\n",
+           frames, frames * 1e3 / total, total / frames,
+           percentile(times, frames, 50), percentile(times, frames, 90),
+           percentile(times, frames, 99), times[frames - 1],
+           (unsigned long long)video_hash, (unsigned long long)audio_hash);
+
+    free(times);
+    return EXIT_SUCCESS;
+}
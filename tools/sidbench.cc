@@ -0,0 +1,330 @@
+/*
+ * sidbench.cc - SID engine rendering benchmark.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/* Usage: sidbench [-e resid|residfp] [-m 6581|8580] [-s method] [-r rate]
+                   [-t seconds] [trace]
+
+   Clocks a trace of SID register writes through SID::clock() of reSID or
+   reSIDfp and prints a single line of key=value pairs for scripts:
+
+     engine=resid method=resample samples=441000 ns_per_sample=812.3
+     cycles_per_sample=2436.9 realtime=27.9 hash=0123456789abcdef
+
+   `cycles_per_sample' counts time stamp counter ticks and is only given
+   on x86, `realtime' is the emulation speed relative to a real C64 and
+   `hash' is a hash of all output samples, which only depends on the trace
+   and the options.  The methods of reSID are fast, interpolate, resample
+   (the default) and fastmem, those of reSIDfp are decimate and resample.
+
+   The trace is a text file written by the "dump" sound device, with one
+   write per line: the cycles since the previous write, the register and
+   the value.  Writes to other SID chips than the first are ignored.
+   Without a trace, a built-in tune of three voices with a filter sweep
+   is played.  The trace is repeated until the given number of seconds
+   (default 10) of C64 time have been rendered.
+
+   The FIR kernels of the engines are selected at startup from the CPU
+   features.  To compare them to the plain loops, build the benchmark
+   again with `make sidbench SIDBENCH_FLAGS=-DRESID_NO_SIMD': the hashes
+   must be the same.  */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define SIDBENCH_TSC 1
+#endif
+
+#include "resid/sid.h"
+#include "residfp/builders/residfp-builder/residfp/SID.h"
+
+#define CLOCK_FREQUENCY 985248
+
+/* Cycles of a PAL frame, the built-in tune is updated once per frame.  */
+#define FRAME_CYCLES 19656
+
+/* SID::clock() of reSIDfp ignores calls for 100 cycles or more.  */
+#define RESIDFP_CHUNK 64
+
+typedef struct sid_write_s {
+    unsigned int delta;
+    uint8_t reg;
+    uint8_t value;
+} sid_write_t;
+
+static sid_write_t *trace = NULL;
+static unsigned int trace_size = 0;
+static unsigned int trace_alloc = 0;
+
+static void trace_add(unsigned int delta, unsigned int reg, unsigned int value)
+{
+    if (trace_size == trace_alloc) {
+        trace_alloc = trace_alloc ? trace_alloc * 2 : 1024;
+        trace = (sid_write_t *)realloc(trace, trace_alloc * sizeof(sid_write_t));
+        if (trace == NULL) {
+            fprintf(stderr, "sidbench: out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    trace[trace_size].delta = delta;
+    trace[trace_size].reg = (uint8_t)reg;
+    trace[trace_size].value = (uint8_t)value;
+    trace_size++;
+}
+
+static int trace_load(const char *name)
+{
+    FILE *fd;
+    unsigned int delta, reg, value;
+    unsigned int skipped = 0;
+
+    fd = fopen(name, "r");
+    if (fd == NULL) {
+        perror(name);
+        return -1;
+    }
+    while (fscanf(fd, "%u %u %u", &delta, &reg, &value) == 3) {
+        if (reg >= 0x20) {
+            /* Keep the time of the writes to the other chips.  */
+            skipped += delta;
+            continue;
+        }
+        trace_add(skipped + delta, reg, value);
+        skipped = 0;
+    }
+    fclose(fd);
+    if (trace_size == 0) {
+        fprintf(stderr, "%s: no SID writes\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+/* Three voices of pulse, sawtooth and triangle waves playing arpeggios,
+   the pulse widths and the cutoff of the low pass filter are swept.  */
+static void trace_builtin(void)
+{
+    static const unsigned int notes[8] = {
+        0x1125, 0x159a, 0x19b1, 0x2249, 0x1125, 0x1469, 0x19b1, 0x1b5a
+    };
+    static const uint8_t waves[3] = { 0x40, 0x20, 0x10 };
+    unsigned int frame, voice, delta;
+
+    trace_add(0, 0x18, 0x1f);
+    trace_add(8, 0x17, 0xf3);
+    for (voice = 0; voice < 3; voice++) {
+        trace_add(8, voice * 7 + 5, 0x09);
+        trace_add(8, voice * 7 + 6, 0x8a);
+    }
+    for (frame = 0; frame < 256; frame++) {
+        delta = FRAME_CYCLES - 16 * 8 * 3;
+        for (voice = 0; voice < 3; voice++) {
+            unsigned int note = notes[(frame / 2 + voice * 3) & 7] >> (voice == 2 ? 1 : 0);
+            unsigned int pulse = (frame * 24 + voice * 1024) & 0xfff;
+            unsigned int gate = (frame & 7) != 7;
+
+            trace_add(delta, voice * 7 + 0, note & 0xff);
+            trace_add(8, voice * 7 + 1, note >> 8);
+            trace_add(8, voice * 7 + 2, pulse & 0xff);
+            trace_add(8, voice * 7 + 3, pulse >> 8);
+            trace_add(8, voice * 7 + 4, waves[voice] | gate);
+            delta = 8;
+        }
+        trace_add(8, 0x15, frame & 7);
+        trace_add(8, 0x16, (frame * 3) & 0xff);
+    }
+}
+
+static uint64_t hash_samples(uint64_t hash, const short *buf, int n)
+{
+    const uint8_t *p = (const uint8_t *)buf;
+    size_t i;
+
+    for (i = 0; i < n * sizeof(short); i++) {
+        hash = (hash ^ p[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: sidbench [-e resid|residfp] [-m 6581|8580] [-s method] [-r rate] [-t seconds] [trace]\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    const char *engine = "resid";
+    const char *method = "resample";
+    int model = 6581;
+    int rate = 44100;
+    unsigned int seconds = 10;
+    reSID::SID *resid = NULL;
+    reSIDfp::SID *residfp = NULL;
+    short buf[4096];
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    uint64_t samples = 0;
+    uint64_t cycles, left;
+    struct timespec t0, t1;
+    double ns;
+#ifdef SIDBENCH_TSC
+    uint64_t tsc;
+#endif
+    unsigned int i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "e:m:s:r:t:")) != -1) {
+        switch (opt) {
+            case 'e':
+                engine = optarg;
+                break;
+            case 'm':
+                model = atoi(optarg);
+                break;
+            case 's':
+                method = optarg;
+                break;
+            case 'r':
+                rate = atoi(optarg);
+                break;
+            case 't':
+                seconds = (unsigned int)strtoul(optarg, NULL, 0);
+                break;
+            default:
+                usage();
+        }
+    }
+    if (argc - optind > 1 || seconds == 0 || rate <= 0 || (model != 6581 && model != 8580)) {
+        usage();
+    }
+    if (argc - optind == 1) {
+        if (trace_load(argv[optind]) < 0) {
+            return EXIT_FAILURE;
+        }
+    } else {
+        trace_builtin();
+    }
+
+    if (strcmp(engine, "resid") == 0) {
+        reSID::sampling_method sampling;
+
+        if (strcmp(method, "fast") == 0) {
+            sampling = reSID::SAMPLE_FAST;
+        } else if (strcmp(method, "interpolate") == 0) {
+            sampling = reSID::SAMPLE_INTERPOLATE;
+        } else if (strcmp(method, "resample") == 0) {
+            sampling = reSID::SAMPLE_RESAMPLE;
+        } else if (strcmp(method, "fastmem") == 0) {
+            sampling = reSID::SAMPLE_RESAMPLE_FASTMEM;
+        } else {
+            usage();
+        }
+        resid = new reSID::SID();
+        resid->set_chip_model(model == 8580 ? reSID::MOS8580 : reSID::MOS6581);
+        /* The defaults of the SidResidPassband and SidResidGain resources.  */
+        if (!resid->set_sampling_parameters(CLOCK_FREQUENCY, sampling, rate, rate * 90 / 200.0, 0.97)) {
+            fprintf(stderr, "sidbench: sampling rate %d out of spec\n", rate);
+            return EXIT_FAILURE;
+        }
+    } else if (strcmp(engine, "residfp") == 0) {
+        reSIDfp::SamplingMethod sampling;
+        int half_freq;
+
+        if (strcmp(method, "decimate") == 0) {
+            sampling = reSIDfp::DECIMATE;
+        } else if (strcmp(method, "resample") == 0) {
+            sampling = reSIDfp::RESAMPLE;
+        } else {
+            usage();
+        }
+        residfp = new reSIDfp::SID();
+        residfp->setChipModel(model == 8580 ? reSIDfp::MOS8580 : reSIDfp::MOS6581);
+        /* The same highest accurate frequency as sid/resid-fp.cc.  */
+        half_freq = 5000 * ((rate + 5000) / 10000);
+        try {
+            residfp->setSamplingParameters(CLOCK_FREQUENCY, sampling, rate, half_freq < 20000 ? half_freq : 20000);
+        } catch (const reSIDfp::SIDError &e) {
+            fprintf(stderr, "sidbench: sampling rate %d out of spec\n", rate);
+            return EXIT_FAILURE;
+        }
+    } else {
+        usage();
+    }
+
+    cycles = (uint64_t)seconds * CLOCK_FREQUENCY;
+    left = cycles;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+#ifdef SIDBENCH_TSC
+    tsc = __rdtsc();
+#endif
+    for (i = 0; left > 0; i = (i + 1) % trace_size) {
+        int delta = trace[i].delta < left ? (int)trace[i].delta : (int)left;
+        int n;
+
+        left -= delta;
+        if (resid != NULL) {
+            while (delta > 0) {
+                n = resid->clock(delta, buf, sizeof(buf) / sizeof(buf[0]));
+                hash = hash_samples(hash, buf, n);
+                samples += n;
+            }
+            resid->write(trace[i].reg, trace[i].value);
+        } else {
+            while (delta > 0) {
+                int chunk = delta < RESIDFP_CHUNK ? delta : RESIDFP_CHUNK;
+
+                n = residfp->clock(chunk, buf, sizeof(buf) / sizeof(buf[0]), 1);
+                hash = hash_samples(hash, buf, n);
+                samples += n;
+                delta -= chunk;
+            }
+            residfp->write(trace[i].reg, trace[i].value);
+        }
+    }
+#ifdef SIDBENCH_TSC
+    tsc = __rdtsc() - tsc;
+#endif
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns = (double)(t1.tv_sec - t0.tv_sec) * 1e9 + (double)(t1.tv_nsec - t0.tv_nsec);
+
+    if (samples == 0) {
+        fprintf(stderr, "sidbench: no samples\n");
+        return EXIT_FAILURE;
+    }
+    printf("engine=%s method=%s samples=%llu ns_per_sample=%.1f", engine, method,
+           (unsigned long long)samples, ns / samples);
+#ifdef SIDBENCH_TSC
+    printf(" cycles_per_sample=%.1f", (double)tsc / samples);
+#endif
+    printf(" realtime=%.1f hash=%016llx\n", seconds * 1e9 / ns, (unsigned long long)hash);
+
+    delete resid;
+    delete residfp;
+    free(trace);
+    return EXIT_SUCCESS;
+}
@@ -54,6 +54,10 @@ void alarm_context_init(alarm_context_t *context, const char *name)
 
     context->num_pending_alarms = 0;
     context->next_pending_alarm_clk = CLOCK_MAX;
+    context->heap_active = 0;
+#ifdef ALARM_TRACE
+    context->trace_id = 0;
+#endif
 }
 
 void alarm_context_destroy(alarm_context_t *context)
@@ -98,6 +102,131 @@ void alarm_context_time_warp(alarm_context_t *context, CLOCK warp_amount,
     } else {
         context->next_pending_alarm_clk -= warp_amount;
     }
+
+    /* Clocks that wrap around would be out of order */
+    if (context->heap_active) {
+        alarm_context_heap_build(context);
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Pending alarm heap.  The heap holds indexes into the pending alarm array.
+   An alarm comes first if it is due earlier, or on the same clock if it has
+   the higher index, which is the alarm the linear scan picks.  */
+
+inline static int alarm_context_heap_before(alarm_context_t *context, unsigned int a, unsigned int b)
+{
+    CLOCK clk_a = context->pending_alarms[a].clk;
+    CLOCK clk_b = context->pending_alarms[b].clk;
+
+    return clk_a < clk_b || (clk_a == clk_b && a > b);
+}
+
+static void alarm_context_heap_place(alarm_context_t *context, unsigned int pos, unsigned int idx)
+{
+    context->heap[pos] = (uint16_t)idx;
+    context->heap_pos[idx] = (uint16_t)pos;
+}
+
+static void alarm_context_heap_sift_up(alarm_context_t *context, unsigned int pos)
+{
+    unsigned int idx = context->heap[pos];
+
+    while (pos > 0) {
+        unsigned int parent = (pos - 1) >> 1;
+
+        if (!alarm_context_heap_before(context, idx, context->heap[parent])) {
+            break;
+        }
+        alarm_context_heap_place(context, pos, context->heap[parent]);
+        pos = parent;
+    }
+    alarm_context_heap_place(context, pos, idx);
+}
+
+static void alarm_context_heap_sift_down(alarm_context_t *context, unsigned int pos, unsigned int size)
+{
+    unsigned int idx = context->heap[pos];
+
+    for (;;) {
+        unsigned int child = (pos << 1) + 1;
+
+        if (child >= size) {
+            break;
+        }
+        if (child + 1 < size
+            && alarm_context_heap_before(context, context->heap[child + 1], context->heap[child])) {
+            child++;
+        }
+        if (!alarm_context_heap_before(context, context->heap[child], idx)) {
+            break;
+        }
+        alarm_context_heap_place(context, pos, context->heap[child]);
+        pos = child;
+    }
+    alarm_context_heap_place(context, pos, idx);
+}
+
+/* Builds the heap from all pending alarms and starts keeping it.  */
+void alarm_context_heap_build(alarm_context_t *context)
+{
+    unsigned int size = context->num_pending_alarms;
+    unsigned int i;
+
+    for (i = 0; i < size; i++) {
+        alarm_context_heap_place(context, i, i);
+    }
+    for (i = size >> 1; i-- > 0;) {
+        alarm_context_heap_sift_down(context, i, size);
+    }
+    context->heap_active = 1;
+}
+
+/* Adds the alarm just appended to the pending alarm array.  */
+void alarm_context_heap_insert(alarm_context_t *context, unsigned int idx)
+{
+    alarm_context_heap_place(context, context->num_pending_alarms - 1, idx);
+    alarm_context_heap_sift_up(context, context->num_pending_alarms - 1);
+}
+
+/* Moves a pending alarm after its clock has changed.  */
+void alarm_context_heap_update(alarm_context_t *context, unsigned int idx)
+{
+    unsigned int pos = context->heap_pos[idx];
+
+    if (pos > 0 && alarm_context_heap_before(context, idx, context->heap[(pos - 1) >> 1])) {
+        alarm_context_heap_sift_up(context, pos);
+    } else {
+        alarm_context_heap_sift_down(context, pos, context->num_pending_alarms);
+    }
+}
+
+/* Takes an alarm out of the heap, before num_pending_alarms is lowered.  */
+static void alarm_context_heap_remove(alarm_context_t *context, unsigned int idx)
+{
+    unsigned int size = context->num_pending_alarms - 1;
+    unsigned int pos = context->heap_pos[idx];
+
+    if (pos == size) {
+        return;
+    }
+    alarm_context_heap_place(context, pos, context->heap[size]);
+    if (pos > 0 && alarm_context_heap_before(context, context->heap[pos], context->heap[(pos - 1) >> 1])) {
+        alarm_context_heap_sift_up(context, pos);
+    } else {
+        alarm_context_heap_sift_down(context, pos, size);
+    }
+}
+
+/* The last pending alarm has moved to index `idx' of the array.  With the
+   lower index it can only come later among alarms on the same clock.  */
+static void alarm_context_heap_move(alarm_context_t *context, unsigned int last, unsigned int idx)
+{
+    unsigned int pos = context->heap_pos[last];
+
+    alarm_context_heap_place(context, pos, idx);
+    alarm_context_heap_sift_down(context, pos, context->num_pending_alarms);
 }
 
 /* ------------------------------------------------------------------------ */
@@ -111,6 +240,9 @@ static void alarm_init(alarm_t *alarm, alarm_context_t *context,
     alarm->data = data;
 
     alarm->pending_idx = -1;      /* Not pending.  */
+#ifdef ALARM_TRACE
+    alarm->trace_id = 0;
+#endif
 
     /* Add to the head of the alarm list of the alarm context.  */
     if (context->alarms == NULL) {
@@ -174,11 +306,19 @@ void alarm_unset(alarm_t *alarm)
     if (idx < 0) {
         return;                 /* Not pending.  */
     }
+#ifdef ALARM_TRACE
+    alarm_trace_unset(alarm);
+#endif
+
     context = alarm->context;
 
     if (context->num_pending_alarms > 1) {
         int last;
 
+        if (context->heap_active) {
+            alarm_context_heap_remove(context, (unsigned int)idx);
+        }
+
         last = --context->num_pending_alarms;
 
         if (last != idx) {
@@ -190,6 +330,17 @@ void alarm_unset(alarm_t *alarm)
                 = context->pending_alarms[last].clk;
 
             context->pending_alarms[idx].alarm->pending_idx = idx;
+
+            if (context->heap_active) {
+                alarm_context_heap_move(context, (unsigned int)last, (unsigned int)idx);
+            }
+        }
+
+        /* Back to the scan when few alarms are left, half the threshold
+           keeps a context from switching on every set and unset */
+        if (context->heap_active
+            && context->num_pending_alarms < ALARM_CONTEXT_HEAP_MIN / 2) {
+            context->heap_active = 0;
         }
 
         if (context->next_pending_alarm_idx == idx) {
@@ -201,6 +352,7 @@ void alarm_unset(alarm_t *alarm)
         context->num_pending_alarms = 0;
         context->next_pending_alarm_clk = CLOCK_MAX;
         context->next_pending_alarm_idx = -1;
+        context->heap_active = 0;
     }
 
     alarm->pending_idx = -1;
@@ -210,3 +362,81 @@ void alarm_log_too_many_alarms(void)
 {
     log_error(LOG_DEFAULT, "alarm_set(): Too many alarms set!");
 }
+
+/* ------------------------------------------------------------------------ */
+
+#ifdef ALARM_TRACE
+
+/* Alarm activity is written as text to the file named by the environment
+   variable VICE_ALARM_TRACE (default "alarm.trace"), one operation per
+   line, for replaying it with tools/alarmbench:
+
+   c <context> <name>           new alarm context
+   a <alarm> <context> <name>   new alarm
+   s <alarm> <clk>              alarm_set()
+   u <alarm>                    alarm_unset() of a pending alarm
+   d <context> <clk>            alarm_context_dispatch()  */
+
+static FILE *alarm_trace_file = NULL;
+static unsigned int alarm_trace_contexts = 0;
+static unsigned int alarm_trace_alarms = 0;
+
+static int alarm_trace_open(void)
+{
+    const char *name;
+
+    if (alarm_trace_file == NULL) {
+        name = getenv("VICE_ALARM_TRACE");
+        alarm_trace_file = fopen(name != NULL ? name : "alarm.trace", "w");
+        if (alarm_trace_file == NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static unsigned int alarm_trace_context_id(alarm_context_t *context)
+{
+    if (context->trace_id == 0) {
+        context->trace_id = ++alarm_trace_contexts;
+        fprintf(alarm_trace_file, "c %u %s\n", context->trace_id, context->name);
+    }
+    return context->trace_id;
+}
+
+static unsigned int alarm_trace_alarm_id(alarm_t *alarm)
+{
+    if (alarm->trace_id == 0) {
+        unsigned int context_id = alarm_trace_context_id(alarm->context);
+
+        alarm->trace_id = ++alarm_trace_alarms;
+        fprintf(alarm_trace_file, "a %u %u %s\n", alarm->trace_id, context_id, alarm->name);
+    }
+    return alarm->trace_id;
+}
+
+void alarm_trace_set(alarm_t *alarm, CLOCK cpu_clk)
+{
+    if (alarm_trace_open() < 0) {
+        return;
+    }
+    fprintf(alarm_trace_file, "s %u %" PRIu64 "\n", alarm_trace_alarm_id(alarm), (uint64_t)cpu_clk);
+}
+
+void alarm_trace_unset(alarm_t *alarm)
+{
+    if (alarm_trace_open() < 0) {
+        return;
+    }
+    fprintf(alarm_trace_file, "u %u\n", alarm_trace_alarm_id(alarm));
+}
+
+void alarm_trace_dispatch(alarm_context_t *context, CLOCK cpu_clk)
+{
+    if (alarm_trace_open() < 0) {
+        return;
+    }
+    fprintf(alarm_trace_file, "d %u %" PRIu64 "\n", alarm_trace_context_id(context), (uint64_t)cpu_clk);
+}
+
+#endif
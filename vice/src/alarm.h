@@ -32,6 +32,10 @@
 
 #define ALARM_CONTEXT_MAX_PENDING_ALARMS 0x100
 
+/* Contexts with at least this many pending alarms find the next one through
+   a heap instead of scanning them all.  */
+#define ALARM_CONTEXT_HEAP_MIN 16
+
 typedef void (*alarm_callback_t)(CLOCK offset, void *data);
 
 /* An alarm.  */
@@ -54,6 +58,11 @@ struct alarm_s {
 
     /* Link to the next and previous alarms in the list.  */
     struct alarm_s *next, *prev;
+
+#ifdef ALARM_TRACE
+    /* Number of the alarm in the trace, 0 if not recorded yet.  */
+    unsigned int trace_id;
+#endif
 };
 typedef struct alarm_s alarm_t;
 
@@ -84,6 +93,21 @@ struct alarm_context_s {
 
     /* Pending alarm number.  */
     int next_pending_alarm_idx;
+
+    /* Binary min-heap of indexes into the pending alarm array, ordered by
+       clock and, on the same clock, by descending index.  Its top is the
+       alarm the linear scan would find.  Only kept up to date while
+       `heap_active' is set, i.e. while many alarms are pending.  */
+    int heap_active;
+    uint16_t heap[ALARM_CONTEXT_MAX_PENDING_ALARMS];
+
+    /* Position in the heap of each pending alarm.  */
+    uint16_t heap_pos[ALARM_CONTEXT_MAX_PENDING_ALARMS];
+
+#ifdef ALARM_TRACE
+    /* Number of the context in the trace, 0 if not recorded yet.  */
+    unsigned int trace_id;
+#endif
 };
 typedef struct alarm_context_s alarm_context_t;
 
@@ -98,6 +122,17 @@ void alarm_destroy(alarm_t *alarm);
 void alarm_unset(alarm_t *alarm);
 void alarm_log_too_many_alarms(void);
 
+void alarm_context_heap_build(alarm_context_t *context);
+void alarm_context_heap_insert(alarm_context_t *context, unsigned int idx);
+void alarm_context_heap_update(alarm_context_t *context, unsigned int idx);
+
+#ifdef ALARM_TRACE
+/* Recording of alarm activity, for replaying it in tools/alarmbench */
+void alarm_trace_set(alarm_t *alarm, CLOCK cpu_clk);
+void alarm_trace_unset(alarm_t *alarm);
+void alarm_trace_dispatch(alarm_context_t *context, CLOCK cpu_clk);
+#endif
+
 /* ------------------------------------------------------------------------- */
 
 /* Inline functions.  */
@@ -115,6 +150,16 @@ inline static void alarm_context_update_next_pending(alarm_context_t *context)
 
     next_pending_alarm_idx = context->next_pending_alarm_idx;
 
+    if (context->heap_active) {
+        if (context->num_pending_alarms > 0) {
+            next_pending_alarm_idx = context->heap[0];
+            next_pending_alarm_clk = context->pending_alarms[next_pending_alarm_idx].clk;
+        }
+        context->next_pending_alarm_clk = next_pending_alarm_clk;
+        context->next_pending_alarm_idx = next_pending_alarm_idx;
+        return;
+    }
+
     for (i = 0; i < context->num_pending_alarms; i++) {
         CLOCK pending_clk = context->pending_alarms[i].clk;
 
@@ -135,6 +180,10 @@ inline static void alarm_context_dispatch(alarm_context_t *context,
     int idx;
     alarm_t *alarm;
 
+#ifdef ALARM_TRACE
+    alarm_trace_dispatch(context, cpu_clk);
+#endif
+
     offset = cpu_clk - context->next_pending_alarm_clk;
 
     idx = context->next_pending_alarm_idx;
@@ -148,6 +197,10 @@ inline static void alarm_set(alarm_t *alarm, CLOCK cpu_clk)
     alarm_context_t *context;
     int idx;
 
+#ifdef ALARM_TRACE
+    alarm_trace_set(alarm, cpu_clk);
+#endif
+
     context = alarm->context;
     idx = alarm->pending_idx;
 
@@ -167,6 +220,12 @@ inline static void alarm_set(alarm_t *alarm, CLOCK cpu_clk)
 
         context->num_pending_alarms++;
 
+        if (context->heap_active) {
+            alarm_context_heap_insert(context, (unsigned int)new_idx);
+        } else if (context->num_pending_alarms >= ALARM_CONTEXT_HEAP_MIN) {
+            alarm_context_heap_build(context);
+        }
+
         if (cpu_clk < context->next_pending_alarm_clk) {
             context->next_pending_alarm_clk = cpu_clk;
             context->next_pending_alarm_idx = new_idx;
@@ -177,6 +236,9 @@ inline static void alarm_set(alarm_t *alarm, CLOCK cpu_clk)
         /* Already pending: modify.  */
 
         context->pending_alarms[idx].clk = cpu_clk;
+        if (context->heap_active) {
+            alarm_context_heap_update(context, (unsigned int)idx);
+        }
         if (context->next_pending_alarm_clk > cpu_clk
             || idx == context->next_pending_alarm_idx) {
             alarm_context_update_next_pending(context);
@@ -25,6 +25,7 @@
 
 #include "vice.h"
 
+#include "c64mem.h"
 #include "maincpu.h"
 #include "mem.h"
 
@@ -131,6 +132,81 @@ static uint8_t memmap_mem_read_dummy(unsigned int addr)
 }
 #endif
 
+#if defined(__LIBRETRO__) && !defined(FEATURE_CPUMEMHISTORY)
+/* Set by every access that does not go to plain memory, or to the CPU port.
+   Those may set alarms or trigger interrupts, so 6510core.c stops running
+   instructions back to back after them.  */
+static int c64cpu_io_access = 0;
+
+/* Plain RAM and ROM pages are accessed directly, everything else goes
+   through the read and write tables.  */
+inline static uint8_t c64cpu_load(unsigned int addr)
+{
+    uint8_t *base = _mem_read_plain_tab_ptr[addr >> 8];
+
+    if (base != NULL) {
+        return base[addr];
+    }
+    c64cpu_io_access = 1;
+    return (*_mem_read_tab_ptr[addr >> 8])((uint16_t)addr);
+}
+
+inline static void c64cpu_store(unsigned int addr, uint8_t value)
+{
+    uint8_t *base = _mem_write_plain_tab_ptr[addr >> 8];
+
+    if (base != NULL) {
+        base[addr] = value;
+    } else {
+        c64cpu_io_access = 1;
+        (*_mem_write_tab_ptr[addr >> 8])((uint16_t)addr, value);
+    }
+}
+
+inline static uint8_t c64cpu_load_dummy(unsigned int addr)
+{
+    if (_mem_read_plain_tab_ptr[addr >> 8] == NULL) {
+        c64cpu_io_access = 1;
+    }
+    return (*_mem_read_tab_ptr_dummy[addr >> 8])((uint16_t)addr);
+}
+
+inline static void c64cpu_store_dummy(unsigned int addr, uint8_t value)
+{
+    if (_mem_write_plain_tab_ptr[addr >> 8] == NULL) {
+        c64cpu_io_access = 1;
+    }
+    (*_mem_write_tab_ptr_dummy[addr >> 8])((uint16_t)addr, value);
+}
+
+inline static void c64cpu_store_zero(unsigned int addr, uint8_t value)
+{
+    if ((addr & 0xff) < 2) {
+        c64cpu_io_access = 1;
+    }
+    (*_mem_write_tab_ptr[0])((uint16_t)addr, value);
+}
+
+inline static void c64cpu_store_zero_dummy(unsigned int addr, uint8_t value)
+{
+    if ((addr & 0xff) < 2) {
+        c64cpu_io_access = 1;
+    }
+    (*_mem_write_tab_ptr_dummy[0])((uint16_t)addr, value);
+}
+
+#define LOAD(addr) c64cpu_load((unsigned int)(addr))
+#define STORE(addr, value) c64cpu_store((unsigned int)(addr), (uint8_t)(value))
+#define LOAD_DUMMY(addr) c64cpu_load_dummy((unsigned int)(addr))
+#define STORE_DUMMY(addr, value) c64cpu_store_dummy((unsigned int)(addr), (uint8_t)(value))
+#define STORE_ZERO(addr, value) c64cpu_store_zero((unsigned int)(addr), (uint8_t)(value))
+#define STORE_ZERO_DUMMY(addr, value) c64cpu_store_zero_dummy((unsigned int)(addr), (uint8_t)(value))
+
+#if !defined(DEBUG) && !defined(NO_CPU_BATCH)
+#define CPU_BATCH_IO c64cpu_io_access
+#endif
+#endif
+
 static void check_and_run_alternate_cpu(void)
 {
     cpmcart_check_and_run_z80();
@@ -112,6 +112,18 @@ static uint32_t mem_read_limit_tab[NUM_CONFIGS][0x101];
 static store_func_ptr_t mem_write_tab_watch[0x101];
 static read_func_ptr_t mem_read_tab_watch[0x101];
 
+#ifdef __LIBRETRO__
+/* Pointers to the currently used plain memory tables.  */
+uint8_t **_mem_read_plain_tab_ptr;
+uint8_t **_mem_write_plain_tab_ptr;
+
+/* Base pointers for the pages that are plain RAM or ROM, NULL for all other
+   pages, see mem_plain_tab_init().  */
+static uint8_t *mem_read_plain_tab[NUM_CONFIGS][0x101];
+static uint8_t *mem_write_plain_tab[NUM_VBANKS][NUM_CONFIGS][0x101];
+static uint8_t *mem_plain_tab_none[0x101];
+#endif
+
 /* Current video bank (0, 1, 2 or 3).  */
 static int vbank;
 
@@ -180,6 +192,16 @@ static void mem_update_tab_ptrs(int flag)
         _mem_read_tab_ptr_dummy = mem_read_tab[mem_config];
         _mem_write_tab_ptr_dummy = mem_write_tab[vbank][mem_config];
     }
+#ifdef __LIBRETRO__
+    /* Watchpoints need every access to go through the functions.  */
+    if (flag) {
+        _mem_read_plain_tab_ptr = mem_plain_tab_none;
+        _mem_write_plain_tab_ptr = mem_plain_tab_none;
+    } else {
+        _mem_read_plain_tab_ptr = mem_read_plain_tab[mem_config];
+        _mem_write_plain_tab_ptr = mem_write_plain_tab[vbank][mem_config];
+    }
+#endif
 }
 
 void mem_toggle_watchpoints(int flag, void *context)
@@ -816,6 +838,53 @@ void mem_read_limit_set(unsigned int base, unsigned int index, uint32_t limit)
     mem_read_limit_tab[base][index] = limit;
 }
 
+#ifdef __LIBRETRO__
+/* Returns the base pointer of `page' for a ROM image of `mask' + 1 bytes that
+   is mirrored through the page.  */
+static uint8_t *mem_plain_rom_base(uint8_t *rom, unsigned int mask, int page)
+{
+    return (uint8_t *)((uintptr_t)rom - (((unsigned int)page << 8) & ~mask));
+}
+
+/* Fill the plain memory tables from the read and write tables.  A page is
+   plain only if its function is one of the functions below that do nothing
+   but access the RAM or a ROM image, so that the CPU can do the access
+   inline with the same result.  Zero page, I/O, cartridges and memory
+   expansions hook other functions and keep going through the tables.  */
+static void mem_plain_tab_init(void)
+{
+    int i, j, k;
+
+    for (i = 0; i < NUM_CONFIGS; i++) {
+        for (j = 0; j <= 0x100; j++) {
+            read_func_ptr_t read_func = mem_read_tab[i][j];
+            uint8_t *base = NULL;
+
+            if (j == 0 || j == 0x100) {
+                /* zero page, $00/$01 is the CPU port */
+            } else if (read_func == ram_read) {
+                base = mem_ram;
+            } else if (read_func == c64memrom_basic64_read) {
+                base = mem_plain_rom_base(c64memrom_basic64_rom, C64_BASIC_ROM_SIZE - 1, j);
+            } else if (read_func == c64memrom_kernal64_read) {
+                base = mem_plain_rom_base(c64memrom_kernal64_rom, C64_KERNAL_ROM_SIZE - 1, j);
+            } else if (read_func == chargen_read) {
+                base = mem_plain_rom_base(mem_chargen_rom, C64_CHARGEN_ROM_SIZE - 1, j);
+            }
+            mem_read_plain_tab[i][j] = base;
+
+            for (k = 0; k < NUM_VBANKS; k++) {
+                if (j != 0 && j != 0x100 && mem_write_tab[k][i][j] == ram_store) {
+                    mem_write_plain_tab[k][i][j] = mem_ram;
+                } else {
+                    mem_write_plain_tab[k][i][j] = NULL;
+                }
+            }
+        }
+    }
+}
+#endif
+
 void mem_initialize_memory(void)
 {
     int i, j, k;
@@ -966,6 +1035,10 @@ void mem_initialize_memory(void)
     if (board == BOARD_MAX) {
         mem_limit_max_init();
     }
+
+#ifdef __LIBRETRO__
+    mem_plain_tab_init();
+#endif
 }
 
 void mem_mmu_translate(unsigned int addr, uint8_t **base, int *start, int *limit)
@@ -1003,6 +1076,9 @@ void mem_set_vbank(int new_vbank)
     /* Do not override watchpoints on vbank switches.  */
     if (_mem_write_tab_ptr != mem_write_tab_watch) {
         _mem_write_tab_ptr = mem_write_tab[new_vbank][mem_config];
+#ifdef __LIBRETRO__
+        _mem_write_plain_tab_ptr = mem_write_plain_tab[new_vbank][mem_config];
+#endif
     }
 
     vicii_set_vbank(new_vbank);
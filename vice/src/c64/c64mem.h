@@ -62,6 +62,13 @@ void mem_set_tape_motor_in(int val);
 
 extern uint8_t mem_chargen_rom[C64_CHARGEN_ROM_SIZE];
 
+#ifdef __LIBRETRO__
+/* Per page base pointers of plain RAM/ROM for the CPU, NULL if the page has
+   to be accessed through the read and write tables.  */
+extern uint8_t **_mem_read_plain_tab_ptr;
+extern uint8_t **_mem_write_plain_tab_ptr;
+#endif
+
 void mem_set_write_hook(int config, int page, store_func_t *f);
 void mem_read_tab_set(unsigned int base, unsigned int index, read_func_ptr_t read_func);
 void mem_read_base_set(unsigned int base, unsigned int index, uint8_t *mem_ptr);
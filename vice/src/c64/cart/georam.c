@@ -108,6 +108,11 @@ static uint8_t georam[2];
 static uint8_t *georam_ram = NULL;
 static int old_georam_ram_size = 0;
 
+#ifdef __LIBRETRO__
+/* changed pages of georam_ram, for delta snapshots */
+static uint8_t *georam_ram_dirty = NULL;
+#endif
+
 static log_t georam_log = LOG_DEFAULT;
 
 static int georam_activate(void);
@@ -199,6 +204,11 @@ static uint8_t georam_io1_read(uint16_t addr)
 static void georam_io1_store(uint16_t addr, uint8_t byte)
 {
     georam_ram[(georam[1] * 16384) + (georam[0] * 256) + addr] = byte;
+#ifdef __LIBRETRO__
+    if (georam_ram_dirty) {
+        SNAPSHOT_DELTA_MARK(georam_ram_dirty, (georam[1] * 16384) + (georam[0] * 256) + addr);
+    }
+#endif
 }
 
 static uint8_t georam_io2_peek(uint16_t addr)
@@ -254,6 +264,9 @@ void georam_powerup(void)
         return;
     }
     if (georam_ram) {
+#ifdef __LIBRETRO__
+        snapshot_delta_touch(georam_ram);
+#endif
         ram_init_with_pattern(georam_ram, georam_size, &ramparam);
     }
 }
@@ -264,7 +277,13 @@ static int georam_activate(void)
         return 0;
     }
 
+#ifdef __LIBRETRO__
+    snapshot_delta_unregister(georam_ram);
+#endif
     georam_ram = lib_realloc((void *)georam_ram, (size_t)georam_size);
+#ifdef __LIBRETRO__
+    georam_ram_dirty = snapshot_delta_register(georam_ram, georam_size);
+#endif
 
     /* Clear newly allocated RAM.  */
     if (georam_size > old_georam_ram_size) {
@@ -309,6 +328,11 @@ static int georam_deactivate(void)
         }
     }
 
+#ifdef __LIBRETRO__
+    snapshot_delta_unregister(georam_ram);
+    georam_ram_dirty = NULL;
+#endif
+
     lib_free(georam_ram);
     georam_ram = NULL;
     old_georam_ram_size = 0;
@@ -571,6 +595,9 @@ void georam_config_setup(uint8_t *rawcart)
 {
     if (georam_size > 0) {
         memcpy(georam_ram, rawcart, georam_size);
+#ifdef __LIBRETRO__
+        snapshot_delta_touch(georam_ram);
+#endif
     }
 }
 
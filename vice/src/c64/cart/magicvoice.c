@@ -1518,22 +1518,14 @@ static int magicvoice_sound_machine_calculate_samples(sound_t **psid, float *pbu
 #else
 static int magicvoice_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, int soc, int scc, CLOCK *delta_t)
 {
-    int i;
     int16_t *buffer;
 
-    buffer = lib_malloc(nr * sizeof(int16_t));
+    buffer = sound_get_mix_buffer(&nr);
 
     t6721_update_output(t6721, buffer, nr);
 
     /* mix generated samples to output */
-    for (i = 0; i < nr; i++) {
-        pbuf[i * soc] = sound_audio_mix(pbuf[i * soc], buffer[i]);
-        if (soc == SOUND_OUTPUT_STEREO) {
-            pbuf[(i * soc) + 1] = sound_audio_mix(pbuf[(i * soc) + 1], buffer[i]);
-        }
-    }
-
-    lib_free(buffer);
+    sound_audio_mix_buffer(pbuf, buffer, nr, soc);
 
     return nr;
 }
@@ -229,6 +229,11 @@ static int reu_dma_active = 0;
 
 /*! \brief pointer to a buffer which holds the REU image.  */
 static uint8_t *reu_ram = NULL;
+
+#ifdef __LIBRETRO__
+/*! \brief changed pages of reu_ram, for delta snapshots */
+static uint8_t *reu_ram_dirty = NULL;
+#endif
 /*! \brief the old ram size of reu_ram. Used to determine if and how much of the
     buffer has to cleared when resizing the REU. */
 static unsigned int old_reu_ram_size = 0;
@@ -583,6 +588,9 @@ void reu_config_setup(uint8_t *rawcart)
 {
     if (reu_size > 0) {
         memcpy(reu_ram, rawcart, reu_size); /* FIXME */
+#ifdef __LIBRETRO__
+        snapshot_delta_touch(reu_ram);
+#endif
     }
 }
 
@@ -647,6 +655,9 @@ static void reu_init_ram(void)
     unsigned int b, i;
     DEBUG_LOG(DEBUG_LEVEL_REGISTER, (reu_log, "reu_init_ram"));
     if (reu_ram) {
+#ifdef __LIBRETRO__
+        snapshot_delta_touch(reu_ram);
+#endif
         ram_init_with_pattern(reu_ram, reu_size, &reuramparam);
         /* apply additional slightly odd invert pattern, observed by x1541 */
         for (b = 0; b < (reu_size >> 16); b += 4) {
@@ -681,7 +692,13 @@ static int reu_activate(void)
         return 0;
     }
 
+#ifdef __LIBRETRO__
+    snapshot_delta_unregister(reu_ram);
+#endif
     reu_ram = lib_realloc(reu_ram, reu_size);
+#ifdef __LIBRETRO__
+    reu_ram_dirty = snapshot_delta_register(reu_ram, reu_size);
+#endif
 
     /* Clear newly allocated RAM.  */
     reu_init_ram();
@@ -729,6 +746,11 @@ static int reu_deactivate(void)
     log_message(reu_log, "REU unit uninstalled.");
 #endif
 
+#ifdef __LIBRETRO__
+    snapshot_delta_unregister(reu_ram);
+    reu_ram_dirty = NULL;
+#endif
+
     lib_free(reu_ram);
     reu_ram = NULL;
     old_reu_ram_size = 0;
@@ -1117,6 +1139,11 @@ inline static void store_to_reu(unsigned int reu_addr, uint8_t value)
     if (reu_addr < rec_options.not_backedup_addresses) {
         assert(reu_addr < reu_size);
         reu_ram[reu_addr] = value;
+#ifdef __LIBRETRO__
+        if (reu_ram_dirty) {
+            SNAPSHOT_DELTA_MARK(reu_ram_dirty, reu_addr);
+        }
+#endif
     } else {
         DEBUG_LOG(DEBUG_LEVEL_NO_DRAM, (reu_log, "--> writing to REU address %05X, but no DRAM!", reu_addr));
     }
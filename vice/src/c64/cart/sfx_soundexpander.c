@@ -395,7 +395,7 @@ static int sfx_soundexpander_sound_machine_calculate_samples(sound_t **psid, flo
     int i;
     int16_t *buffer;
 
-    buffer = lib_malloc(nr * sizeof(int16_t));
+    buffer = sound_get_mix_buffer(&nr);
 
     if (sfx_soundexpander_chip == 3812 && YM3812_chip) {
         ym3812_update_one(YM3812_chip, buffer, nr);
@@ -406,17 +406,15 @@ static int sfx_soundexpander_sound_machine_calculate_samples(sound_t **psid, flo
     for (i = 0; i < nr; i++) {
         pbuf[i] = buffer[i] / 32767.0;
     }
-    lib_free(buffer);
 
     return nr;
 }
 #else
 static int sfx_soundexpander_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, int soc, int scc, CLOCK *delta_t)
 {
-    int i;
     int16_t *buffer;
 
-    buffer = lib_malloc(nr * 2);
+    buffer = sound_get_mix_buffer(&nr);
 
     if (sfx_soundexpander_chip == 3812 && YM3812_chip) {
         ym3812_update_one(YM3812_chip, buffer, nr);
@@ -424,13 +422,7 @@ static int sfx_soundexpander_sound_machine_calculate_samples(sound_t **psid, int
         ym3526_update_one(YM3526_chip, buffer, nr);
     }
 
-    for (i = 0; i < nr; i++) {
-        pbuf[i * soc] = sound_audio_mix(pbuf[i * soc], buffer[i]);
-        if (soc == SOUND_OUTPUT_STEREO) {
-            pbuf[(i * soc) + 1] = sound_audio_mix(pbuf[(i * soc) + 1], buffer[i]);
-        }
-    }
-    lib_free(buffer);
+    sound_audio_mix_buffer(pbuf, buffer, nr, soc);
 
     return nr;
 }
@@ -129,6 +129,8 @@ int drive_snapshot_write_module(snapshot_t *s, int save_disks, int save_roms)
     diskunit_context_t *unit;
     drive_t *drive;
 
+    drive_thread_sync();
+
     /* write vdrive info */
     if (vdrive_snapshot_module_write(s) < 0) {
         return -1;
@@ -332,6 +334,10 @@ int drive_snapshot_read_module(snapshot_t *s)
     int half_track[NUM_DISK_UNITS];
     int has_drives[NUM_DISK_UNITS];
 
+    drive_thread_sync();
+    /* The main CPU clock has been read already */
+    drive_thread_restart();
+
     drive_gcr_data_writeback_all();
 
     for (unr = 0; unr < NUM_DISK_UNITS; unr++) {
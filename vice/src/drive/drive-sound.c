@@ -1506,8 +1506,12 @@ static int drive_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf,
     int m, s;
 
 #ifdef __LIBRETRO__
-    if (sound_drive_mute)
+    /* Nothing to mix until the next motor or head event, disabled like
+       after the motor has stopped */
+    if (sound_drive_mute) {
+        drive_sound.chip_enabled = 0;
         return nr;
+    }
 #endif
 
     for (i = 0; i < nr; i++) {
@@ -1617,8 +1621,21 @@ static sound_chip_t drive_sound = {
     0                                      /* sound chip enabled flag, toggled upon device (de-)activation */
 };
 
+#if defined(__LIBRETRO__) && defined(HAVE_THREADS)
+/* Sounds of the drive thread are played at the next sync */
+static void drive_sound_update_deferred(int i, int unit, int unused)
+{
+    drive_sound_update(i, unit);
+}
+#endif
+
 void drive_sound_update(int i, int unit)
 {
+#if defined(__LIBRETRO__) && defined(HAVE_THREADS)
+    if (drive_thread_defer(drive_sound_update_deferred, i, unit, 0)) {
+        return;
+    }
+#endif
     if (!drive_sound_emulation) {
         drive_sound.chip_enabled = 0;
         return;
@@ -1638,6 +1655,11 @@ void drive_sound_update(int i, int unit)
 
 void drive_sound_head(int track, int dir, int unit)
 {
+#if defined(__LIBRETRO__) && defined(HAVE_THREADS)
+    if (drive_thread_defer(drive_sound_head, track, dir, unit)) {
+        return;
+    }
+#endif
     if (!drive_sound_emulation) {
         drive_sound.chip_enabled = 0;
         return;
@@ -1655,6 +1677,19 @@ void drive_sound_head(int track, int dir, int unit)
     }
 }
 
+#ifdef __LIBRETRO__
+/* The mute has been lifted: play the motors and heads from now on.  The
+   chip disables itself again once they are silent.  */
+void drive_sound_unmute(void)
+{
+    if (!drive_sound_emulation) {
+        return;
+    }
+    sound_store((uint16_t)drive_sound_offset, 0, 0);
+    drive_sound.chip_enabled = 1;
+}
+#endif
+
 void drive_sound_stop(void)
 {
     int i;
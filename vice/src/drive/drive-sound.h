@@ -36,4 +36,8 @@ void drive_sound_head(int track, int step, int unit);
 void drive_sound_stop(void);
 void drive_sound_init(void);
 
+#ifdef __LIBRETRO__
+void drive_sound_unmute(void);
+#endif
+
 #endif
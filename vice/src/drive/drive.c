@@ -89,6 +89,11 @@
 #include <stdbool.h>
 #include "vsync.h"
 #include "libretro-core.h"
+#ifdef HAVE_THREADS
+#include "alarm.h"
+#include "rthreads/rthreads.h"
+#include "timeprobe.h"
+#endif
 extern dc_storage *dc;
 extern unsigned int opt_autoloadwarp;
 extern unsigned int vice_led_state[RETRO_LED_NUM];
@@ -118,6 +123,309 @@ static bool is_jammed[NUM_DISK_UNITS] = { false, false, false, false };
 static char *jam_reason[NUM_DISK_UNITS] = { NULL, NULL, NULL, NULL };
 static int jam_action = MACHINE_JAM_ACTION_DIALOG;
 
+static void drive_cpu_execute_unit(diskunit_context_t *drv, CLOCK clk_value);
+
+/* ------------------------------------------------------------------------- */
+
+#if defined(__LIBRETRO__) && defined(HAVE_THREADS)
+/* Threaded true drive emulation.
+
+   The first drive runs in a worker thread while the main CPU goes on.
+   The worker is only handed main CPU clocks that have already passed, and
+   everything that looks at or changes the drive from the computer side
+   calls drive_thread_sync() first, which waits for the worker and takes
+   the drive back.  As the computer already runs the drive up to its own
+   clock before every bus access, the drive then sees exactly the same bus
+   states as without the thread, at the same clocks.
+
+   This only holds for drives that talk to the computer through the IEC
+   bus alone, so parallel cables, fast serial and further drives on the
+   same bus keep being run from the bus accessors.  Things the drive does
+   to the rest of the emulator (drive sounds) are deferred until the next
+   sync.  A JAM halts the worker: the drive stops at the JAM and gets no
+   more work until the emulation thread has handled it at the next sync.  */
+
+/* Main CPU cycles between handing out work */
+#define DRIVE_THREAD_SLICE 1000
+
+/* Initial size of the deferred call queue, it grows as needed */
+#define DRIVE_THREAD_MIN_DEFERRED 64
+
+typedef struct drive_thread_deferred_s {
+    void (*func)(int, int, int);
+    int a, b, c;
+} drive_thread_deferred_t;
+
+static struct {
+    sthread_t *thread;
+    slock_t *lock;
+    scond_t *cond;
+    alarm_t *alarm;
+    int enabled;
+    bool quit;
+    bool busy;
+    bool active;                /* handed out work since the last sync */
+    bool halted;                /* stopped at a JAM until the next sync */
+    diskunit_context_t *unit;   /* unit to run, NULL if nothing to do */
+    CLOCK target;               /* main CPU clock to run it to */
+    drive_thread_deferred_t *deferred;
+    unsigned int num_deferred;
+    unsigned int max_deferred;
+    drive_thread_deferred_t halt;   /* called after the deferred ones */
+#ifdef TIMEPROBE
+    uint64_t probe_ns;          /* time run since the last sync */
+#endif
+} drive_thread;
+
+static void drive_thread_func(void *data)
+{
+    diskunit_context_t *unit;
+    CLOCK target;
+
+    slock_lock(drive_thread.lock);
+    for (;;) {
+        while (!drive_thread.quit && drive_thread.unit == NULL) {
+            scond_wait(drive_thread.cond, drive_thread.lock);
+        }
+        if (drive_thread.quit) {
+            break;
+        }
+
+        unit = drive_thread.unit;
+        target = drive_thread.target;
+        drive_thread.busy = true;
+        slock_unlock(drive_thread.lock);
+
+#ifdef TIMEPROBE
+        {
+            uint64_t start = timeprobe_now();
+
+            drive_cpu_execute_unit(unit, target);
+            start = timeprobe_now() - start;
+            slock_lock(drive_thread.lock);
+            drive_thread.probe_ns += start;
+        }
+#else
+        drive_cpu_execute_unit(unit, target);
+        slock_lock(drive_thread.lock);
+#endif
+
+        drive_thread.busy = false;
+        if (drive_thread.unit == unit && drive_thread.target == target) {
+            drive_thread.unit = NULL;
+        }
+        scond_broadcast(drive_thread.cond);
+    }
+    slock_unlock(drive_thread.lock);
+}
+
+/* The unit the worker may run: the first drive, if it is a plain IEC
+   drive that is not idling by skipping cycles (these only run on bus
+   accesses, also when the computer is idle for a long time).  */
+static diskunit_context_t *drive_thread_unit(void)
+{
+    unsigned int dnr;
+
+    for (dnr = 0; dnr < NUM_DISK_UNITS; dnr++) {
+        diskunit_context_t *unit = diskunit_context[dnr];
+
+        if (unit->enable) {
+            if ((unit->type == DRIVE_TYPE_1540
+                 || unit->type == DRIVE_TYPE_1541
+                 || unit->type == DRIVE_TYPE_1541II)
+                && unit->parallel_cable == DRIVE_PC_NONE
+                && unit->idling_method != DRIVE_IDLE_SKIP_CYCLES) {
+                return unit;
+            }
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+static void drive_thread_alarm_handler(CLOCK offset, void *data)
+{
+    diskunit_context_t *unit;
+
+    alarm_set(drive_thread.alarm, maincpu_clk + DRIVE_THREAD_SLICE);
+
+    /* The frame is over, the frontend may look at the drives */
+    if (!retro_renderloop) {
+        return;
+    }
+
+    unit = drive_thread_unit();
+    if (unit == NULL) {
+        return;
+    }
+
+    slock_lock(drive_thread.lock);
+    if (!drive_thread.halted) {
+        drive_thread.unit = unit;
+        drive_thread.target = maincpu_clk;
+        scond_broadcast(drive_thread.cond);
+    }
+    slock_unlock(drive_thread.lock);
+
+    drive_thread.active = true;
+}
+
+int drive_thread_on_worker(void)
+{
+    return drive_thread.thread != NULL && sthread_isself(drive_thread.thread);
+}
+
+static void drive_thread_shutdown(void)
+{
+    if (drive_thread.thread == NULL) {
+        return;
+    }
+
+    drive_thread_sync();
+
+    slock_lock(drive_thread.lock);
+    drive_thread.quit = true;
+    scond_broadcast(drive_thread.cond);
+    slock_unlock(drive_thread.lock);
+
+    sthread_join(drive_thread.thread);
+    scond_free(drive_thread.cond);
+    slock_free(drive_thread.lock);
+    drive_thread.thread = NULL;
+
+    lib_free(drive_thread.deferred);
+    drive_thread.deferred = NULL;
+    drive_thread.max_deferred = 0;
+}
+
+void drive_thread_set_enabled(int enabled)
+{
+    if (drive_thread.enabled == enabled) {
+        return;
+    }
+
+    if (enabled && drive_thread.thread == NULL) {
+        drive_thread.lock = slock_new();
+        drive_thread.cond = scond_new();
+        drive_thread.quit = false;
+        if (drive_thread.lock != NULL && drive_thread.cond != NULL) {
+            drive_thread.thread = sthread_create(drive_thread_func, NULL);
+        }
+        if (drive_thread.thread == NULL) {
+            log_error(drive_log, "Cannot create drive thread.");
+            scond_free(drive_thread.cond);
+            slock_free(drive_thread.lock);
+            return;
+        }
+    }
+    if (drive_thread.alarm == NULL) {
+        drive_thread.alarm = alarm_new(maincpu_alarm_context, "DriveThread",
+                                       drive_thread_alarm_handler, NULL);
+    }
+
+    drive_thread_sync();
+
+    if (enabled) {
+        alarm_set(drive_thread.alarm, maincpu_clk + DRIVE_THREAD_SLICE);
+    } else {
+        alarm_unset(drive_thread.alarm);
+    }
+    drive_thread.enabled = enabled;
+}
+
+/* Hands out the next work a slice from now, after snapshots moved the main
+   CPU clock.  The alarm is not part of the snapshot.  */
+void drive_thread_restart(void)
+{
+    if (drive_thread.enabled) {
+        alarm_set(drive_thread.alarm, maincpu_clk + DRIVE_THREAD_SLICE);
+    }
+}
+
+/* Wait for the worker and take the drives back.  */
+void drive_thread_sync(void)
+{
+    unsigned int i;
+
+    if (!drive_thread.active) {
+        return;
+    }
+
+    slock_lock(drive_thread.lock);
+    drive_thread.unit = NULL;
+    while (drive_thread.busy) {
+        scond_wait(drive_thread.cond, drive_thread.lock);
+    }
+#ifdef TIMEPROBE
+    timeprobe_add(TIMEPROBE_DRIVE_THREAD, drive_thread.probe_ns);
+    drive_thread.probe_ns = 0;
+#endif
+    slock_unlock(drive_thread.lock);
+
+    drive_thread.active = false;
+
+    for (i = 0; i < drive_thread.num_deferred; i++) {
+        drive_thread_deferred_t *d = &drive_thread.deferred[i];
+
+        d->func(d->a, d->b, d->c);
+    }
+    drive_thread.num_deferred = 0;
+
+    if (drive_thread.halted) {
+        drive_thread.halted = false;
+        drive_thread.halt.func(drive_thread.halt.a, drive_thread.halt.b, drive_thread.halt.c);
+    }
+}
+
+/* Called by the drive side for things that must happen on the emulation
+   thread, returns 1 if `func' will be called at the next sync.  The queue
+   is only touched by the worker until the sync has waited for it, so it
+   can grow here.  */
+int drive_thread_defer(void (*func)(int, int, int), int a, int b, int c)
+{
+    drive_thread_deferred_t *d;
+
+    if (!drive_thread_on_worker()) {
+        return 0;
+    }
+
+    if (drive_thread.num_deferred == drive_thread.max_deferred) {
+        drive_thread.max_deferred = drive_thread.max_deferred
+                                    ? drive_thread.max_deferred * 2
+                                    : DRIVE_THREAD_MIN_DEFERRED;
+        drive_thread.deferred = lib_realloc(drive_thread.deferred,
+                                            drive_thread.max_deferred * sizeof(drive_thread_deferred_t));
+    }
+
+    d = &drive_thread.deferred[drive_thread.num_deferred++];
+    d->func = func;
+    d->a = a;
+    d->b = b;
+    d->c = c;
+    return 1;
+}
+
+/* Called by the drive side on a JAM, returns 1 if the worker has to stop
+   running the drive.  `func' is called at the next sync, after the
+   deferred calls, and the worker gets no more work until then.  */
+int drive_thread_halt(void (*func)(int, int, int), int a, int b, int c)
+{
+    if (!drive_thread_on_worker()) {
+        return 0;
+    }
+
+    drive_thread.halt.func = func;
+    drive_thread.halt.a = a;
+    drive_thread.halt.b = b;
+    drive_thread.halt.c = c;
+
+    slock_lock(drive_thread.lock);
+    drive_thread.halted = true;
+    slock_unlock(drive_thread.lock);
+    return 1;
+}
+#endif
+
 /* ------------------------------------------------------------------------- */
 
 void drive_set_disk_memory(uint8_t *id, unsigned int track, unsigned int sector,
@@ -320,6 +628,10 @@ void drive_shutdown(void)
         return;
     }
 
+#if defined(__LIBRETRO__) && defined(HAVE_THREADS)
+    drive_thread_shutdown();
+#endif
+
     for (unr = 0; unr < NUM_DISK_UNITS; unr++) {
         diskunit_context_t *unit = diskunit_context[unr];
 
@@ -425,6 +737,8 @@ int drive_set_disk_drive_type(unsigned int type, struct diskunit_context_s *drv)
 
     dnr = drv->mynumber;
 
+    drive_thread_sync();
+
     if (machine_drive_rom_check_loaded(type) < 0) {
         return -1;
     }
@@ -509,6 +823,8 @@ int drive_enable(diskunit_context_t *drv)
         return -1;
     }
 
+    drive_thread_sync();
+
     DBG(("drive_enable unit: %d", 8 + drv->mynumber));
     resources_get_int_sprintf("Drive%uTrueEmulation", &drive_true_emulation, 8 + drv->mynumber);
 
@@ -536,7 +852,7 @@ int drive_enable(diskunit_context_t *drv)
         drv->type == DRIVE_TYPE_CMDHD) {
         drivecpu65c02_wake_up(drv);
     } else {
-        drivecpu_wake_up(drv);
+        drivecpu_wake_up(drv, maincpu_clk);
     }
 
     /* Make sure the UI is updated.  */
@@ -550,6 +866,8 @@ void drive_disable(diskunit_context_t *drv)
     int drive_true_emulation = 0;
     unsigned int drive;
 
+    drive_thread_sync();
+
     /* This must come first, because this might be called before the true
        drive initialization.  */
     drv->enable = 0;
@@ -595,6 +913,8 @@ void drive_cpu_trigger_reset(unsigned int dnr)
     unsigned int d;
     diskunit_context_t *unit = diskunit_context[dnr];
 
+    drive_thread_sync();
+
     if (unit->type == DRIVE_TYPE_2000 ||
         unit->type == DRIVE_TYPE_4000 ||
         unit->type == DRIVE_TYPE_CMDHD) {
@@ -960,6 +1280,13 @@ void drive_update_ui_status(void)
         return;
     }
 
+#if defined(__LIBRETRO__) && defined(HAVE_THREADS)
+    /* Updated at the next vsync */
+    if (drive_thread_on_worker()) {
+        return;
+    }
+#endif
+
     /* Update the LEDs and the track indicators.  */
     for (i = 0; i < NUM_DISK_UNITS; i++) {
         diskunit_context_t *unit = diskunit_context[i];
@@ -1079,7 +1406,7 @@ int drive_num_leds(unsigned int dnr)
     }
 }
 
-void drive_cpu_execute_one(diskunit_context_t *drv, CLOCK clk_value)
+static void drive_cpu_execute_unit(diskunit_context_t *drv, CLOCK clk_value)
 {
     if (drv->type == DRIVE_TYPE_2000 || drv->type == DRIVE_TYPE_4000 ||
         drv->type == DRIVE_TYPE_CMDHD) {
@@ -1089,15 +1416,23 @@ void drive_cpu_execute_one(diskunit_context_t *drv, CLOCK clk_value)
     }
 }
 
+void drive_cpu_execute_one(diskunit_context_t *drv, CLOCK clk_value)
+{
+    drive_thread_sync();
+    drive_cpu_execute_unit(drv, clk_value);
+}
+
 void drive_cpu_execute_all(CLOCK clk_value)
 {
     unsigned int dnr;
 
+    drive_thread_sync();
+
     for (dnr = 0; dnr < NUM_DISK_UNITS; dnr++) {
         diskunit_context_t *unit = diskunit_context[dnr];
 
         if (unit->enable) {
-            drive_cpu_execute_one(unit, clk_value);
+            drive_cpu_execute_unit(unit, clk_value);
         }
     }
 }
@@ -1117,6 +1452,9 @@ void drive_vsync_hook(void)
 {
     unsigned int dnr;
 
+    drive_thread_sync();
+    drive_thread_restart();
+
     drive_update_ui_status();
 
     for (dnr = 0; dnr < NUM_DISK_UNITS; dnr++) {
@@ -1125,7 +1463,7 @@ void drive_vsync_hook(void)
 
         if (unit->enable) {
             if (unit->idling_method != DRIVE_IDLE_SKIP_CYCLES) {
-                drive_cpu_execute_one(diskunit_context[dnr], maincpu_clk);
+                drive_cpu_execute_unit(diskunit_context[dnr], maincpu_clk);
             }
             if (unit->idling_method == DRIVE_IDLE_NO_IDLE) {
                 /* if drive is never idle, also rotate the disk. this prevents
@@ -447,4 +447,17 @@ unsigned int drive_jam(int mynumber, const char *format, ...) VICE_ATTR_PRINTF2;
 bool drive_is_jammed(int mynumber);
 char *drive_jam_reason(int mynumber);
 
+#if defined(__LIBRETRO__) && defined(HAVE_THREADS)
+void drive_thread_set_enabled(int enabled);
+void drive_thread_sync(void);
+void drive_thread_restart(void);
+int drive_thread_defer(void (*func)(int, int, int), int a, int b, int c);
+int drive_thread_halt(void (*func)(int, int, int), int a, int b, int c);
+int drive_thread_on_worker(void);
+#else
+#define drive_thread_sync()
+#define drive_thread_restart()
+#define drive_thread_on_worker() 0
+#endif
+
 #endif
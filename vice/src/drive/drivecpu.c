@@ -54,6 +54,10 @@
 #include "snapshot.h"
 #include "types.h"
 #include "uiapi.h"
+#ifdef __LIBRETRO__
+#include "timeprobe.h"
+#include "via.h"
+#endif
 
 
 #define DRIVE_CPU
@@ -67,6 +71,12 @@
 CLOCK diskunit_clk[NUM_DISK_UNITS];
 
 static void drivecpu_jam(diskunit_context_t *drv);
+#if defined(__LIBRETRO__) && defined(HAVE_THREADS)
+static void drivecpu_jam_deferred(int mynumber, int unused_b, int unused_c);
+
+/* stop_clk of a drive halted at a JAM in the drive thread */
+static CLOCK drivecpu_jam_stop_clk[NUM_DISK_UNITS];
+#endif
 
 static void drivecpu_set_bank_base(void *context);
 
@@ -195,11 +205,26 @@ void drivecpu_reset_clk(diskunit_context_t *drv)
     drv->cpu->stop_clk = 0;
 }
 
+#ifdef __LIBRETRO__
+static void drivecpu_idle_log(diskunit_context_t *drv)
+{
+    if (drv->cpu->idle_skipped_cycles != 0) {
+        log_message(drv->log, "Skipped %lu cycles in polling loops.",
+                    (unsigned long)drv->cpu->idle_skipped_cycles);
+        drv->cpu->idle_skipped_cycles = 0;
+    }
+}
+#endif
+
 /* called by drive_reset() (via machine_specific_reset()) */
 void drivecpu_reset(diskunit_context_t *drv)
 {
     int preserve_monitor;
 
+#ifdef __LIBRETRO__
+    drivecpu_idle_log(drv);
+#endif
+
     *(drv->clk_ptr) = 0;
     drivecpu_reset_clk(drv);
 
@@ -221,6 +246,13 @@ void drivecpu_trigger_reset(unsigned int dnr)
     interrupt_trigger_reset(drivecpu_int_status_ptr[dnr], diskunit_clk[dnr] + 1);
 }
 
+#ifdef __LIBRETRO__
+CLOCK drivecpu_idle_skipped_cycles(diskunit_context_t *drv)
+{
+    return drv->cpu->idle_skipped_cycles;
+}
+#endif
+
 void drivecpu_set_overflow(diskunit_context_t *drv)
 {
     drivecpu_context_t *cpu = drv->cpu;
@@ -233,6 +265,10 @@ void drivecpu_shutdown(diskunit_context_t *drv)
 
     cpu = drv->cpu;
 
+#ifdef __LIBRETRO__
+    drivecpu_idle_log(drv);
+#endif
+
     if (cpu->alarm_context != NULL) {
         alarm_context_destroy(cpu->alarm_context);
     }
@@ -257,14 +293,15 @@ void drivecpu_init(diskunit_context_t *drv, int type)
     drivecpu_reset(drv);
 }
 
-inline void drivecpu_wake_up(diskunit_context_t *drv)
+/* `clk' is the main CPU clock the drive is about to be run to.  */
+inline void drivecpu_wake_up(diskunit_context_t *drv, CLOCK clk)
 {
     /* FIXME: this value could break some programs, or be way too high for
        others.  Maybe we should put it into a user-definable resource.  */
-    if (maincpu_clk - drv->cpu->last_clk > 0xffffff
+    if (clk - drv->cpu->last_clk > 0xffffff
         && *(drv->clk_ptr) > 934639) {
         log_message(drv->log, "Skipping cycles.");
-        drv->cpu->last_clk = maincpu_clk;
+        drv->cpu->last_clk = clk;
     }
 }
 
@@ -355,6 +392,303 @@ inline static int interrupt_check_irq_delay(interrupt_cpu_status_t *cs,
     return 0;
 }
 
+#ifdef __LIBRETRO__
+/* -------------------------------------------------------------------------- */
+/* Polling loop skipping.
+
+   Fast loaders spend most of their time in tight loops like
+
+       loop: LDA $1800
+             AND #$04
+             BEQ loop
+
+   that only read VIA1 port B or drive RAM.  Neither can change before the
+   next alarm of the drive CPU (the IEC bus only changes between two calls
+   of `drivecpu_execute()'), so once such a loop is running every further
+   iteration leaves the CPU in the same state, and all iterations but the
+   last one before the next alarm can be skipped.  */
+
+/* Maximum number of instructions and bytes of a polling loop.  */
+#define IDLE_LOOP_MAX_INSNS 4
+#define IDLE_LOOP_MAX_SIZE  16
+
+typedef struct idle_loop_regs_s {
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t p;
+    uint8_t n;
+    uint8_t z;
+} idle_loop_regs_t;
+
+/* Read a byte of a polling loop, or its operand, without side effects.
+   Return -1 if the loop must not be skipped at all, 0 if it must not be
+   skipped right now.  */
+static int idle_loop_peek(diskunit_context_t *drv, unsigned int addr,
+                          int is_code, uint8_t *value)
+{
+    uint8_t *base;
+
+    if (addr < 0x0800) {
+        *value = drv->drive_ram[addr];
+        return 1;
+    }
+    if (is_code) {
+        base = drv->cpud->read_base_tab_ptr[addr >> 8];
+        if (base == NULL) {
+            return -1;
+        }
+        *value = base[addr];
+        return 1;
+    }
+    if ((addr & 0xfc0f) == 0x1800) {
+        /* Reading port B clears pending CB1/CB2 interrupts and may return
+           the latched input instead of the pins.  */
+        if (drv->via1d1541->ifr & (VIA_IM_CB1 | VIA_IM_CB2)) {
+            return 0;
+        }
+        *value = viacore_peek(drv->via1d1541, VIA_PRB);
+        return 1;
+    }
+    return -1;
+}
+
+/* Emulate one iteration of the loop at `pc' on `regs'.  Return 1 and the
+   number of cycles if it ends with a branch back to `pc', otherwise the
+   return value of `idle_loop_peek()' or 0 if the loop is left.  */
+static int idle_loop_iterate(diskunit_context_t *drv, unsigned int pc,
+                             idle_loop_regs_t *regs, CLOCK *cycles)
+{
+    unsigned int addr = pc, dest, tmp;
+    uint8_t opcode, p1, p2, value;
+    int i, taken, ret;
+
+    *cycles = 0;
+
+    for (i = 0; i < IDLE_LOOP_MAX_INSNS; i++) {
+        if ((ret = idle_loop_peek(drv, addr, 1, &opcode)) <= 0
+            || (ret = idle_loop_peek(drv, (addr + 1) & 0xffff, 1, &p1)) <= 0) {
+            return ret;
+        }
+
+        switch (opcode) {
+            case 0x10:          /* BPL */
+            case 0x30:          /* BMI */
+            case 0x90:          /* BCC */
+            case 0xb0:          /* BCS */
+            case 0xd0:          /* BNE */
+            case 0xf0:          /* BEQ */
+                addr = (addr + 2) & 0xffff;
+                dest = (addr + (signed char)p1) & 0xffff;
+                if (dest != pc) {
+                    return -1;
+                }
+                switch (opcode) {
+                    case 0x10:
+                        taken = !(regs->n & 0x80);
+                        break;
+                    case 0x30:
+                        taken = regs->n & 0x80;
+                        break;
+                    case 0x90:
+                        taken = !(regs->p & P_CARRY);
+                        break;
+                    case 0xb0:
+                        taken = regs->p & P_CARRY;
+                        break;
+                    case 0xd0:
+                        taken = regs->z;
+                        break;
+                    default:
+                        taken = !regs->z;
+                        break;
+                }
+                if (!taken) {
+                    return 0;
+                }
+                *cycles += ((addr ^ dest) & 0xff00) ? 4 : 3;
+                return 1;
+
+            case 0x09:          /* ORA #$nn */
+            case 0x29:          /* AND #$nn */
+            case 0x49:          /* EOR #$nn */
+            case 0xa9:          /* LDA #$nn */
+            case 0xc9:          /* CMP #$nn */
+            case 0xa0:          /* LDY #$nn */
+            case 0xa2:          /* LDX #$nn */
+            case 0xc0:          /* CPY #$nn */
+            case 0xe0:          /* CPX #$nn */
+                value = p1;
+                addr += 2;
+                *cycles += 2;
+                break;
+
+            case 0x05:          /* ORA $nn */
+            case 0x25:          /* AND $nn */
+            case 0x45:          /* EOR $nn */
+            case 0xa5:          /* LDA $nn */
+            case 0xc5:          /* CMP $nn */
+            case 0xa4:          /* LDY $nn */
+            case 0xa6:          /* LDX $nn */
+            case 0xc4:          /* CPY $nn */
+            case 0xe4:          /* CPX $nn */
+            case 0x24:          /* BIT $nn */
+                value = drv->drive_ram[p1];
+                addr += 2;
+                *cycles += 3;
+                break;
+
+            case 0x0d:          /* ORA $nnnn */
+            case 0x2d:          /* AND $nnnn */
+            case 0x4d:          /* EOR $nnnn */
+            case 0xad:          /* LDA $nnnn */
+            case 0xcd:          /* CMP $nnnn */
+            case 0xac:          /* LDY $nnnn */
+            case 0xae:          /* LDX $nnnn */
+            case 0xcc:          /* CPY $nnnn */
+            case 0xec:          /* CPX $nnnn */
+            case 0x2c:          /* BIT $nnnn */
+                if ((ret = idle_loop_peek(drv, (addr + 2) & 0xffff, 1, &p2)) <= 0
+                    || (ret = idle_loop_peek(drv, p1 | (p2 << 8), 0, &value)) <= 0) {
+                    return ret;
+                }
+                addr += 3;
+                *cycles += 4;
+                break;
+
+            default:
+                return -1;
+        }
+
+        /* The addressing mode bits masked out, as in the opcode tables.  */
+        switch (opcode & 0xe3) {
+            case 0x01:          /* ORA */
+                regs->a |= value;
+                regs->n = regs->z = regs->a;
+                break;
+            case 0x21:          /* AND */
+                regs->a &= value;
+                regs->n = regs->z = regs->a;
+                break;
+            case 0x41:          /* EOR */
+                regs->a ^= value;
+                regs->n = regs->z = regs->a;
+                break;
+            case 0xa1:          /* LDA */
+                regs->a = value;
+                regs->n = regs->z = regs->a;
+                break;
+            case 0xa0:          /* LDY */
+                regs->y = value;
+                regs->n = regs->z = regs->y;
+                break;
+            case 0xa2:          /* LDX */
+                regs->x = value;
+                regs->n = regs->z = regs->x;
+                break;
+            case 0x20:          /* BIT */
+                /* Clearing V also acknowledges the byte ready line.  */
+                if (!(value & 0x40)) {
+                    return -1;
+                }
+                regs->p |= P_OVERFLOW;
+                regs->n = value & 0x80;
+                regs->z = (value & regs->a) ? 1 : 0;
+                break;
+            default:            /* CMP, CPX, CPY */
+                tmp = (opcode & 0xe3) == 0xc1 ? regs->a
+                      : (opcode & 0xe3) == 0xc0 ? regs->y : regs->x;
+                tmp -= value;
+                regs->p = (tmp < 0x100) ? (regs->p | P_CARRY) : (regs->p & ~P_CARRY);
+                regs->n = regs->z = (uint8_t)tmp;
+                break;
+        }
+        addr &= 0xffff;
+    }
+
+    return -1;
+}
+
+/* Called at the start of a loop iteration.  If the loop only polls, skip
+   as many iterations as possible without passing an alarm or `stop_clk'.  */
+static void drivecpu_idle_loop_skip(diskunit_context_t *drv)
+{
+    drivecpu_context_t *cpu = drv->cpu;
+    unsigned int pending;
+    idle_loop_regs_t first, next;
+    CLOCK cycles, next_cycles, limit, iterations;
+
+    switch (drv->type) {
+        case DRIVE_TYPE_1540:
+        case DRIVE_TYPE_1541:
+        case DRIVE_TYPE_1541II:
+        case DRIVE_TYPE_1570:
+        case DRIVE_TYPE_1571:
+        case DRIVE_TYPE_1571CR:
+            break;
+        default:
+            return;
+    }
+
+#ifdef DEBUG
+    if (debug.drivecpu_traceflg[drv->mynumber]) {
+        return;
+    }
+#endif
+
+    /* Nothing but an IRQ that stays masked may be pending.  */
+    pending = cpu->int_status->global_pending_int;
+    if (pending != IK_NONE
+        && ((pending & ~(IK_IRQ | IK_IRQPEND)) || !(pending & IK_IRQ)
+            || !(cpu->cpu_regs.p & P_INTERRUPT)
+            || OPINFO_DISABLES_IRQ(cpu->last_opcode_info))) {
+        return;
+    }
+
+    first.a = cpu->cpu_regs.a;
+    first.x = cpu->cpu_regs.x;
+    first.y = cpu->cpu_regs.y;
+    first.p = cpu->cpu_regs.p;
+    first.n = cpu->cpu_regs.n;
+    first.z = cpu->cpu_regs.z;
+
+    /* The loop must end up in the same state after every iteration.  */
+    if (idle_loop_iterate(drv, cpu->cpu_regs.pc, &first, &cycles) <= 0) {
+        return;
+    }
+    next = first;
+    if (idle_loop_iterate(drv, cpu->cpu_regs.pc, &next, &next_cycles) <= 0
+        || memcmp(&first, &next, sizeof(first)) != 0) {
+        return;
+    }
+
+    limit = alarm_context_next_pending_clk(cpu->alarm_context);
+    if (limit > cpu->stop_clk) {
+        limit = cpu->stop_clk;
+    }
+    if (limit <= *(drv->clk_ptr)) {
+        return;
+    }
+
+    /* Leave the last iteration before the alarm to the CPU emulation.  */
+    iterations = (limit - *(drv->clk_ptr)) / cycles;
+    if (iterations < 2) {
+        return;
+    }
+    iterations--;
+
+    cpu->cpu_regs.a = first.a;
+    cpu->cpu_regs.x = first.x;
+    cpu->cpu_regs.y = first.y;
+    cpu->cpu_regs.p = first.p;
+    cpu->cpu_regs.n = first.n;
+    cpu->cpu_regs.z = first.z;
+
+    *(drv->clk_ptr) += iterations * cycles;
+    cpu->idle_skipped_cycles += iterations * cycles;
+}
+#endif
+
 /* -------------------------------------------------------------------------- */
 /* Execute up to the current main CPU clock value.  This automatically
    calculates the corresponding number of clock ticks in the drive.  */
@@ -376,7 +710,16 @@ void drivecpu_execute(diskunit_context_t *drv, CLOCK clk_value)
 
     cpu = drv->cpu;
 
-    drivecpu_wake_up(drv);
+#ifdef TIMEPROBE
+    /* The drive thread is timed as a whole */
+    int probe = !drive_thread_on_worker();
+
+    if (probe) {
+        timeprobe_enter(TIMEPROBE_DRIVE);
+    }
+#endif
+
+    drivecpu_wake_up(drv, clk_value);
 
     /* Calculate number of main CPU clocks to emulate */
     if (clk_value > cpu->last_clk) {
@@ -396,6 +739,13 @@ void drivecpu_execute(diskunit_context_t *drv, CLOCK clk_value)
 
     /* Run drive CPU emulation until the stop_clk clock has been reached. */
     while (*drv->clk_ptr < cpu->stop_clk) {
+#ifdef __LIBRETRO__
+        /* A short backward branch was just taken.  */
+        if (reg_pc < cpu->last_opcode_addr
+            && cpu->last_opcode_addr - reg_pc < IDLE_LOOP_MAX_SIZE) {
+            drivecpu_idle_loop_skip(drv);
+        }
+#endif
 /* Include the 6502/6510 CPU emulation core.  */
 #define CPU_LOG_ID (drv->log)
 /* #define ANE_LOG_LEVEL ane_log_level */
@@ -447,6 +797,12 @@ void drivecpu_execute(diskunit_context_t *drv, CLOCK clk_value)
 
     cpu->last_clk = clk_value;
     drivecpu_sleep(drv);
+
+#ifdef TIMEPROBE
+    if (probe) {
+        timeprobe_leave();
+    }
+#endif
 }
 
 
@@ -472,6 +828,16 @@ static void drivecpu_jam(diskunit_context_t *drv)
 
     cpu = drv->cpu;
 
+#if defined(__LIBRETRO__) && defined(HAVE_THREADS)
+    /* In the drive thread, stop right at the JAM.  The emulation thread
+       runs it at the next sync and the drive goes on from there.  */
+    if (drive_thread_halt(drivecpu_jam_deferred, (int)drv->mynumber, 0, 0)) {
+        drivecpu_jam_stop_clk[drv->mynumber] = cpu->stop_clk;
+        cpu->stop_clk = CLK;
+        return;
+    }
+#endif
+
     switch (drv->type) {
         case DRIVE_TYPE_1540:
             dname = "  1540";
@@ -543,6 +909,16 @@ static void drivecpu_jam(diskunit_context_t *drv)
     }
 }
 
+#if defined(__LIBRETRO__) && defined(HAVE_THREADS)
+static void drivecpu_jam_deferred(int mynumber, int unused_b, int unused_c)
+{
+    diskunit_context_t *drv = diskunit_context[mynumber];
+
+    drv->cpu->stop_clk = drivecpu_jam_stop_clk[mynumber];
+    drivecpu_jam(drv);
+}
+#endif
+
 /* ------------------------------------------------------------------------- */
 
 #define SNAP_MAJOR 1
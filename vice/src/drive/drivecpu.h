@@ -47,11 +47,14 @@ void drivecpu_setup_context(struct diskunit_context_s *drv, int i);
 void drivecpu_init(struct diskunit_context_s *drv, int type);
 void drivecpu_reset(struct diskunit_context_s *drv);
 void drivecpu_sleep(struct diskunit_context_s *drv);
-void drivecpu_wake_up(struct diskunit_context_s *drv);
+void drivecpu_wake_up(struct diskunit_context_s *drv, CLOCK clk);
 void drivecpu_shutdown(struct diskunit_context_s *drv);
 void drivecpu_reset_clk(struct diskunit_context_s *drv);
 void drivecpu_trigger_reset(unsigned int dnr);
 void drivecpu_set_overflow(struct diskunit_context_s *drv);
+#ifdef __LIBRETRO__
+CLOCK drivecpu_idle_skipped_cycles(struct diskunit_context_s *drv);
+#endif
 
 void drivecpu_execute(struct diskunit_context_s *drv, CLOCK clk_value);
 int drivecpu_snapshot_write_module(struct diskunit_context_s *drv,
@@ -178,6 +178,8 @@ int drive_image_attach(disk_image_t *image, unsigned int unit, unsigned int drv)
     dnr = unit - 8;
     drive = diskunit_context[dnr]->drives[drv];
 
+    drive_thread_sync();
+
     if (drive_check_image_format(image->type, dnr) < 0) {
         return -1;
     }
@@ -241,6 +243,8 @@ int drive_image_detach(disk_image_t *image, unsigned int unit, unsigned int drv)
     diskunit = diskunit_context[dnr];
     drive = diskunit->drives[drv];
 
+    drive_thread_sync();
+
     if (drive->image != NULL) {
         switch (image->type) {
             case DISK_IMAGE_TYPE_D64:
@@ -83,6 +83,10 @@ typedef struct drivecpu_context_s {
     CLOCK stop_clk;
 
     CLOCK cycle_accum;
+#ifdef __LIBRETRO__
+    /* Number of cycles skipped in polling loops.  */
+    CLOCK idle_skipped_cycles;
+#endif
     uint8_t *d_bank_base;
     unsigned int d_bank_start;
     unsigned int d_bank_limit;
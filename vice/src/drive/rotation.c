@@ -1042,7 +1042,49 @@ static void rotation_1541_simple(drive_t *dptr)
             byte = dptr->GCR_track_start_ptr[off >> 3] << (off & 7);
         }
 
-        while (bits_moved-- != 0) {
+        while (bits_moved != 0) {
+#ifdef __LIBRETRO__
+            /* At a byte boundary, shift in the whole next byte at once
+               unless it could complete a sync mark.  */
+            if ((off & 7) == 7 && bits_moved >= 8) {
+                unsigned int idx = (unsigned int)(off + 1) >> 3;
+                unsigned int next, window, ones;
+
+                if (idx >= dptr->GCR_current_track_size) {
+                    idx = 0;
+                }
+                if (dptr->GCR_image_loaded == 0 || dptr->GCR_track_start_ptr == NULL) {
+                    next = 0;
+                } else {
+                    next = dptr->GCR_track_start_ptr[idx];
+                }
+
+                /* the 10 bits read so far followed by the 8 new ones; bit n
+                   of `ones' is set if bits n...n+9 are all ones, which
+                   means a sync after 8-n of the new bits */
+                window = ((last_read_data >> 7) & 0x3ff) << 8 | next;
+                ones = window & (window >> 1);
+                ones &= ones >> 2;
+                ones &= ones >> 4;
+                ones &= window >> 8 & window >> 9;
+
+                if ((ones & 0xff) == 0) {
+                    /* exactly one byte completes, after 8 - bit_counter bits */
+                    dptr->GCR_read = (uint8_t)(window >> bit_counter);
+                    rptr->last_write_data = (uint8_t)(dptr->GCR_read << bit_counter);
+                    if ((dptr->byte_ready_active & BRA_BYTE_READY) != 0) {
+                        dptr->byte_ready_edge = 1;
+                        dptr->byte_ready_level = 1;
+                    }
+                    last_read_data = (last_read_data << 8) | (next << 7);
+                    off = (int)(idx << 3) + 7;
+                    byte = next << 7;
+                    bits_moved -= 8;
+                    continue;
+                }
+            }
+#endif
+            bits_moved--;
             byte <<= 1; off++;
             if (!(off & 7)) {
                 if ((off >> 3) >= (int)dptr->GCR_current_track_size) {
@@ -400,6 +400,14 @@ if (!retro_mainloop)
     }
 }
 
+/* The 65816 registers are local to maincpu_mainloop(), snapshots always go
+   through a CPU trap */
+int maincpu_frame_boundary = 0;
+
+void maincpu_import_registers(void)
+{
+}
+
 #else /* __LIBRETRO__ */
 
 void maincpu_mainloop(void)
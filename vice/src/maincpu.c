@@ -51,9 +51,14 @@
 #include "snapshot.h"
 #include "resources.h"
 #include "cmdline.h"
+#include "timeprobe.h"
 #include "traps.h"
 #include "types.h"
 
+#ifdef __LIBRETRO__
+extern unsigned int retro_renderloop;
+#endif
+
 #ifndef EXIT_FAILURE
 #define EXIT_FAILURE 1
 #endif
@@ -524,20 +529,19 @@ void maincpu_resync_limits(void)
 }
 
 #ifdef __LIBRETRO__
-void maincpu_mainloop(void)
-{
-#define ORIGIN_MEMSPACE (e_comp_space)
+/* The registers live outside of maincpu_mainloop(), which runs a single
+   instruction per call, so they can be imported after a snapshot read.  */
 #ifndef C64DTV
-    /* Notice that using a struct for these would make it a lot slower (at
-       least, on gcc 2.7.2.x).  */
-    static uint8_t reg_a = 0;
-    static uint8_t reg_x = 0;
-    static uint8_t reg_y = 0;
+/* Notice that using a struct for these would make it a lot slower (at
+   least, on gcc 2.7.2.x).  */
+static uint8_t reg_a = 0;
+static uint8_t reg_x = 0;
+static uint8_t reg_y = 0;
 #else
-    static int reg_a_read_idx = 0;
-    static int reg_a_write_idx = 0;
-    static int reg_x_idx = 2;
-    static int reg_y_idx = 1;
+static int reg_a_read_idx = 0;
+static int reg_a_write_idx = 0;
+static int reg_x_idx = 2;
+static int reg_y_idx = 1;
 
 #define reg_a_write(c)                      \
     do {                                    \
@@ -565,14 +569,39 @@ void maincpu_mainloop(void)
     } while (0);
 #define reg_y_read dtv_registers[reg_y_idx]
 #endif
-    static uint8_t reg_p = 0;
-    static uint8_t reg_sp = 0;
-    static uint8_t flag_n = 0;
-    static uint8_t flag_z = 0;
+static uint8_t reg_p = 0;
+static uint8_t reg_sp = 0;
+static uint8_t flag_n = 0;
+static uint8_t flag_z = 0;
 #ifndef NEED_REG_PC
-    static unsigned int reg_pc;
+static unsigned int reg_pc;
+#endif
+
+/* Set when the last call ended a frame with the registers exported */
+int maincpu_frame_boundary = 0;
+
+#ifdef CPU_BATCH_IO
+/* The machine sets CPU_BATCH_IO on every memory access that may set an alarm
+   or trigger an interrupt.  6510core.c runs the instructions after one that
+   did not back to back up to the next alarm, without the checks at the start
+   of an instruction, if nothing else needs to see every instruction.  The
+   call has to return right after the end of a frame.  */
+#define CPU_BATCH_ALLOWED()                                    \
+    (retro_renderloop                                          \
+     && maincpu_int_status->global_pending_int == IK_NONE      \
+     && !maincpu_jammed                                        \
+     && !maincpu_profiling                                     \
+     && !maincpu_clk_limit                                     \
+     && !autostart_in_progress())
+
+#define CPU_BATCH_BREAK() (CPU_BATCH_IO = 1)
+#else
+#define CPU_BATCH_BREAK() ((void)0)
 #endif
 
+void maincpu_mainloop(void)
+{
+#define ORIGIN_MEMSPACE (e_comp_space)
 static unsigned retro_mainloop = 0;
 if (!retro_mainloop)
 {
@@ -587,6 +616,10 @@ if (!retro_mainloop)
 
     machine_trigger_reset(MACHINE_RESET_MODE_RESET_CPU);
 }
+    maincpu_frame_boundary = 0;
+
+    TIMEPROBE_ENTER(TIMEPROBE_CPU);
+
     /*while (1)*/ {
 #define CPU_LOG_ID maincpu_log
 #define ANE_LOG_LEVEL ane_log_level
@@ -608,12 +641,13 @@ if (!retro_mainloop)
 
 #define TRAP(addr) maincpu_int_status->trap_func(addr);
 
-#define ROM_TRAP_HANDLER() traps_handler()
+#define ROM_TRAP_HANDLER() (CPU_BATCH_BREAK(), traps_handler())
 
 #define JAM()                                                         \
     do {                                                              \
         unsigned int tmp;                                             \
                                                                       \
+        CPU_BATCH_BREAK();                                            \
         EXPORT_REGISTERS();                                           \
         tmp = machine_jam("   " CPU_STR ": JAM at $%04X   ", reg_pc); \
         switch (tmp) {                                                \
@@ -654,7 +688,21 @@ if (!retro_mainloop)
             debug.maincpu_traceflg = 1;
         }
 #endif
+
+        /* Frame done, snapshots can be taken without a CPU trap */
+        if (!retro_renderloop) {
+            EXPORT_REGISTERS();
+            maincpu_frame_boundary = 1;
+        }
     }
+
+    TIMEPROBE_LEAVE();
+}
+
+/* Take over the registers after a snapshot was read outside of the loop */
+void maincpu_import_registers(void)
+{
+    IMPORT_REGISTERS();
 }
 
 #else /* __LIBRETRO__ */
@@ -90,6 +90,10 @@ void maincpu_early_init(void);
 void maincpu_shutdown(void);
 void maincpu_reset(void);
 void maincpu_mainloop(void);
+#ifdef __LIBRETRO__
+extern int maincpu_frame_boundary;
+void maincpu_import_registers(void);
+#endif
 struct monitor_interface_s *maincpu_monitor_interface_get(void);
 int maincpu_snapshot_read_module(struct snapshot_s *s);
 int maincpu_snapshot_write_module(struct snapshot_s *s);
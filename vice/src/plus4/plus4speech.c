@@ -660,22 +660,14 @@ static int speech_sound_machine_calculate_samples(sound_t **psid, float *pbuf, i
 #else
 static int speech_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, int soc, int scc, CLOCK *delta_t)
 {
-    int i;
     int16_t *buffer;
 
-    buffer = lib_malloc(nr * 2);
+    buffer = sound_get_mix_buffer(&nr);
 
     t6721_update_output(t6721, buffer, nr);
 
     /* mix generated samples to output */
-    for (i = 0; i < nr; i++) {
-        pbuf[i * soc] = sound_audio_mix(pbuf[i * soc], buffer[i]);
-        if (soc == SOUND_OUTPUT_STEREO) {
-            pbuf[(i * soc) + 1] = sound_audio_mix(pbuf[(i * soc) + 1], buffer[i]);
-        }
-    }
-
-    lib_free(buffer);
+    sound_audio_mix_buffer(pbuf, buffer, nr, soc);
 
     return nr;
 }
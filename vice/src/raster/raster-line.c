@@ -45,6 +45,7 @@
 
 #ifdef __LIBRETRO__
 #include "libretro-core.h"
+#include "videoarch.h"
 #endif
 
 unsigned int raster_line_get_real_mode(raster_t *raster)
@@ -715,6 +716,11 @@ void raster_line_emulate(raster_t *raster)
 
     raster->current_line++;
 
+#ifdef __LIBRETRO__
+    /* Lines above the raster are final for this frame */
+    video_render_thread_rows(raster->canvas->draw_buffer->draw_buffer, raster->current_line);
+#endif
+
     if (raster->current_line == raster->geometry->screen_size.height) {
         raster->current_line = 0;
         /* not end of frame on NTSC VIC-II where lines 0+ are */
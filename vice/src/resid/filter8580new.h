@@ -663,6 +663,7 @@ private:
     public:
         Randomnoise()
         {
+            index = 0;
             for (int i=0; i<1024; i++)
                 buffer[i] = rand() % (1<<19);
         }
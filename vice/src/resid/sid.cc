@@ -36,6 +36,19 @@ using namespace std;
 #define round(x) (x>=0.0?floor(x+0.5):ceil(x-0.5))
 #endif
 
+// Vector kernels for the FIR convolution, see convolve() below.
+// Define RESID_NO_SIMD to build the plain loop only.
+#ifndef RESID_NO_SIMD
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+  && (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define RESID_FIR_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define RESID_FIR_NEON 1
+#include <arm_neon.h>
+#endif
+#endif
+
 namespace reSID
 {
 
@@ -56,6 +69,104 @@ inline short amplify(int input, int scaleFactor)
     return clip((scaleFactor * input) / 2);
 }
 
+
+// ----------------------------------------------------------------------------
+// Convolution of n samples with a FIR table.
+// The vector kernels are bit exact: the 32 bit sum of the products wraps
+// around the same way in any order of summation.
+// ----------------------------------------------------------------------------
+static int convolve_c(const short* a, const short* b, int n)
+{
+  int v = 0;
+  for (int i = 0; i < n; i++) {
+    v += a[i]*b[i];
+  }
+  return v;
+}
+
+#if RESID_FIR_X86
+__attribute__((target("sse2")))
+static int convolve_sse2(const short* a, const short* b, int n)
+{
+  __m128i acc = _mm_setzero_si128();
+  int i = 0;
+  for (; i <= n - 8; i += 8) {
+    acc = _mm_add_epi32(acc, _mm_madd_epi16(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i))));
+  }
+  acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+  acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+  int v = _mm_cvtsi128_si32(acc);
+  for (; i < n; i++) {
+    v += a[i]*b[i];
+  }
+  return v;
+}
+
+__attribute__((target("avx2")))
+static int convolve_avx2(const short* a, const short* b, int n)
+{
+  __m256i acc = _mm256_setzero_si256();
+  int i = 0;
+  for (; i <= n - 16; i += 16) {
+    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i))));
+  }
+  __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc),
+                              _mm256_extracti128_si256(acc, 1));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+  int v = _mm_cvtsi128_si32(sum);
+  for (; i < n; i++) {
+    v += a[i]*b[i];
+  }
+  return v;
+}
+#endif
+
+#if RESID_FIR_NEON
+static int convolve_neon(const short* a, const short* b, int n)
+{
+  int32x4_t acc = vdupq_n_s32(0);
+  int i = 0;
+  for (; i <= n - 8; i += 8) {
+    const int16x8_t x = vld1q_s16(a + i);
+    const int16x8_t y = vld1q_s16(b + i);
+    acc = vmlal_s16(acc, vget_low_s16(x), vget_low_s16(y));
+    acc = vmlal_s16(acc, vget_high_s16(x), vget_high_s16(y));
+  }
+  int32x2_t sum = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+  int v = vget_lane_s32(vpadd_s32(sum, sum), 0);
+  for (; i < n; i++) {
+    v += a[i]*b[i];
+  }
+  return v;
+}
+#endif
+
+typedef int (*convolve_function)(const short* a, const short* b, int n);
+
+static convolve_function select_convolve()
+{
+#if RESID_FIR_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return convolve_avx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return convolve_sse2;
+  }
+#elif RESID_FIR_NEON
+  return convolve_neon;
+#endif
+  return convolve_c;
+}
+
+static const convolve_function convolve = select_convolve();
+
+
 // ----------------------------------------------------------------------------
 // Constructor.
 // ----------------------------------------------------------------------------
@@ -1005,10 +1116,7 @@ int SID::clock_resample(cycle_count& delta_t, short* buf, int n, int interleave)
     short* sample_start = sample + sample_index - fir_N - 1 + RINGSIZE;
 
     // Convolution with filter impulse response.
-    int v1 = 0;
-    for (int j = 0; j < fir_N; j++) {
-      v1 += sample_start[j]*fir_start[j];
-    }
+    int v1 = convolve(sample_start, fir_start, fir_N);
 
     // Use next FIR table, wrap around to first FIR table using
     // next sample.
@@ -1019,10 +1127,7 @@ int SID::clock_resample(cycle_count& delta_t, short* buf, int n, int interleave)
     fir_start = fir + fir_offset*fir_N;
 
     // Convolution with filter impulse response.
-    int v2 = 0;
-    for (int k = 0; k < fir_N; k++) {
-      v2 += sample_start[k]*fir_start[k];
-    }
+    int v2 = convolve(sample_start, fir_start, fir_N);
 
     // Linear interpolation.
     // fir_offset_rmd is equal for all samples, it can thus be factorized out:
@@ -1071,10 +1176,7 @@ int SID::clock_resample_fastmem(cycle_count& delta_t, short* buf, int n, int int
     short* sample_start = sample + sample_index - fir_N + RINGSIZE;
 
     // Convolution with filter impulse response.
-    int v = 0;
-    for (int j = 0; j < fir_N; j++) {
-      v += sample_start[j]*fir_start[j];
-    }
+    int v = convolve(sample_start, fir_start, fir_N);
 
     v >>= FIR_SHIFT;
 
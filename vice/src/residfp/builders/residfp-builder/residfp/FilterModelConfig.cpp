@@ -33,6 +33,7 @@
 
 #include "Integrator.h"
 #include "OpAmp.h"
+#include "TableCache.h"
 
 namespace reSIDfp
 {
@@ -130,6 +131,45 @@ FilterModelConfig::FilterModelConfig() :
 {
     dac.kinkedDac(MOS6581);
 
+    // Allocate the lookup tables, so that they can be filled from the cache.
+    TableCache::Segment segments[3 + 5 + 8 + 16];
+    unsigned int count = 0;
+
+    segments[count].data = opamp_rev;
+    segments[count++].size = sizeof(opamp_rev);
+    segments[count].data = vcr_kVg;
+    segments[count++].size = sizeof(vcr_kVg);
+    segments[count].data = vcr_n_Ids_term;
+    segments[count++].size = sizeof(vcr_n_Ids_term);
+
+    for (int i = 0; i < 5; i++)
+    {
+        const int size = (2 + i) << 16;
+        summer[i] = new unsigned short[size];
+        segments[count].data = summer[i];
+        segments[count++].size = size * sizeof(unsigned short);
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+        const int size = (i == 0) ? 1 : i << 16;
+        mixer[i] = new unsigned short[size];
+        segments[count].data = mixer[i];
+        segments[count++].size = size * sizeof(unsigned short);
+    }
+
+    for (int n8 = 0; n8 < 16; n8++)
+    {
+        gain[n8] = new unsigned short[1 << 16];
+        segments[count].data = gain[n8];
+        segments[count++].size = (1 << 16) * sizeof(unsigned short);
+    }
+
+    if (TableCache::load("filter6581", segments, count))
+    {
+        return;
+    }
+
     // Convert op-amp voltage transfer to 16 bit values.
 
     Spline::Point scaled_voltage[OPAMP_SIZE];
@@ -170,7 +210,6 @@ FilterModelConfig::FilterModelConfig() :
         const int size = idiv << 16;
         const double n = idiv;
         opampModel.reset();
-        summer[i] = new unsigned short[size];
 
         for (int vi = 0; vi < size; vi++)
         {
@@ -192,7 +231,6 @@ FilterModelConfig::FilterModelConfig() :
         const int size = (i == 0) ? 1 : i << 16;
         const double n = i * 8.0 / 6.0;
         opampModel.reset();
-        mixer[i] = new unsigned short[size];
 
         for (int vi = 0; vi < size; vi++)
         {
@@ -213,7 +251,6 @@ FilterModelConfig::FilterModelConfig() :
         const int size = 1 << 16;
         const double n = n8 / 8.0;
         opampModel.reset();
-        gain[n8] = new unsigned short[size];
 
         for (int vi = 0; vi < size; vi++)
         {
@@ -269,6 +306,8 @@ FilterModelConfig::FilterModelConfig() :
         assert(tmp > -0.5 && tmp < 65535.5);
         vcr_n_Ids_term[kVg_Vx] = static_cast<unsigned short>(tmp + 0.5);
     }
+
+    TableCache::save("filter6581", segments, count);
 }
 
 FilterModelConfig::~FilterModelConfig()
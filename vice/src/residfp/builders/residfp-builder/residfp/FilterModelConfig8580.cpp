@@ -29,6 +29,7 @@
 
 #include "Integrator8580.h"
 #include "OpAmp.h"
+#include "TableCache.h"
 
 namespace reSIDfp
 {
@@ -139,6 +140,48 @@ FilterModelConfig8580::FilterModelConfig8580() :
     norm(1.0 / denorm),
     N16(norm * ((1 << 16) - 1))
 {
+    // Allocate the lookup tables, so that they can be filled from the cache.
+    TableCache::Segment segments[1 + 5 + 8 + 16 + 16];
+    unsigned int count = 0;
+
+    segments[count].data = opamp_rev;
+    segments[count++].size = sizeof(opamp_rev);
+
+    for (int i = 0; i < 5; i++)
+    {
+        const int size = (2 + i) << 16;
+        summer[i] = new unsigned short[size];
+        segments[count].data = summer[i];
+        segments[count++].size = size * sizeof(unsigned short);
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+        const int size = (i == 0) ? 1 : i << 16;
+        mixer[i] = new unsigned short[size];
+        segments[count].data = mixer[i];
+        segments[count++].size = size * sizeof(unsigned short);
+    }
+
+    for (int n8 = 0; n8 < 16; n8++)
+    {
+        gain_vol[n8] = new unsigned short[1 << 16];
+        segments[count].data = gain_vol[n8];
+        segments[count++].size = (1 << 16) * sizeof(unsigned short);
+    }
+
+    for (int n8 = 0; n8 < 16; n8++)
+    {
+        gain_res[n8] = new unsigned short[1 << 16];
+        segments[count].data = gain_res[n8];
+        segments[count++].size = (1 << 16) * sizeof(unsigned short);
+    }
+
+    if (TableCache::load("filter8580", segments, count))
+    {
+        return;
+    }
+
     // Convert op-amp voltage transfer to 16 bit values.
 
     Spline::Point scaled_voltage[OPAMP_SIZE];
@@ -178,7 +221,6 @@ FilterModelConfig8580::FilterModelConfig8580() :
         const int size = idiv << 16;
         const double n = idiv;
         opampModel.reset();
-        summer[i] = new unsigned short[size];
 
         for (int vi = 0; vi < size; vi++)
         {
@@ -200,7 +242,6 @@ FilterModelConfig8580::FilterModelConfig8580() :
         const int size = (i == 0) ? 1 : i << 16;
         const double n = i * 8.0 / 6.0;
         opampModel.reset();
-        mixer[i] = new unsigned short[size];
 
         for (int vi = 0; vi < size; vi++)
         {
@@ -220,7 +261,6 @@ FilterModelConfig8580::FilterModelConfig8580() :
         const int size = 1 << 16;
         const double n = n8 / 8.0;
         opampModel.reset();
-        gain_vol[n8] = new unsigned short[size];
 
         for (int vi = 0; vi < size; vi++)
         {
@@ -240,7 +280,6 @@ FilterModelConfig8580::FilterModelConfig8580() :
     {
         const int size = 1 << 16;
         opampModel.reset();
-        gain_res[n8] = new unsigned short[size];
 
         for (int vi = 0; vi < size; vi++)
         {
@@ -250,6 +289,8 @@ FilterModelConfig8580::FilterModelConfig8580() :
             gain_res[n8][vi] = static_cast<unsigned short>(tmp + 0.5);
         }
     }
+
+    TableCache::save("filter8580", segments, count);
 }
 
 FilterModelConfig8580::~FilterModelConfig8580()
@@ -0,0 +1,95 @@
+/*
+ * This file is part of libsidplayfp, a SID player engine.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef TABLECACHE_H
+#define TABLECACHE_H
+
+#include "sidcxx11.h"
+
+namespace reSIDfp
+{
+
+/**
+ * Persistent storage for lookup tables which are expensive to compute,
+ * like the op-amp tables of the filter models.
+ *
+ * The tables of one kind are handed over as a list of segments under a
+ * name which changes with the parameters they depend on. Nothing is
+ * cached until the application sets an instance.
+ */
+class TableCache
+{
+public:
+    /// Part of the tables, stored one after the other.
+    struct Segment
+    {
+        void* data;
+        unsigned int size;  ///< Size in bytes
+    };
+
+public:
+    virtual ~TableCache() {}
+
+    /**
+     * Fill the segments with the tables stored under the given name.
+     *
+     * @param name name of the tables
+     * @param segments the segments to fill
+     * @param count number of segments
+     * @return false if the tables are not stored or do not fit the segments
+     */
+    virtual bool loadTables(const char* name, const Segment* segments, unsigned int count) = 0;
+
+    /**
+     * Store the tables under the given name.
+     *
+     * @param name name of the tables
+     * @param segments the segments to store
+     * @param count number of segments
+     */
+    virtual void saveTables(const char* name, const Segment* segments, unsigned int count) = 0;
+
+    /**
+     * Set the cache used by all models, nullptr for none.
+     */
+    static void setInstance(TableCache* cache) { instance() = cache; }
+
+    static bool load(const char* name, const Segment* segments, unsigned int count)
+    {
+        return instance() != nullptr && instance()->loadTables(name, segments, count);
+    }
+
+    static void save(const char* name, const Segment* segments, unsigned int count)
+    {
+        if (instance() != nullptr)
+        {
+            instance()->saveTables(name, segments, count);
+        }
+    }
+
+private:
+    static TableCache*& instance()
+    {
+        static TableCache* cache = nullptr;
+        return cache;
+    }
+};
+
+} // namespace reSIDfp
+
+#endif
@@ -21,6 +21,8 @@
 
 #include "WaveformCalculator.h"
 
+#include "TableCache.h"
+
 #ifdef __LIBRETRO__
 #ifdef __PS3__
 #include "PS3_include.h"
@@ -189,16 +191,26 @@ matrix_t* WaveformCalculator::buildTable(ChipModel model)
 
     matrix_t wftable(8, 4096);
 
-    for (unsigned int idx = 0; idx < 1 << 12; idx++)
+    const char* name = model == MOS6581 ? "waveforms6581" : "waveforms8580";
+    TableCache::Segment segment;
+    segment.data = wftable[0];
+    segment.size = wftable.length() * sizeof(short);
+
+    if (!TableCache::load(name, &segment, 1))
     {
-        wftable[0][idx] = 0xfff;
-        wftable[1][idx] = static_cast<short>((idx & 0x800) == 0 ? idx << 1 : (idx ^ 0xfff) << 1);
-        wftable[2][idx] = static_cast<short>(idx);
-        wftable[3][idx] = calculateCombinedWaveform(cfgArray[0], 3, idx);
-        wftable[4][idx] = 0xfff;
-        wftable[5][idx] = calculateCombinedWaveform(cfgArray[1], 5, idx);
-        wftable[6][idx] = calculateCombinedWaveform(cfgArray[2], 6, idx);
-        wftable[7][idx] = calculateCombinedWaveform(cfgArray[3], 7, idx);
+        for (unsigned int idx = 0; idx < 1 << 12; idx++)
+        {
+            wftable[0][idx] = 0xfff;
+            wftable[1][idx] = static_cast<short>((idx & 0x800) == 0 ? idx << 1 : (idx ^ 0xfff) << 1);
+            wftable[2][idx] = static_cast<short>(idx);
+            wftable[3][idx] = calculateCombinedWaveform(cfgArray[0], 3, idx);
+            wftable[4][idx] = 0xfff;
+            wftable[5][idx] = calculateCombinedWaveform(cfgArray[1], 5, idx);
+            wftable[6][idx] = calculateCombinedWaveform(cfgArray[2], 6, idx);
+            wftable[7][idx] = calculateCombinedWaveform(cfgArray[3], 7, idx);
+        }
+
+        TableCache::save(name, &segment, 1);
     }
 
     return &(CACHE.insert(lb, cw_cache_t::value_type(cfgArray, wftable))->second);
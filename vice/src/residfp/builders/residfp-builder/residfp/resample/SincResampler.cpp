@@ -36,16 +36,23 @@
 #endif
 
 #include "siddefs-fp.h"
+#include "TableCache.h"
 
 #ifdef HAVE_CONFIG_H
 #  include "config.h"
 #endif
 
-#ifdef __LIBRETRO__
-#else
-#ifdef HAVE_MMINTRIN_H
-#  include <mmintrin.h>
-#endif
+// Vector kernels for convolve(), define RESID_NO_SIMD to build the
+// plain loop only.
+#ifndef RESID_NO_SIMD
+#  if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+    && (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#    define RESID_FIR_X86 1
+#    include <immintrin.h>
+#  elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#    define RESID_FIR_NEON 1
+#    include <arm_neon.h>
+#  endif
 #endif
 
 namespace reSIDfp
@@ -88,43 +95,134 @@ double I0(double x)
     return sum;
 }
 
-/**
- * Calculate convolution with sample and sinc.
- *
- * @param a sample buffer input
- * @param b sinc buffer
- * @param bLength length of the sinc buffer
- * @return convolved result
- */
-int convolve(const short* a, const short* b, int bLength)
+int convolve_c(const short* a, const short* b, int bLength)
 {
-#ifdef HAVE_MMINTRIN_H
-    __m64 acc = _mm_setzero_si64();
+    int out = 0;
 
-    const int n = bLength / 4;
+    for (int i = 0; i < bLength; i++)
+    {
+        out += a[i] * b[i];
+    }
+
+    return out;
+}
 
-    for (int i = 0; i < n; i++)
+#ifdef RESID_FIR_X86
+__attribute__((target("sse2")))
+int convolve_sse2(const short* a, const short* b, int bLength)
+{
+    __m128i acc = _mm_setzero_si128();
+    int i = 0;
+
+    for (; i <= bLength - 8; i += 8)
     {
-        const __m64 tmp = _mm_madd_pi16(*(__m64*)a, *(__m64*)b);
-        acc = _mm_add_pi16(acc, tmp);
-        a += 4;
-        b += 4;
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(x, y));
     }
 
-    int out = _mm_cvtsi64_si32(acc) + _mm_cvtsi64_si32(_mm_srli_si64(acc, 32));
-    _mm_empty();
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    int out = _mm_cvtsi128_si32(acc);
 
-    bLength &= 3;
-#else
-    int out = 0;
+    for (; i < bLength; i++)
+    {
+        out += a[i] * b[i];
+    }
+
+    return out;
+}
+
+__attribute__((target("avx2")))
+int convolve_avx2(const short* a, const short* b, int bLength)
+{
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0;
+
+    for (; i <= bLength - 16; i += 16)
+    {
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        const __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(x, y));
+    }
+
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    int out = _mm_cvtsi128_si32(sum);
+
+    for (; i < bLength; i++)
+    {
+        out += a[i] * b[i];
+    }
+
+    return out;
+}
 #endif
 
-    for (int i = 0; i < bLength; i++)
+#ifdef RESID_FIR_NEON
+int convolve_neon(const short* a, const short* b, int bLength)
+{
+    int32x4_t acc = vdupq_n_s32(0);
+    int i = 0;
+
+    for (; i <= bLength - 8; i += 8)
     {
-        out += *a++ * *b++;
+        const int16x8_t x = vld1q_s16(a + i);
+        const int16x8_t y = vld1q_s16(b + i);
+        acc = vmlal_s16(acc, vget_low_s16(x), vget_low_s16(y));
+        acc = vmlal_s16(acc, vget_high_s16(x), vget_high_s16(y));
     }
 
-    return (out + (1 << 14)) >> 15;
+    const int32x2_t sum = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+    int out = vget_lane_s32(vpadd_s32(sum, sum), 0);
+
+    for (; i < bLength; i++)
+    {
+        out += a[i] * b[i];
+    }
+
+    return out;
+}
+#endif
+
+typedef int (*convolve_t)(const short* a, const short* b, int bLength);
+
+/**
+ * Select the fastest convolution kernel for the CPU. All kernels give
+ * the same result, the 32 bit sum of the products wraps around the same
+ * way in any order of summation.
+ */
+convolve_t selectConvolve()
+{
+#if defined(RESID_FIR_X86)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        return convolve_avx2;
+
+    if (__builtin_cpu_supports("sse2"))
+        return convolve_sse2;
+#elif defined(RESID_FIR_NEON)
+    return convolve_neon;
+#endif
+
+    return convolve_c;
+}
+
+const convolve_t convolveKernel = selectConvolve();
+
+/**
+ * Calculate convolution with sample and sinc.
+ *
+ * @param a sample buffer input
+ * @param b sinc buffer
+ * @param bLength length of the sinc buffer
+ * @return convolved result
+ */
+int convolve(const short* a, const short* b, int bLength)
+{
+    return (convolveKernel(a, b, bLength) + (1 << 14)) >> 15;
 }
 
 int SincResampler::fir(int subcycle)
@@ -215,6 +313,19 @@ SincResampler::SincResampler(double clockFrequency, double samplingFrequency, do
         matrix_t tempTable(firRES, firN);
         firTable = &(FIR_CACHE.insert(lb, fir_cache_t::value_type(firKey, tempTable))->second);
 
+        // The key without commas names the tables in the persistent cache.
+        std::ostringstream n;
+        n << "fir-" << firN << "-" << firRES << "-" << cyclesPerSampleD;
+        const std::string firName = n.str();
+        TableCache::Segment segment;
+        segment.data = (*firTable)[0];
+        segment.size = firTable->length() * sizeof(short);
+
+        if (TableCache::load(firName.c_str(), &segment, 1))
+        {
+            return;
+        }
+
         // The cutoff frequency is midway through the transition band, in effect the same as nyquist.
         const double wc = M_PI;
 
@@ -238,6 +349,8 @@ SincResampler::SincResampler(double clockFrequency, double samplingFrequency, do
                 (*firTable)[i][j] = static_cast<short>(scale * sincWt * kaiserXt);
             }
         }
+
+        TableCache::save(firName.c_str(), &segment, 1);
     }
 }
 
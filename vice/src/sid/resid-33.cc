@@ -1,5 +1,13 @@
 #include <math.h>
 
+/* The vector intrinsics used by resid/sid.cc cannot be included inside a
+   namespace. */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 /* Compile ReSID to its own namespace to avoid symbol clashes with the original one, but enable new filters
 this time. */
 #define NEW_8580_FILTER 1
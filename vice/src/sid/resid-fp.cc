@@ -17,13 +17,141 @@ extern char *strcpy(char *s1, char *s2);
 #include "resources.h"
 #include "sid-snapshot.h"
 #include "types.h"
+#ifdef __LIBRETRO__
+#include "archdep.h"
+#include "crc32.h"
+#include "util.h"
+#endif
 
 } // extern "C"
 
 #include "builders/residfp-builder/residfp/SID.h"
+#ifdef __LIBRETRO__
+#include "builders/residfp-builder/residfp/TableCache.h"
+#endif
 
 using namespace reSIDfp;
 
+#ifdef __LIBRETRO__
+/* The filter model tables take a few hundred milliseconds to compute when
+   the first SID is opened, they are kept as residfp-<name>.bin files in the
+   system directory instead.  A file starts with a header, the tables are
+   only used if it matches this build and the checksum of the tables.  */
+
+#define RESIDFP_CACHE_MAGIC   "VICERFPT"
+#define RESIDFP_CACHE_FORMAT  1
+
+struct residfp_cache_header_s
+{
+    char magic[8];
+    uint32_t format;        /* also tells the byte order */
+    char version[16];       /* residfp_version_string */
+    uint32_t size;          /* of the tables */
+    uint32_t crc;           /* of the tables */
+};
+
+typedef struct residfp_cache_header_s residfp_cache_header_t;
+
+class ViceTableCache : public TableCache
+{
+public:
+    bool loadTables(const char *name, const Segment *segments, unsigned int count)
+    {
+        residfp_cache_header_t header;
+        uint8_t *buf;
+        uint8_t *p;
+        unsigned int size = tablesSize(segments, count);
+        unsigned int i;
+        bool ok = false;
+
+        buf = (uint8_t *)lib_malloc(sizeof(header) + size);
+        if (loadFile(name, buf, sizeof(header) + size) == 0) {
+            p = buf + sizeof(header);
+            makeHeader(&header, p, size);
+            if (memcmp(buf, &header, sizeof(header)) == 0) {
+                for (i = 0; i < count; i++) {
+                    memcpy(segments[i].data, p, segments[i].size);
+                    p += segments[i].size;
+                }
+                ok = true;
+            } else {
+                log_warning(LOG_DEFAULT, "reSID-fp: ignoring outdated tables '%s'.", name);
+            }
+        }
+        lib_free(buf);
+        return ok;
+    }
+
+    void saveTables(const char *name, const Segment *segments, unsigned int count)
+    {
+        uint8_t *buf;
+        uint8_t *p;
+        char *path;
+        unsigned int size = tablesSize(segments, count);
+        unsigned int i;
+
+        buf = (uint8_t *)lib_malloc(sizeof(residfp_cache_header_t) + size);
+        p = buf + sizeof(residfp_cache_header_t);
+        for (i = 0; i < count; i++) {
+            memcpy(p, segments[i].data, segments[i].size);
+            p += segments[i].size;
+        }
+        makeHeader((residfp_cache_header_t *)buf, buf + sizeof(residfp_cache_header_t), size);
+
+        path = filePath(name);
+        if (util_file_save(path, buf, (int)(sizeof(residfp_cache_header_t) + size)) < 0) {
+            log_warning(LOG_DEFAULT, "reSID-fp: cannot save tables to '%s'.", path);
+        }
+        lib_free(path);
+        lib_free(buf);
+    }
+
+private:
+    static unsigned int tablesSize(const Segment *segments, unsigned int count)
+    {
+        unsigned int size = 0;
+        unsigned int i;
+
+        for (i = 0; i < count; i++) {
+            size += segments[i].size;
+        }
+        return size;
+    }
+
+    static void makeHeader(residfp_cache_header_t *header, const uint8_t *tables, unsigned int size)
+    {
+        memset(header, 0, sizeof(*header));
+        memcpy(header->magic, RESIDFP_CACHE_MAGIC, sizeof(header->magic));
+        header->format = RESIDFP_CACHE_FORMAT;
+        strncpy(header->version, residfp_version_string, sizeof(header->version) - 1);
+        header->size = size;
+        header->crc = crc32_buf((const char *)tables, size);
+    }
+
+    static char *filePath(const char *name)
+    {
+        char *datadir = archdep_get_vice_datadir();
+        char *file = lib_msprintf("residfp-%s.bin", name);
+        char *path = util_join_paths(datadir, file, NULL);
+
+        lib_free(file);
+        lib_free(datadir);
+        return path;
+    }
+
+    static int loadFile(const char *name, uint8_t *dest, unsigned int size)
+    {
+        char *path = filePath(name);
+        int retval = util_file_load(path, dest, size, UTIL_FILE_LOAD_RAW);
+
+        lib_free(path);
+        return retval;
+    }
+};
+
+static ViceTableCache residfp_table_cache;
+#endif
+
 extern "C" {
 
 struct sound_s
@@ -42,6 +170,9 @@ static sound_t *residfp_open(uint8_t *sidstate)
     sound_t *psid;
     int i;
 
+#ifdef __LIBRETRO__
+    TableCache::setInstance(&residfp_table_cache);
+#endif
     psid = new sound_t;
     psid->sid = new reSIDfp::SID;
 
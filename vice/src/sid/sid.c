@@ -41,6 +41,7 @@
 #include "usbsid.h"
 #include "joyport.h"
 #include "lib.h"
+#include "log.h"
 #include "machine.h"
 #include "maincpu.h"
 #include "parsid.h"
@@ -56,6 +57,10 @@
 #include "lightpen.h"
 #endif
 
+#if defined(__LIBRETRO__) && defined(HAVE_THREADS)
+#include "rthreads/rthreads.h"
+#endif
+
 #ifdef HAVE_RESID
 #include "resid.h"
 #if defined(__LIBRETRO__) && (defined(__X64__) || defined(__X64SC__) || defined(__XSCPU64__) || defined(__X128__))
@@ -585,8 +590,416 @@ bool sid_sound_machine_set_engine_hooks(void)
     return false;
 }
 
+#if defined(__LIBRETRO__) && defined(HAVE_THREADS) && !defined(SOUND_SYSTEM_FLOAT)
+/* Threaded rendering of the extra SIDs.
+
+   With more than one SID, only the first one is rendered into the sound
+   buffer when the emulation asks for samples.  The extra SIDs are
+   rendered by one worker thread each, which replays a log of what the
+   emulation thread would have done to them: a render event for every
+   sound_machine_calculate_samples() call, with the same cycles and
+   buffer room, and the register writes in between.  The workers are
+   handed the log every SID_THREAD_SLICE cycles, so they get the same
+   calls in the same order as without the threads and render the same
+   samples into buffers of their own.
+
+   sound_flush() holds the samples back until the end of the frame or
+   until the buffer is half full, then sid_thread_mix() waits for the
+   workers and mixes their samples in the same order as
+   sid_sound_machine_calculate_samples() does.  Everything else that
+   looks at or changes the SIDs waits for the workers first.
+
+   The other sound chips of the machine are mixed into the samples of all
+   SIDs, and mixing is not associative, so samples are only held back
+   while these chips are disabled.  Enabling one, like the drive sound
+   when a motor starts, first mixes the samples held back, then the SIDs
+   are rendered on the emulation thread until it is disabled again.  */
+
+/* Main CPU cycles between handing out work */
+#define SID_THREAD_SLICE 2000
+
+#define SID_THREAD_MAX_EVENTS 4096
+
+#define SID_THREAD_MAX_WORKERS (SOUND_SIDS_MAX - 1)
+
+typedef struct sid_thread_event_s {
+    CLOCK delta_t;      /* cycles to render */
+    int nr;             /* room for samples, -1 for a register write */
+    int chipno;         /* chip written to */
+    uint16_t addr;
+    uint8_t byte;
+} sid_thread_event_t;
+
+typedef struct sid_thread_worker_s {
+    sthread_t *thread;
+    sound_t *psid;
+    unsigned int pos;   /* next event to replay */
+    int16_t *buf;       /* samples not mixed yet */
+    int len;
+} sid_thread_worker_t;
+
+static struct {
+    slock_t *lock;
+    scond_t *cond;
+    int enabled;
+    bool quit;
+    int scc;                    /* chips being rendered, 0 if not active */
+    int soc;
+    sound_t *psid;              /* the first SID */
+    sid_thread_worker_t worker[SID_THREAD_MAX_WORKERS];
+    int num_workers;
+    int bufsize;                /* size of the worker buffers */
+    int16_t *mix_start;         /* samples of the first SID not mixed yet */
+    int rendered;
+    CLOCK cycles;               /* cycles logged since handing out work */
+    sid_thread_event_t events[SID_THREAD_MAX_EVENTS];
+    unsigned int num_events;
+    unsigned int published;     /* events handed to the workers */
+} sid_thread;
+
+static void sid_thread_replay(sid_thread_worker_t *w, int chipno, unsigned int start, unsigned int end)
+{
+    sid_thread_event_t *e;
+    CLOCK delta_t;
+    int room;
+    unsigned int i;
+
+    for (i = start; i < end; i++) {
+        e = &sid_thread.events[i];
+        if (e->nr < 0) {
+            if (e->chipno == chipno) {
+                sid_engine.store(w->psid, e->addr, e->byte);
+            }
+            continue;
+        }
+        room = sid_thread.bufsize - w->len;
+        if (room > e->nr) {
+            room = e->nr;
+        }
+        delta_t = e->delta_t;
+        w->len += sid_engine.calculate_samples(w->psid, w->buf + w->len, room,
+                                               SOUND_OUTPUT_MONO, &delta_t);
+    }
+}
+
+static void sid_thread_func(void *data)
+{
+    sid_thread_worker_t *w = data;
+    int chipno = (int)(w - sid_thread.worker) + 1;
+    unsigned int end;
+
+    slock_lock(sid_thread.lock);
+    for (;;) {
+        while (!sid_thread.quit && w->pos == sid_thread.published) {
+            scond_wait(sid_thread.cond, sid_thread.lock);
+        }
+        if (sid_thread.quit) {
+            break;
+        }
+        end = sid_thread.published;
+        slock_unlock(sid_thread.lock);
+
+        sid_thread_replay(w, chipno, w->pos, end);
+
+        slock_lock(sid_thread.lock);
+        w->pos = end;
+        scond_broadcast(sid_thread.cond);
+    }
+    slock_unlock(sid_thread.lock);
+}
+
+static void sid_thread_publish(void)
+{
+    slock_lock(sid_thread.lock);
+    sid_thread.published = sid_thread.num_events;
+    scond_broadcast(sid_thread.cond);
+    slock_unlock(sid_thread.lock);
+
+    sid_thread.cycles = 0;
+}
+
+/* Wait for the workers to replay the whole log and clear it.  */
+static void sid_thread_sync(void)
+{
+    int i;
+
+    if (sid_thread.num_events == 0) {
+        return;
+    }
+
+    sid_thread_publish();
+
+    slock_lock(sid_thread.lock);
+    for (i = 0; i < sid_thread.num_workers; i++) {
+        while (sid_thread.worker[i].pos < sid_thread.num_events) {
+            scond_wait(sid_thread.cond, sid_thread.lock);
+        }
+    }
+    slock_unlock(sid_thread.lock);
+
+    for (i = 0; i < SID_THREAD_MAX_WORKERS; i++) {
+        sid_thread.worker[i].pos = 0;
+    }
+    sid_thread.num_events = 0;
+    sid_thread.published = 0;
+    sid_thread.cycles = 0;
+}
+
+static sid_thread_event_t *sid_thread_event(void)
+{
+    if (sid_thread.num_events == SID_THREAD_MAX_EVENTS) {
+        sid_thread_sync();
+    }
+    return &sid_thread.events[sid_thread.num_events++];
+}
+
+static void sid_thread_shutdown(void)
+{
+    int i;
+
+    if (sid_thread.lock == NULL) {
+        return;
+    }
+
+    sid_thread_sync();
+
+    slock_lock(sid_thread.lock);
+    sid_thread.quit = true;
+    scond_broadcast(sid_thread.cond);
+    slock_unlock(sid_thread.lock);
+
+    for (i = 0; i < sid_thread.num_workers; i++) {
+        sthread_join(sid_thread.worker[i].thread);
+        sid_thread.worker[i].thread = NULL;
+    }
+    sid_thread.num_workers = 0;
+    scond_free(sid_thread.cond);
+    slock_free(sid_thread.lock);
+    sid_thread.cond = NULL;
+    sid_thread.lock = NULL;
+}
+
+/* Start the workers for `scc' chips, returns 0 if they cannot run.  */
+static int sid_thread_start(int scc)
+{
+    if (sid_thread.lock == NULL) {
+        sid_thread.lock = slock_new();
+        sid_thread.cond = scond_new();
+        sid_thread.quit = false;
+        if (sid_thread.lock == NULL || sid_thread.cond == NULL) {
+            log_error(LOG_DEFAULT, "Cannot create SID threads.");
+            scond_free(sid_thread.cond);
+            slock_free(sid_thread.lock);
+            sid_thread.cond = NULL;
+            sid_thread.lock = NULL;
+            sid_thread.enabled = 0;
+            return 0;
+        }
+    }
+
+    while (sid_thread.num_workers < scc - 1) {
+        sid_thread_worker_t *w = &sid_thread.worker[sid_thread.num_workers];
+
+        w->thread = sthread_create(sid_thread_func, w);
+        if (w->thread == NULL) {
+            log_error(LOG_DEFAULT, "Cannot create SID threads.");
+            sid_thread_shutdown();
+            sid_thread.enabled = 0;
+            return 0;
+        }
+        sid_thread.num_workers++;
+    }
+    return 1;
+}
+
+void sid_thread_set_enabled(int enabled)
+{
+    /* Samples held back are mixed first, then this is tried again */
+    if (sid_thread.enabled == enabled || sid_thread.rendered > 0) {
+        return;
+    }
+
+    sid_thread_shutdown();
+    sid_thread.enabled = enabled;
+}
+
+/* Frames of the first SID in the sound buffer waiting for the extra SIDs */
+int sid_thread_deferred(void)
+{
+    return sid_thread.rendered;
+}
+
+/* Mix the samples of the extra SIDs into those of the first one, returns
+   the start of the mixed frames and their number in `nr'.  */
+int16_t *sid_thread_mix(int *nr)
+{
+    int16_t *pbuf = sid_thread.mix_start;
+    int16_t *src;
+    int i, k, n;
+    int left, right;
+
+    sid_thread_sync();
+
+    for (k = 1; k < sid_thread.scc; k++) {
+        src = sid_thread.worker[k - 1].buf;
+        n = sid_thread.worker[k - 1].len;
+        if (n > sid_thread.rendered) {
+            n = sid_thread.rendered;
+        }
+        if (sid_thread.soc == SOUND_OUTPUT_MONO) {
+            for (i = 0; i < n; i++) {
+                pbuf[i] = sound_audio_mix(pbuf[i], src[i]);
+            }
+        } else {
+            /* Odd chips go right, even ones left, a last even one both */
+            left = !(k & 1);
+            right = (k & 1) || k == sid_thread.scc - 1;
+            for (i = 0; i < n; i++) {
+                if (left) {
+                    pbuf[i * 2] = sound_audio_mix(pbuf[i * 2], src[i]);
+                }
+                if (right) {
+                    pbuf[(i * 2) + 1] = sound_audio_mix(pbuf[(i * 2) + 1], src[i]);
+                }
+            }
+        }
+        sid_thread.worker[k - 1].len = 0;
+    }
+
+    *nr = sid_thread.rendered;
+    sid_thread.rendered = 0;
+    return pbuf;
+}
+
+/* The sound buffer was dropped, forget the samples not mixed yet.  */
+void sid_thread_discard(void)
+{
+    int i;
+
+    sid_thread_sync();
+
+    for (i = 0; i < SID_THREAD_MAX_WORKERS; i++) {
+        sid_thread.worker[i].len = 0;
+    }
+    sid_thread.rendered = 0;
+}
+
+/* Renders the first SID and logs a render event for the extra ones,
+   returns -1 if the workers cannot take the extra SIDs.  */
+static int sid_thread_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, int soc, int scc, CLOCK *delta_t)
+{
+    sid_thread_event_t *e;
+    int i, need;
+    CLOCK cycles = *delta_t;
+
+    if (!sid_thread.enabled || scc < SOUND_2_DEVICES
+        || (sidengine != SID_ENGINE_RESID && sidengine != SID_ENGINE_RESIDFP)
+        || sound_mixed_chips_enabled()) {
+        /* The extra SIDs are rendered here, with the writes logged so far */
+        sid_thread_sync();
+        return -1;
+    }
+
+    if (sid_thread.num_workers < scc - 1 || sid_thread.scc != scc
+        || sid_thread.soc != soc || sid_thread.psid != psid[0]) {
+        /* The samples of the old setup are mixed first */
+        if (sid_thread.rendered > 0 || !sid_thread_start(scc)) {
+            return -1;
+        }
+        for (i = 1; i < scc; i++) {
+            sid_thread.worker[i - 1].psid = psid[i];
+        }
+        sid_thread.psid = psid[0];
+        sid_thread.scc = scc;
+        sid_thread.soc = soc;
+    }
+
+    /* The workers can get as many samples as the sound buffer has room */
+    need = sid_thread.rendered + nr;
+    if (need > sid_thread.bufsize) {
+        sid_thread_sync();
+        for (i = 0; i < SID_THREAD_MAX_WORKERS; i++) {
+            sid_thread.worker[i].buf = lib_realloc(sid_thread.worker[i].buf, need * sizeof(int16_t));
+        }
+        sid_thread.bufsize = need;
+    }
+
+    e = sid_thread_event();
+    e->delta_t = *delta_t;
+    e->nr = nr;
+
+    if (sid_thread.rendered == 0) {
+        sid_thread.mix_start = pbuf;
+    }
+    nr = sid_engine.calculate_samples(psid[0], pbuf, nr, soc, delta_t);
+    if (soc == SOUND_OUTPUT_STEREO) {
+        for (i = 0; i < nr; i++) {
+            pbuf[(i * 2) + 1] = 0;
+        }
+    }
+    sid_thread.rendered += nr;
+
+    sid_thread.cycles += cycles;
+    if (sid_thread.cycles >= SID_THREAD_SLICE) {
+        sid_thread_publish();
+    }
+    return nr;
+}
+
+/* Returns the number of the extra SID `psid' is rendered by a worker
+   for, 0 if it is not.  */
+static int sid_thread_chipno(sound_t *psid)
+{
+    int i;
+
+    if (!sid_thread.enabled) {
+        return 0;
+    }
+    for (i = 1; i < sid_thread.scc; i++) {
+        if (sid_thread.worker[i - 1].psid == psid) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+/* Returns 1 if the write was logged for the worker of `psid'.  With
+   nothing logged the workers are idle and the write is done right away.  */
+static int sid_thread_store(sound_t *psid, uint16_t addr, uint8_t byte)
+{
+    sid_thread_event_t *e;
+    int chipno = sid_thread_chipno(psid);
+
+    if (chipno == 0 || sid_thread.num_events == 0) {
+        return 0;
+    }
+    e = sid_thread_event();
+    e->nr = -1;
+    e->chipno = chipno;
+    e->addr = addr;
+    e->byte = byte;
+    return 1;
+}
+
+/* The SIDs are closed, forget what the workers rendered.  */
+static void sid_thread_close(void)
+{
+    sid_thread_discard();
+    sid_thread.scc = 0;
+    sid_thread.psid = NULL;
+}
+#else
+#define sid_thread_calculate_samples(psid, pbuf, nr, soc, scc, delta_t) -1
+#define sid_thread_store(psid, addr, byte) 0
+#define sid_thread_chipno(psid) 0
+#define sid_thread_sync()
+#define sid_thread_close()
+#endif
+
 sound_t *sid_sound_machine_open(int chipno)
 {
+    sid_thread_sync();
+
     if (!sid_sound_machine_set_engine_hooks()) {
         return NULL;
     }
@@ -640,6 +1053,7 @@ GETBUFx(7)
 
 int sid_sound_machine_init_vbr(sound_t *psid, int speed, int cycles_per_sec, int factor)
 {
+    sid_thread_sync();
     return sid_engine.init(psid, speed * factor / 1000, cycles_per_sec, factor);
 }
 
@@ -648,11 +1062,13 @@ int sid_sound_machine_init(sound_t *psid, int speed, int cycles_per_sec)
     #ifdef HAVE_USBSID
     usbsid_open();
     #endif
+    sid_thread_sync();
     return sid_engine.init(psid, speed, cycles_per_sec, 1000);
 }
 
 void sid_sound_machine_close(sound_t *psid)
 {
+    sid_thread_close();
     sid_engine.close(psid);
 #ifndef SOUND_SYSTEM_FLOAT
     /* free the temp. buffers */
@@ -699,16 +1115,23 @@ void sid_sound_machine_close(sound_t *psid)
 
 uint8_t sid_sound_machine_read(sound_t *psid, uint16_t addr)
 {
+    if (sid_thread_chipno(psid)) {
+        sid_thread_sync();
+    }
     return sid_engine.read(psid, addr);
 }
 
 void sid_sound_machine_store(sound_t *psid, uint16_t addr, uint8_t byte)
 {
+    if (sid_thread_store(psid, addr, byte)) {
+        return;
+    }
     sid_engine.store(psid, addr, byte);
 }
 
 void sid_sound_machine_reset(sound_t *psid, CLOCK cpu_clk)
 {
+    sid_thread_sync();
     sid_engine.reset(psid, cpu_clk);
     #ifdef HAVE_USBSID
     usbsid_reset(true); /* This is called when the STOP button is pressed */
@@ -735,6 +1158,11 @@ int sid_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, i
     int tmp_nr = 0;
     CLOCK tmp_delta_t = *delta_t;
 
+    tmp_nr = sid_thread_calculate_samples(psid, pbuf, nr, soc, scc, delta_t);
+    if (tmp_nr >= 0) {
+        return tmp_nr;
+    }
+
     if (soc == SOUND_OUTPUT_MONO && scc == SOUND_1_DEVICE) {
         return sid_engine.calculate_samples(psid[0], pbuf, nr, SOUND_OUTPUT_MONO, delta_t);
     }
@@ -1017,6 +1445,7 @@ int sid_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, i
 
 char *sid_sound_machine_dump_state(sound_t *psid)
 {
+    sid_thread_sync();
     return sid_engine.dump_state(psid);
 }
 
@@ -1201,6 +1630,7 @@ int sid_engine_set(int engine)
 
 void sid_state_read(unsigned int channel, sid_snapshot_state_t *sid_state)
 {
+    sid_thread_sync();
     sid_engine.state_read(sound_get_psid(channel), sid_state);
 }
 
@@ -1211,6 +1641,8 @@ void sid_state_write(unsigned int channel, sid_snapshot_state_t *sid_state)
                 __FILE__, __LINE__, __func__);
     } else {
         sound_t *psid = sound_get_psid(channel);
+
+        sid_thread_sync();
         if (psid == NULL) {
             fprintf(stderr, "%s:%d:%s(): sound_get_psid() returned NULL\n",
                     __FILE__, __LINE__, __func__);
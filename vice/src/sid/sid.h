@@ -277,6 +277,16 @@ int sid_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, i
 
 void sid_set_enable(int value);
 
+#if defined(__LIBRETRO__) && defined(HAVE_THREADS) && !defined(SOUND_SYSTEM_FLOAT)
+void sid_thread_set_enabled(int enabled);
+int sid_thread_deferred(void);
+int16_t *sid_thread_mix(int *nr);
+void sid_thread_discard(void);
+#else
+#define sid_thread_deferred() 0
+#define sid_thread_discard()
+#endif
+
 int sid_engine_get_max_sids(int engine);
 int sid_machine_get_max_sids(void);
 int sid_machine_engine_get_max_sids(int engine);
@@ -52,6 +52,7 @@
 #include "monitor.h"
 #include "resources.h"
 #include "sound.h"
+#include "timeprobe.h"
 #include "types.h"
 #include "uiapi.h"
 #include "util.h"
@@ -189,6 +190,20 @@ uint16_t sound_chip_register(sound_chip_t *chip)
     return offset - 0x20;
 }
 
+/* Returns 1 if a sound chip is enabled that is mixed into the samples of
+   the first one, the drive sound while a motor runs for example.  */
+int sound_mixed_chips_enabled(void)
+{
+    int i;
+
+    for (i = 1; i < (offset >> 5); i++) {
+        if (sound_calls[i]->chip_enabled) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 /* ------------------------------------------------------------------------- */
 
 typedef struct {
@@ -315,6 +330,50 @@ static void malloc_sound_buffers(int size)
 }
 #endif
 
+/* scratch buffer handed to the sound chips, allocated with the sample buffer */
+static int16_t *mix_buffer = NULL;
+static int mix_buffer_size = 0;
+
+int16_t *sound_get_mix_buffer(int *nr)
+{
+    /* nr never exceeds the sample buffer, this is only a safety net */
+    if (*nr > mix_buffer_size) {
+        *nr = mix_buffer_size;
+    }
+    return mix_buffer;
+}
+
+static void alloc_mix_buffer(int nr)
+{
+    mix_buffer = lib_malloc(nr * sizeof(int16_t));
+    mix_buffer_size = nr;
+}
+
+static void free_mix_buffer(void)
+{
+    lib_free(mix_buffer);
+    mix_buffer = NULL;
+    mix_buffer_size = 0;
+}
+
+#ifndef SOUND_SYSTEM_FLOAT
+void sound_audio_mix_buffer(int16_t *pbuf, const int16_t *buf, int nr, int soc)
+{
+    int i;
+
+    if (soc == SOUND_OUTPUT_STEREO) {
+        for (i = 0; i < nr; i++) {
+            pbuf[i * 2] = sound_audio_mix(pbuf[i * 2], buf[i]);
+            pbuf[i * 2 + 1] = sound_audio_mix(pbuf[i * 2 + 1], buf[i]);
+        }
+    } else {
+        for (i = 0; i < nr; i++) {
+            pbuf[i] = sound_audio_mix(pbuf[i], buf[i]);
+        }
+    }
+}
+#endif
+
 /*
     There is some inconsistency about when the buffer should be overwritten and
     when mixed. Usually it's overwritten by SID and other cycle based engines,
@@ -1246,6 +1305,8 @@ int sound_open(void)
 #endif
         }
         snddata.buffer = lib_malloc(snddata.bufsize * snddata.sound_output_channels * sizeof(int16_t));
+        free_mix_buffer();
+        alloc_mix_buffer(snddata.bufsize * snddata.sound_output_channels);
 #ifdef SOUND_SYSTEM_FLOAT
         malloc_sound_buffers(snddata.bufsize * snddata.sound_output_channels * sizeof(float));
 #endif
@@ -1338,6 +1399,122 @@ int sound_open(void)
     return 0;
 }
 
+#ifdef __LIBRETRO__
+/* Batched sound writes.
+
+   Every write to a sound chip runs the sound emulation up to the clock of
+   the write first.  With batched writes, sound_store() only logs the write
+   with its clock, and sound_flush() logs the end of the raster line
+   instead of running the sound emulation.  The log is replayed at the end
+   of the frame, or before its samples would fill the sound buffer, by
+   running the sound emulation up to each logged clock in turn and doing
+   the write.  The chips get the same writes at the same clocks and render
+   in the same chunks as without the log, but they are only touched in one
+   go per frame.  Everything that needs the current state of the chips
+   runs the sound emulation, which replays the log first.
+
+   The output is only the same if nothing but the logged writes changes
+   what the chips render.  So only writes to the first chip are logged,
+   and only while it is cycle based (not fastsid, which fades registers by
+   the clock of the CPU) and no other chip is enabled (the drive sound,
+   the tape noise and the cartridges are changed by the emulation
+   directly).  */
+
+/* Entries in the log, a power of two */
+#define SOUND_BATCH_SIZE 4096
+
+/* Chip number of the end of a raster line */
+#define SOUND_BATCH_SYNC -1
+
+typedef struct sound_batch_entry_s {
+    CLOCK clk;
+    uint16_t addr;
+    uint8_t val;
+    int8_t chipno;
+} sound_batch_entry_t;
+
+static struct {
+    int enabled;
+    unsigned int head;
+    unsigned int tail;
+    sound_batch_entry_t entries[SOUND_BATCH_SIZE];
+} sound_batch;
+
+static int sound_run_sound_at(CLOCK clk);
+
+static int sound_batch_active(void)
+{
+    return sound_batch.enabled && playback_enabled && snddata.playdev
+           && !snddata.playdev->dump && !warp_mode_enabled && !retro_runahead_replay
+           && sound_calls[0]->cycle_based() && !sound_mixed_chips_enabled();
+}
+
+static int sound_batch_full(void)
+{
+    return sound_batch.head - sound_batch.tail == SOUND_BATCH_SIZE;
+}
+
+static void sound_batch_add(CLOCK clk, uint16_t addr, uint8_t val, int chipno)
+{
+    sound_batch_entry_t *e = &sound_batch.entries[sound_batch.head & (SOUND_BATCH_SIZE - 1)];
+
+    e->clk = clk;
+    e->addr = addr;
+    e->val = val;
+    e->chipno = (int8_t)chipno;
+    sound_batch.head++;
+}
+
+static void sound_batch_discard(void)
+{
+    sound_batch.tail = sound_batch.head;
+}
+
+/* Number of samples the logged clocks will render */
+static int sound_batch_samples(void)
+{
+    return (int)(SOUNDCLK_CONSTANT((maincpu_clk - snddata.lastclk)) / snddata.clkstep);
+}
+
+static int sound_batch_replay(void)
+{
+    sound_batch_entry_t *e;
+    int i;
+
+    while (sound_batch.tail != sound_batch.head) {
+        e = &sound_batch.entries[sound_batch.tail & (SOUND_BATCH_SIZE - 1)];
+        sound_batch.tail++;
+
+        i = sound_run_sound_at(e->clk);
+        if (i) {
+            sound_batch_discard();
+            return i;
+        }
+        if (e->chipno != SOUND_BATCH_SYNC && e->chipno < snddata.sound_chip_channels) {
+            sound_machine_store(snddata.psid[e->chipno], e->addr, e->val);
+        }
+    }
+    return 0;
+}
+
+void sound_batch_set_enabled(int enabled)
+{
+    if (!enabled && sound_batch_pending()) {
+        sound_batch_replay();
+    }
+    sound_batch.enabled = enabled;
+}
+
+/* Number of logged writes and line ends waiting to be replayed */
+int sound_batch_pending(void)
+{
+    return (int)(sound_batch.head - sound_batch.tail);
+}
+#else
+#define sound_batch_pending() 0
+#define sound_batch_discard()
+#endif
+
 static void sounddev_close(const sound_device_t **dev)
 {
     if (*dev) {
@@ -1357,6 +1534,9 @@ void sound_close(void)
         sound_state_changed = FALSE;
     if (!sound_state_changed && !sound_playdev_reopen)
         return;
+    /* The chips still get the logged writes */
+    if (sound_batch_pending())
+        sound_batch_replay();
 #endif
     sounddev_close(&snddata.playdev);
     sounddev_close(&snddata.recdev);
@@ -1373,6 +1553,7 @@ void sound_close(void)
     lib_free(snddata.buffer);
     snddata.buffer = NULL;
     snddata.bufsize = 0;
+    free_mix_buffer();
 
     if (temp_buffer) {
         lib_free(temp_buffer);
@@ -1385,8 +1566,35 @@ void sound_close(void)
     vsync_suspend_speed_eval();
 }
 
-/* run sid */
-static int sound_run_sound(void)
+static void sound_apply_volume(int16_t *pbuf, int nr)
+{
+    int i;
+
+    if (amp < 4096) {
+        if (amp) {
+            for (i = 0; i < (nr * snddata.sound_output_channels); i++) {
+                pbuf[i] = pbuf[i] * amp / 4096;
+            }
+        } else {
+            memset(pbuf, 0, nr * snddata.sound_output_channels * sizeof(int16_t));
+        }
+    }
+}
+
+#if defined(__LIBRETRO__) && defined(HAVE_THREADS)
+/* Mix in the extra SIDs of the samples held back for the SID threads */
+static void sound_sid_thread_mix(void)
+{
+    int16_t *mixed;
+    int nr;
+
+    mixed = sid_thread_mix(&nr);
+    sound_apply_volume(mixed, nr);
+}
+#endif
+
+/* run sid up to `clk' */
+static int sound_run_sound_at(CLOCK clk)
 {
 #if 1
     static int overflow_warning_count = 0;
@@ -1410,20 +1618,33 @@ static int sound_run_sound(void)
 
 #ifdef __LIBRETRO__
     /* Serialization/rewind crash guard */
-    if (        cycle_based && (snddata.lastclk > maincpu_clk)
-            || !cycle_based && (snddata.fclk > maincpu_clk))
+    if (        cycle_based && (snddata.lastclk > clk)
+            || !cycle_based && (snddata.fclk > clk))
+        return 0;
+
+    /* Runahead replays are restored afterwards and never heard. The sound
+       clock stays behind, snapshot reading resyncs it */
+    if (retro_runahead_replay)
         return 0;
 #endif
 
     /* if "disable sound emulation on warp" is enabled, exit */
     if ((sound_emulation_enabled_on_warp == 0) && warp_mode_enabled) {
-        snddata.lastclk = maincpu_clk;
+        snddata.lastclk = clk;
         return 0;
     }
 
+#if defined(__LIBRETRO__) && defined(HAVE_THREADS)
+    /* The other chips are mixed into all SIDs, the samples held back so far
+       are finished before a chip is mixed in */
+    if (sid_thread_deferred() && sound_mixed_chips_enabled()) {
+        sound_sid_thread_mix();
+    }
+#endif
+
     /* Handling of cycle based sound engines. */
     if (cycle_based) {
-        delta_t = maincpu_clk - snddata.lastclk;
+        delta_t = clk - snddata.lastclk;
         bufferptr = snddata.buffer + snddata.bufptr * snddata.sound_output_channels;
         nr = sound_machine_calculate_samples(snddata.psid,
                                              bufferptr,
@@ -1449,7 +1670,7 @@ static int sound_run_sound(void)
         }
      } else {
          /* Handling of sample based sound engines. */
-         nr = (int)((SOUNDCLK_CONSTANT(maincpu_clk) - snddata.fclk)
+         nr = (int)((SOUNDCLK_CONSTANT(clk) - snddata.fclk)
                     / snddata.clkstep);
          if (!nr) {
              return 0;
@@ -1467,18 +1688,14 @@ static int sound_run_sound(void)
          snddata.fclk += nr * snddata.clkstep;
      }
 
-     if (amp < 4096) {
-         if (amp) {
-             for (i = 0; i < (nr * snddata.sound_output_channels); i++) {
-                 bufferptr[i] = bufferptr[i] * amp / 4096;
-             }
-         } else {
-             memset(bufferptr, 0, nr * snddata.sound_output_channels * sizeof(int16_t));
-         }
+     /* The volume of samples waiting for the extra SIDs is set when they
+        are mixed */
+     if (!sid_thread_deferred()) {
+         sound_apply_volume(bufferptr, nr);
      }
 
     snddata.bufptr += nr;
-    snddata.lastclk = maincpu_clk;
+    snddata.lastclk = clk;
 
 #ifdef __LIBRETRO__
     if (opt_autoloadwarp)
@@ -1488,6 +1705,37 @@ static int sound_run_sound(void)
     return 0;
 }
 
+/* run sid */
+static int sound_run_sound(void)
+{
+#ifdef __LIBRETRO__
+    int i;
+
+    if (sound_batch_pending()) {
+        i = sound_batch_replay();
+        if (i) {
+            return i;
+        }
+    }
+#endif
+    return sound_run_sound_at(maincpu_clk);
+}
+
+#ifdef TIMEPROBE
+/* SID reads and writes run the sound emulation up to the current clock
+   too, so they are charged to the sound stage like sound_flush().  */
+static int sound_run_sound_timed(void)
+{
+    int result;
+
+    TIMEPROBE_ENTER(TIMEPROBE_SOUND);
+    result = sound_run_sound();
+    TIMEPROBE_LEAVE();
+    return result;
+}
+#define sound_run_sound() sound_run_sound_timed()
+#endif
+
 /* reset sid */
 void sound_reset(void)
 {
@@ -1496,6 +1744,8 @@ void sound_reset(void)
     snddata.fclk = SOUNDCLK_CONSTANT(maincpu_clk);
     snddata.wclk = maincpu_clk;
     snddata.lastclk = maincpu_clk;
+    sound_batch_discard();
+    sid_thread_discard();
     snddata.bufptr = 0;         /* ugly hack! */
     for (c = 0; c < snddata.sound_chip_channels; c++) {
         if (snddata.psid[c]) {
@@ -1509,6 +1759,8 @@ bool sound_flush(void)
 {
     int c, i, nr, space;
 
+    TIMEPROBE_ENTER(TIMEPROBE_SOUND);
+
     /*
      * It's possible when changing settings via UI to end up
      * flushing sound on the ui thread, which is a problem
@@ -1548,6 +1800,17 @@ bool sound_flush(void)
         sound_playdev_reopen = FALSE;
     }
 
+#ifdef __LIBRETRO__
+    /* Log the end of the line, the log is replayed at the end of the frame
+       or before its samples would fill half of the free buffer */
+    if (sound_batch_pending() && sound_batch_active() && retro_renderloop
+        && !sound_batch_full()
+        && sound_batch_samples() < (snddata.bufsize - snddata.bufptr) / 2) {
+        sound_batch_add(maincpu_clk, 0, 0, SOUND_BATCH_SYNC);
+        goto done;
+    }
+#endif
+
     if (sound_run_sound()) {
         goto done;
     }
@@ -1560,9 +1823,21 @@ bool sound_flush(void)
     }
 
     if (warp_mode_enabled && snddata.recdev == NULL) {
+        sid_thread_discard();
         snddata.bufptr = 0;
         goto done;
     }
+
+#if defined(__LIBRETRO__) && defined(HAVE_THREADS)
+    /* Give the SID threads time to render the extra SIDs, until the end of
+       the frame or until the buffer is half full */
+    if (sid_thread_deferred()) {
+        if (retro_renderloop && snddata.bufptr < snddata.bufsize / 2) {
+            goto done;
+        }
+        sound_sid_thread_mix();
+    }
+#endif
     sound_resume();
 
 #if 0
@@ -1664,6 +1939,7 @@ bool sound_flush(void)
     }
 
 done:
+    TIMEPROBE_LEAVE();
 
     /*
      * If the sound device is not a timing source, then we need
@@ -1803,6 +2079,13 @@ void sound_store(uint16_t addr, uint8_t val, int chipno)
 {
     int i;
 
+#ifdef __LIBRETRO__
+    if ((addr >> 5) == 0 && sound_batch_active() && !sound_batch_full()) {
+        sound_batch_add(maincpu_clk, addr, val, chipno);
+        return;
+    }
+#endif
+
     if (sound_run_sound()) {
         return;
     }
@@ -1880,6 +2163,8 @@ void sound_snapshot_prepare(void)
 
 void sound_snapshot_finish(void)
 {
+    /* Writes logged before reading a snapshot belong to the old state */
+    sound_batch_discard();
     snddata.lastclk = maincpu_clk;
 }
 
@@ -232,28 +232,26 @@ typedef struct sound_desc_s {
 } sound_desc_t;
 
 #ifndef SOUND_SYSTEM_FLOAT
+/* Adds two samples, when both have the same sign their product is taken off
+   to soften the clipping.  Written without branches so that the compiler
+   can vectorize the mixing loops.  */
 static inline int16_t sound_audio_mix(int ch1, int ch2)
 {
-    if (ch1 == 0) {
-        return (int16_t)ch2;
-    }
+    int product = ch1 * ch2;
+    int soften = (product > 0) ? product / 32768 : 0;
 
-    if (ch2 == 0) {
-        return (int16_t)ch1;
-    }
-
-    if ((ch1 > 0 && ch2 < 0) || (ch1 < 0 && ch2 > 0)) {
-        return (int16_t)(ch1 + ch2);
-    }
-
-    if (ch1 > 0) {
-        return (int16_t)((ch1 + ch2) - (ch1 * ch2 / 32768));
-    }
-
-    return (int16_t)-((-(ch1) + -(ch2)) - (-(ch1) * -(ch2) / 32768));
+    return (int16_t)(ch1 + ch2 - ((ch1 < 0) ? -soften : soften));
 }
+
+/* Mix nr mono samples into the output buffer, like sound_audio_mix() */
+void sound_audio_mix_buffer(int16_t *pbuf, const int16_t *buf, int nr, int soc);
 #endif
 
+/* Scratch buffer for the samples of a sound chip, valid until the chip's
+   calculate_samples function returns.  It is allocated by sound_open() and
+   never grows, nr is lowered to its size.  */
+int16_t *sound_get_mix_buffer(int *nr);
+
 sound_desc_t *sound_get_valid_devices(int type, int sort);
 
 /* external functions for vice */
@@ -270,6 +268,12 @@ void sound_set_machine_parameter(long clock_rate, long ticks_per_frame);
 void sound_snapshot_prepare(void);
 void sound_snapshot_finish(void);
 
+#ifdef __LIBRETRO__
+/* Batched sound writes, replayed once per frame */
+void sound_batch_set_enabled(int enabled);
+int sound_batch_pending(void);
+#endif
+
 int sound_resources_init(void);
 void sound_resources_shutdown(void);
 int sound_cmdline_options_init(void);
@@ -379,6 +383,7 @@ typedef struct sound_chip_s {
 } sound_chip_t;
 
 uint16_t sound_chip_register(sound_chip_t *chip);
+int sound_mixed_chips_enabled(void);
 
 typedef struct sound_dac_s {
     float output;
@@ -190,6 +190,13 @@ struct video_render_color_tables_s {
     uint32_t color_red[256];
     uint32_t color_grn[256];
     uint32_t color_blu[256];
+
+#ifdef __LIBRETRO__
+    /* physical colors of two neighbouring pixels, indexed by both 4 bit
+       color indexes, packed for pair_colors_bytes sized pixels (0 = unset) */
+    unsigned int pair_colors_bytes;
+    uint64_t pair_colors[256];
+#endif
 };
 typedef struct video_render_color_tables_s video_render_color_tables_t;
 
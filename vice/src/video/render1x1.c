@@ -26,6 +26,8 @@
 
 #include "vice.h"
 
+#include <string.h>
+
 #include "render1x1.h"
 #include "types.h"
 
@@ -141,3 +143,128 @@ void render_32_1x1_04(const video_render_color_tables_t *color_tab, const uint8_
         trg += pitcht;
     }
 }
+
+#ifdef __LIBRETRO__
+/* 16 color 1x1 renderers converting two pixels with one lookup */
+
+void render_1x1_pairs_init(video_render_color_tables_t *color_tab, unsigned int pixel_bytes)
+{
+    const uint32_t *colortab = color_tab->physical_colors;
+    unsigned int i;
+
+    for (i = 0; i < 256; i++) {
+        /* low nibble is the left pixel */
+        if (pixel_bytes == 2) {
+            uint16_t pair[2];
+            uint32_t packed;
+
+            pair[0] = (uint16_t)colortab[i & 0x0f];
+            pair[1] = (uint16_t)colortab[i >> 4];
+            memcpy(&packed, pair, sizeof(packed));
+            color_tab->pair_colors[i] = packed;
+        } else {
+            uint32_t pair[2];
+
+            pair[0] = colortab[i & 0x0f];
+            pair[1] = colortab[i >> 4];
+            memcpy(&color_tab->pair_colors[i], pair, sizeof(pair));
+        }
+    }
+    color_tab->pair_colors_bytes = pixel_bytes;
+}
+
+static void render_16_1x1_pairs(const video_render_color_tables_t *color_tab, const uint8_t *src, uint8_t *trg,
+                                unsigned int width, const unsigned int height,
+                                const unsigned int xs, const unsigned int ys,
+                                const unsigned int xt, const unsigned int yt,
+                                const unsigned int pitchs, const unsigned int pitcht)
+{
+    const uint32_t *colortab = color_tab->physical_colors;
+    const uint64_t *pairtab = color_tab->pair_colors;
+    const uint8_t *tmpsrc;
+    uint16_t *tmptrg;
+    unsigned int x, y, wpairs;
+    uint32_t packed;
+    uint8_t c0, c1;
+
+    src = src + pitchs * ys + xs;
+    trg = trg + pitcht * yt + (xt << 1);
+    wpairs = width >> 1;
+
+    for (y = 0; y < height; y++) {
+        tmpsrc = src;
+        tmptrg = (uint16_t *)trg;
+        for (x = 0; x < wpairs; x++) {
+            c0 = tmpsrc[0];
+            c1 = tmpsrc[1];
+            if ((c0 | c1) & 0xf0) {
+                tmptrg[0] = (uint16_t)colortab[c0];
+                tmptrg[1] = (uint16_t)colortab[c1];
+            } else {
+                packed = (uint32_t)pairtab[c0 | (c1 << 4)];
+                memcpy(tmptrg, &packed, sizeof(packed));
+            }
+            tmpsrc += 2;
+            tmptrg += 2;
+        }
+        if (width & 1) {
+            *tmptrg = (uint16_t)colortab[*tmpsrc];
+        }
+        src += pitchs;
+        trg += pitcht;
+    }
+}
+
+void render_32_1x1_pairs(const video_render_color_tables_t *color_tab, const uint8_t *src, uint8_t *trg,
+                         unsigned int width, const unsigned int height,
+                         const unsigned int xs, const unsigned int ys,
+                         const unsigned int xt, const unsigned int yt,
+                         const unsigned int pitchs, const unsigned int pitcht)
+{
+    const uint32_t *colortab = color_tab->physical_colors;
+    const uint64_t *pairtab = color_tab->pair_colors;
+    const uint8_t *tmpsrc;
+    uint32_t *tmptrg;
+    unsigned int x, y, wpairs;
+    uint8_t c0, c1;
+
+    /* the pairs must have been packed for the current pixel size */
+    if (color_tab->pair_colors_bytes != pix_bytes) {
+        render_32_1x1_04(color_tab, src, trg, width, height,
+                         xs, ys, xt, yt, pitchs, pitcht);
+        return;
+    }
+
+    if (pix_bytes == 2) {
+        render_16_1x1_pairs(color_tab, src, trg, width, height,
+                            xs, ys, xt, yt, pitchs, pitcht);
+        return;
+    }
+
+    src = src + pitchs * ys + xs;
+    trg = trg + pitcht * yt + (xt << 2);
+    wpairs = width >> 1;
+
+    for (y = 0; y < height; y++) {
+        tmpsrc = src;
+        tmptrg = (uint32_t *)trg;
+        for (x = 0; x < wpairs; x++) {
+            c0 = tmpsrc[0];
+            c1 = tmpsrc[1];
+            if ((c0 | c1) & 0xf0) {
+                tmptrg[0] = colortab[c0];
+                tmptrg[1] = colortab[c1];
+            } else {
+                memcpy(tmptrg, &pairtab[c0 | (c1 << 4)], sizeof(uint64_t));
+            }
+            tmpsrc += 2;
+            tmptrg += 2;
+        }
+        if (width & 1) {
+            *tmptrg = colortab[*tmpsrc];
+        }
+        src += pitchs;
+        trg += pitcht;
+    }
+}
+#endif
@@ -39,4 +39,14 @@ void render_32_1x1_04(const video_render_color_tables_t *color_tab, const uint8_
                       const unsigned int pitchs,
                       const unsigned int pitcht);
 
+#ifdef __LIBRETRO__
+void render_1x1_pairs_init(video_render_color_tables_t *color_tab, unsigned int pixel_bytes);
+void render_32_1x1_pairs(const video_render_color_tables_t *color_tab, const uint8_t *src, uint8_t *trg,
+                         unsigned int width, const unsigned int height,
+                         const unsigned int xs, const unsigned int ys,
+                         const unsigned int xt, const unsigned int yt,
+                         const unsigned int pitchs,
+                         const unsigned int pitcht);
+#endif
+
 #endif
@@ -0,0 +1,430 @@
+/*
+ * render1x1crt.c - Line kernels for the 1x1 PAL/NTSC renderers
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/*
+    The renderers look up the color tables once per source pixel, the
+    kernels then do the horizontal blur, the PAL delay line and the
+    YUV/YIQ to RGB matrix on whole lines. The vector kernels use the same
+    32 bit integer arithmetic as the scalar ones, so the results are
+    identical, only the gamma table lookups stay scalar.
+*/
+
+#include "vice.h"
+
+#include "log.h"
+#include "render1x1crt.h"
+#include "types.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RENDER_CRT_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+    && (defined(__clang__) || __GNUC__ >= 5)
+#define RENDER_CRT_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define RENDER_CRT_NEON
+#include <arm_neon.h>
+#endif
+
+render_crt_line_t render_crt_line;
+
+void render_crt_line_fetch(render_crt_line_t *line, const video_render_color_tables_t *color_tab,
+                           const int32_t *cbtable, const int32_t *crtable,
+                           const uint8_t *src, unsigned int count, unsigned int avail)
+{
+    const int32_t *ytablel = color_tab->ytablel;
+    const int32_t *ytableh = color_tab->ytableh;
+    unsigned int i, n;
+
+    /* every target pixel needs 2 source pixels left and 1 right of it,
+       the ones past the end of the source row repeat its last pixel */
+    n = (avail < count + 3) ? avail : count + 3;
+    for (i = 0; i < n; i++) {
+        uint8_t c = src[i];
+        line->yl[i] = ytablel[c];
+        line->yh[i] = ytableh[c];
+        line->cb[i] = cbtable[c];
+        line->cr[i] = crtable[c];
+    }
+    for (; i < count + 3; i++) {
+        line->yl[i] = line->yl[i - 1];
+        line->yh[i] = line->yh[i - 1];
+        line->cb[i] = line->cb[i - 1];
+        line->cr[i] = line->cr[i - 1];
+    }
+}
+
+void render_crt_line_store(const render_crt_line_t *line, const video_render_color_tables_t *color_tab,
+                           uint8_t *trg, unsigned int count, unsigned int pixel_bytes)
+{
+    unsigned int i;
+
+    if (pixel_bytes == 2) {
+        uint16_t *tmp = (uint16_t *)trg;
+        for (i = 0; i < count; i++) {
+            tmp[i] = (uint16_t)(color_tab->gamma_red[256 + line->red[i]]
+                                | color_tab->gamma_grn[256 + line->grn[i]]
+                                | color_tab->gamma_blu[256 + line->blu[i]]);
+        }
+    } else {
+        uint32_t *tmp = (uint32_t *)trg;
+        for (i = 0; i < count; i++) {
+            tmp[i] = color_tab->gamma_red[256 + line->red[i]]
+                     | color_tab->gamma_grn[256 + line->grn[i]]
+                     | color_tab->gamma_blu[256 + line->blu[i]]
+                     | color_tab->alpha;
+        }
+    }
+}
+
+/*
+    YUV to RGB
+
+    R = Y + V
+    G = Y - (0.1953 * U + 0.5078 * V)
+    B = Y + U
+*/
+static void render_crt_pal_range(render_crt_line_t *line, int32_t *delay_u, int32_t *delay_v,
+                                 int32_t off_flip, unsigned int i, unsigned int count)
+{
+    for (; i < count; i++) {
+        int32_t l, u, v, unew, vnew;
+
+        l = line->yl[i + 1] + line->yh[i + 2] + line->yl[i + 3];
+        unew = line->cb[i] + line->cb[i + 1] + line->cb[i + 2] + line->cb[i + 3];
+        vnew = line->cr[i] + line->cr[i + 1] + line->cr[i + 2] + line->cr[i + 3];
+        u = (unew + delay_u[i]) * off_flip;
+        v = (vnew + delay_v[i]) * off_flip;
+        delay_u[i] = unew;
+        delay_v[i] = vnew;
+
+        line->red[i] = (l + v) >> 16;
+        line->blu[i] = (l + u) >> 16;
+        line->grn[i] = (l - ((50 * u + 130 * v) >> 8)) >> 16;
+    }
+}
+
+/*
+    YIQ->RGB (Sony CXA2025AS US decoder matrix)
+
+    R = Y + (1.630 * I + 0.317 * Q)
+    G = Y - (0.378 * I + 0.466 * Q)
+    B = Y - (1.089 * I - 1.677 * Q)
+*/
+static void render_crt_ntsc_range(render_crt_line_t *line, int32_t off_flip,
+                                  unsigned int i, unsigned int count)
+{
+    for (; i < count; i++) {
+        int32_t l, u, v;
+
+        l = line->yl[i + 1] + line->yh[i + 2] + line->yl[i + 3];
+        u = (line->cb[i] + line->cb[i + 1] + line->cb[i + 2] + line->cb[i + 3]) * off_flip;
+        v = (line->cr[i] + line->cr[i + 1] + line->cr[i + 2] + line->cr[i + 3]) * off_flip;
+
+        line->red[i] = (l + ((209 * u +  41 * v) >> 7)) >> 15;
+        line->grn[i] = (l - (( 48 * u +  69 * v) >> 7)) >> 15;
+        line->blu[i] = (l - ((139 * u - 215 * v) >> 7)) >> 15;
+    }
+}
+
+static void render_crt_pal_scalar(render_crt_line_t *line, int32_t *delay_u, int32_t *delay_v,
+                                  int32_t off_flip, unsigned int count)
+{
+    render_crt_pal_range(line, delay_u, delay_v, off_flip, 0, count);
+}
+
+static void render_crt_ntsc_scalar(render_crt_line_t *line, int32_t off_flip, unsigned int count)
+{
+    render_crt_ntsc_range(line, off_flip, 0, count);
+}
+
+static const render_crt_kernels_t render_crt_kernels_scalar = {
+    "scalar", render_crt_pal_scalar, render_crt_ntsc_scalar
+};
+
+#ifdef RENDER_CRT_SSE2
+/* SSE2 has no 32 bit multiply keeping the low halves */
+static inline __m128i render_crt_mullo_sse2(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+#define LOAD4(p) _mm_loadu_si128((const __m128i *)(p))
+#define SUM4(p, i) _mm_add_epi32(_mm_add_epi32(LOAD4((p) + (i)), LOAD4((p) + (i) + 1)), \
+                                 _mm_add_epi32(LOAD4((p) + (i) + 2), LOAD4((p) + (i) + 3)))
+
+static void render_crt_pal_sse2(render_crt_line_t *line, int32_t *delay_u, int32_t *delay_v,
+                                int32_t off_flip, unsigned int count)
+{
+    const __m128i off = _mm_set1_epi32(off_flip);
+    const __m128i c50 = _mm_set1_epi32(50);
+    const __m128i c130 = _mm_set1_epi32(130);
+    unsigned int i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        __m128i l, u, v, unew, vnew, g;
+
+        l = _mm_add_epi32(_mm_add_epi32(LOAD4(line->yl + i + 1), LOAD4(line->yh + i + 2)),
+                          LOAD4(line->yl + i + 3));
+        unew = SUM4(line->cb, i);
+        vnew = SUM4(line->cr, i);
+        u = render_crt_mullo_sse2(_mm_add_epi32(unew, LOAD4(delay_u + i)), off);
+        v = render_crt_mullo_sse2(_mm_add_epi32(vnew, LOAD4(delay_v + i)), off);
+        _mm_storeu_si128((__m128i *)(delay_u + i), unew);
+        _mm_storeu_si128((__m128i *)(delay_v + i), vnew);
+
+        g = _mm_add_epi32(render_crt_mullo_sse2(u, c50), render_crt_mullo_sse2(v, c130));
+        _mm_storeu_si128((__m128i *)(line->red + i), _mm_srai_epi32(_mm_add_epi32(l, v), 16));
+        _mm_storeu_si128((__m128i *)(line->blu + i), _mm_srai_epi32(_mm_add_epi32(l, u), 16));
+        _mm_storeu_si128((__m128i *)(line->grn + i),
+                         _mm_srai_epi32(_mm_sub_epi32(l, _mm_srai_epi32(g, 8)), 16));
+    }
+
+    render_crt_pal_range(line, delay_u, delay_v, off_flip, i, count);
+}
+
+static void render_crt_ntsc_sse2(render_crt_line_t *line, int32_t off_flip, unsigned int count)
+{
+    const __m128i off = _mm_set1_epi32(off_flip);
+    const __m128i c209 = _mm_set1_epi32(209), c41 = _mm_set1_epi32(41);
+    const __m128i c48 = _mm_set1_epi32(48), c69 = _mm_set1_epi32(69);
+    const __m128i c139 = _mm_set1_epi32(139), c215 = _mm_set1_epi32(215);
+    unsigned int i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        __m128i l, u, v, r, g, b;
+
+        l = _mm_add_epi32(_mm_add_epi32(LOAD4(line->yl + i + 1), LOAD4(line->yh + i + 2)),
+                          LOAD4(line->yl + i + 3));
+        u = render_crt_mullo_sse2(SUM4(line->cb, i), off);
+        v = render_crt_mullo_sse2(SUM4(line->cr, i), off);
+
+        r = _mm_add_epi32(render_crt_mullo_sse2(u, c209), render_crt_mullo_sse2(v, c41));
+        g = _mm_add_epi32(render_crt_mullo_sse2(u, c48), render_crt_mullo_sse2(v, c69));
+        b = _mm_sub_epi32(render_crt_mullo_sse2(u, c139), render_crt_mullo_sse2(v, c215));
+        _mm_storeu_si128((__m128i *)(line->red + i),
+                         _mm_srai_epi32(_mm_add_epi32(l, _mm_srai_epi32(r, 7)), 15));
+        _mm_storeu_si128((__m128i *)(line->grn + i),
+                         _mm_srai_epi32(_mm_sub_epi32(l, _mm_srai_epi32(g, 7)), 15));
+        _mm_storeu_si128((__m128i *)(line->blu + i),
+                         _mm_srai_epi32(_mm_sub_epi32(l, _mm_srai_epi32(b, 7)), 15));
+    }
+
+    render_crt_ntsc_range(line, off_flip, i, count);
+}
+
+#undef LOAD4
+#undef SUM4
+
+static const render_crt_kernels_t render_crt_kernels_sse2 = {
+    "SSE2", render_crt_pal_sse2, render_crt_ntsc_sse2
+};
+#endif
+
+#ifdef RENDER_CRT_AVX2
+#define LOAD8(p) _mm256_loadu_si256((const __m256i *)(p))
+#define SUM8(p, i) _mm256_add_epi32(_mm256_add_epi32(LOAD8((p) + (i)), LOAD8((p) + (i) + 1)), \
+                                    _mm256_add_epi32(LOAD8((p) + (i) + 2), LOAD8((p) + (i) + 3)))
+
+__attribute__((target("avx2")))
+static void render_crt_pal_avx2(render_crt_line_t *line, int32_t *delay_u, int32_t *delay_v,
+                                int32_t off_flip, unsigned int count)
+{
+    const __m256i off = _mm256_set1_epi32(off_flip);
+    const __m256i c50 = _mm256_set1_epi32(50);
+    const __m256i c130 = _mm256_set1_epi32(130);
+    unsigned int i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        __m256i l, u, v, unew, vnew, g;
+
+        l = _mm256_add_epi32(_mm256_add_epi32(LOAD8(line->yl + i + 1), LOAD8(line->yh + i + 2)),
+                             LOAD8(line->yl + i + 3));
+        unew = SUM8(line->cb, i);
+        vnew = SUM8(line->cr, i);
+        u = _mm256_mullo_epi32(_mm256_add_epi32(unew, LOAD8(delay_u + i)), off);
+        v = _mm256_mullo_epi32(_mm256_add_epi32(vnew, LOAD8(delay_v + i)), off);
+        _mm256_storeu_si256((__m256i *)(delay_u + i), unew);
+        _mm256_storeu_si256((__m256i *)(delay_v + i), vnew);
+
+        g = _mm256_add_epi32(_mm256_mullo_epi32(u, c50), _mm256_mullo_epi32(v, c130));
+        _mm256_storeu_si256((__m256i *)(line->red + i), _mm256_srai_epi32(_mm256_add_epi32(l, v), 16));
+        _mm256_storeu_si256((__m256i *)(line->blu + i), _mm256_srai_epi32(_mm256_add_epi32(l, u), 16));
+        _mm256_storeu_si256((__m256i *)(line->grn + i),
+                            _mm256_srai_epi32(_mm256_sub_epi32(l, _mm256_srai_epi32(g, 8)), 16));
+    }
+
+    render_crt_pal_range(line, delay_u, delay_v, off_flip, i, count);
+}
+
+__attribute__((target("avx2")))
+static void render_crt_ntsc_avx2(render_crt_line_t *line, int32_t off_flip, unsigned int count)
+{
+    const __m256i off = _mm256_set1_epi32(off_flip);
+    const __m256i c209 = _mm256_set1_epi32(209), c41 = _mm256_set1_epi32(41);
+    const __m256i c48 = _mm256_set1_epi32(48), c69 = _mm256_set1_epi32(69);
+    const __m256i c139 = _mm256_set1_epi32(139), c215 = _mm256_set1_epi32(215);
+    unsigned int i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        __m256i l, u, v, r, g, b;
+
+        l = _mm256_add_epi32(_mm256_add_epi32(LOAD8(line->yl + i + 1), LOAD8(line->yh + i + 2)),
+                             LOAD8(line->yl + i + 3));
+        u = _mm256_mullo_epi32(SUM8(line->cb, i), off);
+        v = _mm256_mullo_epi32(SUM8(line->cr, i), off);
+
+        r = _mm256_add_epi32(_mm256_mullo_epi32(u, c209), _mm256_mullo_epi32(v, c41));
+        g = _mm256_add_epi32(_mm256_mullo_epi32(u, c48), _mm256_mullo_epi32(v, c69));
+        b = _mm256_sub_epi32(_mm256_mullo_epi32(u, c139), _mm256_mullo_epi32(v, c215));
+        _mm256_storeu_si256((__m256i *)(line->red + i),
+                            _mm256_srai_epi32(_mm256_add_epi32(l, _mm256_srai_epi32(r, 7)), 15));
+        _mm256_storeu_si256((__m256i *)(line->grn + i),
+                            _mm256_srai_epi32(_mm256_sub_epi32(l, _mm256_srai_epi32(g, 7)), 15));
+        _mm256_storeu_si256((__m256i *)(line->blu + i),
+                            _mm256_srai_epi32(_mm256_sub_epi32(l, _mm256_srai_epi32(b, 7)), 15));
+    }
+
+    render_crt_ntsc_range(line, off_flip, i, count);
+}
+
+#undef LOAD8
+#undef SUM8
+
+static const render_crt_kernels_t render_crt_kernels_avx2 = {
+    "AVX2", render_crt_pal_avx2, render_crt_ntsc_avx2
+};
+#endif
+
+#ifdef RENDER_CRT_NEON
+#define SUM4(p, i) vaddq_s32(vaddq_s32(vld1q_s32((p) + (i)), vld1q_s32((p) + (i) + 1)), \
+                             vaddq_s32(vld1q_s32((p) + (i) + 2), vld1q_s32((p) + (i) + 3)))
+
+static void render_crt_pal_neon(render_crt_line_t *line, int32_t *delay_u, int32_t *delay_v,
+                                int32_t off_flip, unsigned int count)
+{
+    unsigned int i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        int32x4_t l, u, v, unew, vnew, g;
+
+        l = vaddq_s32(vaddq_s32(vld1q_s32(line->yl + i + 1), vld1q_s32(line->yh + i + 2)),
+                      vld1q_s32(line->yl + i + 3));
+        unew = SUM4(line->cb, i);
+        vnew = SUM4(line->cr, i);
+        u = vmulq_n_s32(vaddq_s32(unew, vld1q_s32(delay_u + i)), off_flip);
+        v = vmulq_n_s32(vaddq_s32(vnew, vld1q_s32(delay_v + i)), off_flip);
+        vst1q_s32(delay_u + i, unew);
+        vst1q_s32(delay_v + i, vnew);
+
+        g = vmlaq_n_s32(vmulq_n_s32(u, 50), v, 130);
+        vst1q_s32(line->red + i, vshrq_n_s32(vaddq_s32(l, v), 16));
+        vst1q_s32(line->blu + i, vshrq_n_s32(vaddq_s32(l, u), 16));
+        vst1q_s32(line->grn + i, vshrq_n_s32(vsubq_s32(l, vshrq_n_s32(g, 8)), 16));
+    }
+
+    render_crt_pal_range(line, delay_u, delay_v, off_flip, i, count);
+}
+
+static void render_crt_ntsc_neon(render_crt_line_t *line, int32_t off_flip, unsigned int count)
+{
+    unsigned int i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        int32x4_t l, u, v, r, g, b;
+
+        l = vaddq_s32(vaddq_s32(vld1q_s32(line->yl + i + 1), vld1q_s32(line->yh + i + 2)),
+                      vld1q_s32(line->yl + i + 3));
+        u = vmulq_n_s32(SUM4(line->cb, i), off_flip);
+        v = vmulq_n_s32(SUM4(line->cr, i), off_flip);
+
+        r = vmlaq_n_s32(vmulq_n_s32(u, 209), v, 41);
+        g = vmlaq_n_s32(vmulq_n_s32(u, 48), v, 69);
+        b = vmlsq_n_s32(vmulq_n_s32(u, 139), v, 215);
+        vst1q_s32(line->red + i, vshrq_n_s32(vaddq_s32(l, vshrq_n_s32(r, 7)), 15));
+        vst1q_s32(line->grn + i, vshrq_n_s32(vsubq_s32(l, vshrq_n_s32(g, 7)), 15));
+        vst1q_s32(line->blu + i, vshrq_n_s32(vsubq_s32(l, vshrq_n_s32(b, 7)), 15));
+    }
+
+    render_crt_ntsc_range(line, off_flip, i, count);
+}
+
+#undef SUM4
+
+static const render_crt_kernels_t render_crt_kernels_neon = {
+    "NEON", render_crt_pal_neon, render_crt_ntsc_neon
+};
+#endif
+
+static const render_crt_kernels_t *render_crt_kernels = NULL;
+
+/* All kernels the CPU supports, the scalar ones first and the widest last */
+unsigned int render_crt_kernels_supported(const render_crt_kernels_t **list, unsigned int max)
+{
+    unsigned int num = 0;
+
+    if (num < max) {
+        list[num++] = &render_crt_kernels_scalar;
+    }
+#ifdef RENDER_CRT_SSE2
+    if (num < max) {
+        list[num++] = &render_crt_kernels_sse2;
+    }
+#endif
+#ifdef RENDER_CRT_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && num < max) {
+        list[num++] = &render_crt_kernels_avx2;
+    }
+#endif
+#ifdef RENDER_CRT_NEON
+    if (num < max) {
+        list[num++] = &render_crt_kernels_neon;
+    }
+#endif
+    return num;
+}
+
+/* Pick the widest kernels the CPU supports on first use */
+const render_crt_kernels_t *render_crt_kernels_get(void)
+{
+    const render_crt_kernels_t *list[RENDER_CRT_KERNELS_MAX];
+
+    if (render_crt_kernels != NULL) {
+        return render_crt_kernels;
+    }
+
+    render_crt_kernels = list[render_crt_kernels_supported(list, RENDER_CRT_KERNELS_MAX) - 1];
+
+    log_message(LOG_DEFAULT, "CRT emulation renderer: %s", render_crt_kernels->name);
+    return render_crt_kernels;
+}
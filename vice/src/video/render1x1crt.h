@@ -0,0 +1,70 @@
+/*
+ * render1x1crt.h - Line kernels for the 1x1 PAL/NTSC renderers
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#ifndef VICE_RENDER1X1CRT_H
+#define VICE_RENDER1X1CRT_H
+
+#include "types.h"
+
+#include "video.h"
+
+/* Per pixel color table values of one source line, starting 2 pixels left
+   of the first target pixel, and the resulting gamma table indexes */
+typedef struct render_crt_line_s {
+    int32_t yl[VIDEO_MAX_OUTPUT_WIDTH + 4];
+    int32_t yh[VIDEO_MAX_OUTPUT_WIDTH + 4];
+    int32_t cb[VIDEO_MAX_OUTPUT_WIDTH + 4];
+    int32_t cr[VIDEO_MAX_OUTPUT_WIDTH + 4];
+    int32_t red[VIDEO_MAX_OUTPUT_WIDTH];
+    int32_t grn[VIDEO_MAX_OUTPUT_WIDTH];
+    int32_t blu[VIDEO_MAX_OUTPUT_WIDTH];
+} render_crt_line_t;
+
+/* PAL kernels blend with the delay line (and update it), NTSC kernels
+   have no delay line */
+typedef void (*render_crt_pal_func_t)(render_crt_line_t *line, int32_t *delay_u, int32_t *delay_v,
+                                      int32_t off_flip, unsigned int count);
+typedef void (*render_crt_ntsc_func_t)(render_crt_line_t *line, int32_t off_flip, unsigned int count);
+
+typedef struct render_crt_kernels_s {
+    const char *name;
+    render_crt_pal_func_t pal;
+    render_crt_ntsc_func_t ntsc;
+} render_crt_kernels_t;
+
+#define RENDER_CRT_KERNELS_MAX 4
+
+extern render_crt_line_t render_crt_line;
+
+const render_crt_kernels_t *render_crt_kernels_get(void);
+unsigned int render_crt_kernels_supported(const render_crt_kernels_t **list, unsigned int max);
+
+/* Looks up `count' + 3 source pixels, of which only `avail' are in the
+   source row */
+void render_crt_line_fetch(render_crt_line_t *line, const video_render_color_tables_t *color_tab,
+                           const int32_t *cbtable, const int32_t *crtable,
+                           const uint8_t *src, unsigned int count, unsigned int avail);
+void render_crt_line_store(const render_crt_line_t *line, const video_render_color_tables_t *color_tab,
+                           uint8_t *trg, unsigned int count, unsigned int pixel_bytes);
+
+#endif
@@ -27,6 +27,7 @@
 
 #include "vice.h"
 
+#include "render1x1crt.h"
 #include "render1x1ntsc.h"
 #include "types.h"
 #include "video-color.h"
@@ -35,62 +36,6 @@
     right now this is basically the PAL renderer without delay line emulation
 */
 
-/*
-    YIQ->RGB (Sony CXA2025AS US decoder matrix)
-
-    R = Y + (1.630 * I + 0.317 * Q)
-    G = Y - (0.378 * I + 0.466 * Q)
-    B = Y - (1.089 * I - 1.677 * Q)
-*/
-static inline
-void yuv_to_rgb(int32_t y, int32_t u, int32_t v,
-                int32_t *red, int32_t *grn, int32_t *blu)
-{
-    *red = (y + ((209 * u +  41 * v) >> 7)) >> 15;
-    *grn = (y - (( 48 * u +  69 * v) >> 7)) >> 15;
-    *blu = (y - ((139 * u - 215 * v) >> 7)) >> 15;
-}
-
-#ifdef __LIBRETRO__
-static inline
-void store_pixel_2(video_render_color_tables_t *color_tab, uint8_t *trg, int32_t y1, int32_t u1, int32_t v1, int32_t y2, int32_t u2, int32_t v2)
-{
-    uint16_t *tmp;
-    int32_t red;
-    int32_t grn;
-    int32_t blu;
-
-    yuv_to_rgb(y1, u1, v1, &red, &grn, &blu);
-    tmp = (uint16_t *) trg;
-    tmp[0] = (uint16_t) (color_tab->gamma_red[256 + red] | color_tab->gamma_grn[256 + grn] | color_tab->gamma_blu[256 + blu]);
-
-    yuv_to_rgb(y2, u2, v2, &red, &grn, &blu);
-    tmp[1] = (uint16_t) (color_tab->gamma_red[256 + red] | color_tab->gamma_grn[256 + grn] | color_tab->gamma_blu[256 + blu]);
-}
-#endif
-
-static inline
-void store_pixel_4(video_render_color_tables_t *color_tab, uint8_t *trg, int32_t y1, int32_t u1, int32_t v1, int32_t y2, int32_t u2, int32_t v2)
-{
-    uint32_t *tmp;
-    int32_t red;
-    int32_t grn;
-    int32_t blu;
-
-    yuv_to_rgb(y1, u1, v1, &red, &grn, &blu);
-    tmp = (uint32_t *) trg;
-    tmp[0] = color_tab->gamma_red[256 + red]
-             | color_tab->gamma_grn[256 + grn]
-             | color_tab->gamma_blu[256 + blu]
-             | color_tab->alpha;
-
-    yuv_to_rgb(y2, u2, v2, &red, &grn, &blu);
-    tmp[1] = color_tab->gamma_red[256 + red]
-             | color_tab->gamma_grn[256 + grn]
-             | color_tab->gamma_blu[256 + blu]
-             | color_tab->alpha;
-}
-
 /* NTSC 1x1 renderers */
 static inline void
 render_generic_1x1_ntsc(video_render_color_tables_t *color_tab, const uint8_t *src, uint8_t *trg,
@@ -101,15 +46,11 @@ render_generic_1x1_ntsc(video_render_color_tables_t *color_tab, const uint8_t *s
                         const unsigned int pixelstride,
                         int yuvtarget)
 {
+    const render_crt_kernels_t *kernels = render_crt_kernels_get();
+    render_crt_line_t *line = &render_crt_line;
     const int32_t *cbtable;
     const int32_t *crtable;
-    const int32_t *ytablel = color_tab->ytablel;
-    const int32_t *ytableh = color_tab->ytableh;
-    const uint8_t *tmpsrc;
-    uint8_t *tmptrg;
-    unsigned int x, y;
-    int32_t l1, l2, u1, u2, v1, v2, unew, vnew;
-    uint8_t cl0, cl1, cl2, cl3;
+    unsigned int y, count, avail;
     int off_flip;
 
     /* ensure starting on even coords */
@@ -122,51 +63,22 @@ render_generic_1x1_ntsc(video_render_color_tables_t *color_tab, const uint8_t *s
     src = src + pitchs * ys + xs - 2;
     trg = trg + pitcht * yt + (xt >> 1) * pixelstride;
 
-    width >>= 1;
+    /* source pixels from src to the end of its row */
+    avail = pitchs + 2 - xs;
 
-    off_flip = 1 << 6;
+    /* pixels are rendered in pairs */
+    count = width & ~1;
 
-    for (y = ys; y < height + ys; y++) {
-        tmpsrc = src;
-        tmptrg = trg;
+    off_flip = 1 << 6;
 
-        cbtable = yuvtarget ? color_tab->cutable : color_tab->cbtable;
-        crtable = yuvtarget ? color_tab->cvtable : color_tab->crtable;
+    cbtable = yuvtarget ? color_tab->cutable : color_tab->cbtable;
+    crtable = yuvtarget ? color_tab->cvtable : color_tab->crtable;
 
+    for (y = ys; y < height + ys; y++) {
         /* one scanline */
-        for (x = 0; x < width; x++) {
-            cl0 = tmpsrc[0];
-            cl1 = tmpsrc[1];
-            cl2 = tmpsrc[2];
-            cl3 = tmpsrc[3];
-            tmpsrc += 1;
-            l1 = ytablel[cl1] + ytableh[cl2] + ytablel[cl3];
-            unew = cbtable[cl0] + cbtable[cl1] + cbtable[cl2] + cbtable[cl3];
-            vnew = crtable[cl0] + crtable[cl1] + crtable[cl2] + crtable[cl3];
-            u1 = (unew) * off_flip;
-            v1 = (vnew) * off_flip;
-
-            cl0 = tmpsrc[0];
-            cl1 = tmpsrc[1];
-            cl2 = tmpsrc[2];
-            cl3 = tmpsrc[3];
-            tmpsrc += 1;
-            l2 = ytablel[cl1] + ytableh[cl2] + ytablel[cl3];
-            unew = cbtable[cl0] + cbtable[cl1] + cbtable[cl2] + cbtable[cl3];
-            vnew = crtable[cl0] + crtable[cl1] + crtable[cl2] + crtable[cl3];
-            u2 = (unew) * off_flip;
-            v2 = (vnew) * off_flip;
-
-#ifdef __LIBRETRO__
-            if (pix_bytes == 2)
-               store_pixel_2(color_tab, tmptrg, l1, u1, v1, l2, u2, v2);
-            else
-               store_pixel_4(color_tab, tmptrg, l1, u1, v1, l2, u2, v2);
-#else
-            store_pixel_4(color_tab, tmptrg, l1, u1, v1, l2, u2, v2);
-#endif
-            tmptrg += pixelstride;
-        }
+        render_crt_line_fetch(line, color_tab, cbtable, crtable, src, count, avail);
+        kernels->ntsc(line, off_flip, count);
+        render_crt_line_store(line, color_tab, trg, count, pixelstride >> 1);
 
         src += pitchs;
         trg += pitcht;
@@ -26,66 +26,11 @@
 
 #include "vice.h"
 
+#include "render1x1crt.h"
 #include "render1x1pal.h"
 #include "types.h"
 #include "video-color.h"
 
-/*
-    YUV to RGB
-
-    R = Y + V
-    G = Y - (0.1953 * U + 0.5078 * V)
-    B = Y + U
-*/
-static inline
-void yuv_to_rgb(int32_t y, int32_t u, int32_t v,
-                int32_t *red, int32_t *grn, int32_t *blu)
-{
-    *red = (y + v) >> 16;
-    *blu = (y + u) >> 16;
-    *grn = (y - ((50 * u + 130 * v) >> 8)) >> 16;
-}
-
-#ifdef __LIBRETRO__
-static inline
-void store_pixel_2(video_render_color_tables_t *color_tab, uint8_t *trg, int32_t y1, int32_t u1, int32_t v1, int32_t y2, int32_t u2, int32_t v2)
-{
-    uint16_t *tmp;
-    int32_t red;
-    int32_t grn;
-    int32_t blu;
-
-    yuv_to_rgb(y1, u1, v1, &red, &grn, &blu);
-    tmp = (uint16_t *) trg;
-    tmp[0] = (uint16_t) (color_tab->gamma_red[256 + red] | color_tab->gamma_grn[256 + grn] | color_tab->gamma_blu[256 + blu]);
-
-    yuv_to_rgb(y2, u2, v2, &red, &grn, &blu);
-    tmp[1] = (uint16_t) (color_tab->gamma_red[256 + red] | color_tab->gamma_grn[256 + grn] | color_tab->gamma_blu[256 + blu]);
-}
-#endif
-
-static inline
-void store_pixel_4(video_render_color_tables_t *color_tab, uint8_t *trg, int32_t y1, int32_t u1, int32_t v1, int32_t y2, int32_t u2, int32_t v2)
-{
-    uint32_t *tmp;
-    int32_t red;
-    int32_t grn;
-    int32_t blu;
-
-    yuv_to_rgb(y1, u1, v1, &red, &grn, &blu);
-    tmp = (uint32_t *) trg;
-    tmp[0] = color_tab->gamma_red[256 + red]
-             | color_tab->gamma_grn[256 + grn]
-             | color_tab->gamma_blu[256 + blu]
-             | color_tab->alpha;
-
-    yuv_to_rgb(y2, u2, v2, &red, &grn, &blu);
-    tmp[1] = color_tab->gamma_red[256 + red]
-             | color_tab->gamma_grn[256 + grn]
-             | color_tab->gamma_blu[256 + blu]
-             | color_tab->alpha;
-}
-
 /* PAL 1x1 renderers */
 static inline void
 render_generic_1x1_pal(video_render_color_tables_t *color_tab, const uint8_t *src, uint8_t *trg,
@@ -96,15 +41,13 @@ render_generic_1x1_pal(video_render_color_tables_t *color_tab, const uint8_t *sr
                        const unsigned int pixelstride,
                        int yuvtarget, video_render_config_t *config)
 {
+    const render_crt_kernels_t *kernels = render_crt_kernels_get();
+    render_crt_line_t *line = &render_crt_line;
     const int32_t *cbtable;
     const int32_t *crtable;
-    const int32_t *ytablel = color_tab->ytablel;
-    const int32_t *ytableh = color_tab->ytableh;
     const uint8_t *tmpsrc;
-    uint8_t *tmptrg;
-    unsigned int x, y;
-    int32_t *line, l1, l2, u1, u2, v1, v2, unew, vnew;
-    uint8_t cl0, cl1, cl2, cl3;
+    unsigned int x, y, count, avail;
+    int32_t *delay_u, *delay_v;
     int off, off_flip;
 
     /* ensure starting on even coords */
@@ -117,7 +60,11 @@ render_generic_1x1_pal(video_render_color_tables_t *color_tab, const uint8_t *sr
     src = src + pitchs * ys + xs - 2;
     trg = trg + pitcht * yt + (xt >> 1) * pixelstride;
 
-    line = color_tab->line_yuv_0;
+    /* source pixels from src to the end of its row */
+    avail = pitchs + 2 - xs;
+
+    delay_u = color_tab->line_yuv_0;
+    delay_v = color_tab->line_yuv_0 + VIDEO_MAX_OUTPUT_WIDTH;
     tmpsrc = ys > 0 ? src - pitchs : src;
 
     /* is the previous line odd or even? (inverted condition!) */
@@ -130,28 +77,19 @@ render_generic_1x1_pal(video_render_color_tables_t *color_tab, const uint8_t *sr
     }
 
     /* prepare previous (delay-)line */
+    render_crt_line_fetch(line, color_tab, cbtable, crtable, tmpsrc, width, avail);
     for (x = 0; x < width; x++) {
-        cl0 = tmpsrc[0];
-        cl1 = tmpsrc[1];
-        cl2 = tmpsrc[2];
-        cl3 = tmpsrc[3];
-        tmpsrc += 1;
-        line[0] = (cbtable[cl0] + cbtable[cl1] + cbtable[cl2] + cbtable[cl3]);
-        line[1] = (crtable[cl0] + crtable[cl1] + crtable[cl2] + crtable[cl3]);
-        line += 2;
+        delay_u[x] = line->cb[x] + line->cb[x + 1] + line->cb[x + 2] + line->cb[x + 3];
+        delay_v[x] = line->cr[x] + line->cr[x + 1] + line->cr[x + 2] + line->cr[x + 3];
     }
 
-    width >>= 1;
+    /* pixels are rendered in pairs */
+    count = width & ~1;
 
     /* Calculate odd line shading */
     off = (int) (((float) config->video_resources.pal_oddlines_offset * (1.5f / 2000.0f) - (1.5f / 2.0f - 1.0f)) * (1 << 5));
 
     for (y = ys; y < height + ys; y++) {
-        tmpsrc = src;
-        tmptrg = trg;
-
-        line = color_tab->line_yuv_0;
-
         if (y & 1) { /* odd sourceline */
             off_flip = off;
             cbtable = yuvtarget ? color_tab->cutable_odd : color_tab->cbtable_odd;
@@ -163,45 +101,9 @@ render_generic_1x1_pal(video_render_color_tables_t *color_tab, const uint8_t *sr
         }
 
         /* one scanline */
-        for (x = 0; x < width; x++) {
-            cl0 = tmpsrc[0];
-            cl1 = tmpsrc[1];
-            cl2 = tmpsrc[2];
-            cl3 = tmpsrc[3];
-            tmpsrc += 1;
-            l1 = ytablel[cl1] + ytableh[cl2] + ytablel[cl3];
-            unew = cbtable[cl0] + cbtable[cl1] + cbtable[cl2] + cbtable[cl3];
-            vnew = crtable[cl0] + crtable[cl1] + crtable[cl2] + crtable[cl3];
-            u1 = (unew + line[0]) * off_flip;
-            v1 = (vnew + line[1]) * off_flip;
-            line[0] = unew;
-            line[1] = vnew;
-            line += 2;
-
-            cl0 = tmpsrc[0];
-            cl1 = tmpsrc[1];
-            cl2 = tmpsrc[2];
-            cl3 = tmpsrc[3];
-            tmpsrc += 1;
-            l2 = ytablel[cl1] + ytableh[cl2] + ytablel[cl3];
-            unew = cbtable[cl0] + cbtable[cl1] + cbtable[cl2] + cbtable[cl3];
-            vnew = crtable[cl0] + crtable[cl1] + crtable[cl2] + crtable[cl3];
-            u2 = (unew + line[0]) * off_flip;
-            v2 = (vnew + line[1]) * off_flip;
-            line[0] = unew;
-            line[1] = vnew;
-            line += 2;
-
-#ifdef __LIBRETRO__
-            if (pix_bytes == 2)
-               store_pixel_2(color_tab, tmptrg, l1, u1, v1, l2, u2, v2);
-            else
-               store_pixel_4(color_tab, tmptrg, l1, u1, v1, l2, u2, v2);
-#else
-            store_pixel_4(color_tab, tmptrg, l1, u1, v1, l2, u2, v2);
-#endif
-            tmptrg += pixelstride;
-        }
+        render_crt_line_fetch(line, color_tab, cbtable, crtable, src, count, avail);
+        kernels->pal(line, delay_u, delay_v, off_flip, count);
+        render_crt_line_store(line, color_tab, trg, count, pixelstride >> 1);
 
         src += pitchs;
         trg += pitcht;
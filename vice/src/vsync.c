@@ -78,6 +78,7 @@
 
 #ifdef __LIBRETRO__
 #include "monitor.h"
+extern bool retro_runahead_hidden;
 #endif
 
 /* public metrics, updated every vsync */
@@ -649,6 +650,13 @@ bool vsync_should_skip_frame(struct video_canvas_s *canvas)
         return true;
     }
 
+#ifdef __LIBRETRO__
+    /* Runahead frames which are never shown */
+    if (retro_runahead_hidden) {
+        return true;
+    }
+#endif
+
     /*
      * Limit rendering fps if we're in warp mode.
      * It's ugly enough for dqh to weep but makes warp faster.